@@ -7,6 +7,8 @@
 #include "threads/io.h"
 #include "threads/interrupt.h"
 #include "threads/synch.h"
+#include "threads/trace.h"
+#include "threads/tsc.h"
 
 /* The code in this file is an interface to an ATA (IDE)
    controller.  It attempts to comply to [ATA-3]. */
@@ -97,6 +99,7 @@ static void select_device (const struct disk *);
 static void select_device_wait (const struct disk *);
 
 static void interrupt_handler (struct intr_frame *);
+static int disk_id (const struct disk *);
 
 /* Initialize the disk subsystem and detect disks. */
 void
@@ -220,6 +223,7 @@ void
 disk_read (struct disk *d, disk_sector_t sec_no, void *buffer) 
 {
   struct channel *c;
+  uint64_t start = rdtsc ();
   
   ASSERT (d != NULL);
   ASSERT (buffer != NULL);
@@ -234,6 +238,7 @@ disk_read (struct disk *d, disk_sector_t sec_no, void *buffer)
   input_sector (c, buffer);
   d->read_cnt++;
   lock_release (&c->lock);
+  TRACE (TRACE_DISK_READ, disk_id (d), sec_no, rdtsc () - start);
 }
 
 /* Write sector SEC_NO to disk D from BUFFER, which must contain
@@ -245,6 +250,7 @@ void
 disk_write (struct disk *d, disk_sector_t sec_no, const void *buffer)
 {
   struct channel *c;
+  uint64_t start = rdtsc ();
   
   ASSERT (d != NULL);
   ASSERT (buffer != NULL);
@@ -259,8 +265,17 @@ disk_write (struct disk *d, disk_sector_t sec_no, const void *buffer)
   sema_down (&c->completion_wait);
   d->write_cnt++;
   lock_release (&c->lock);
+  TRACE (TRACE_DISK_WRITE, disk_id (d), sec_no, rdtsc () - start);
 }
 
+/* Returns D's number as used by disk_get(): its channel number
+   times 2 plus its device number. */
+static int
+disk_id (const struct disk *d) 
+{
+  return (d->channel - channels) * 2 + d->dev_no;
+}
+
 /* Disk detection and identification. */
 
 static void print_ata_string (char *string, size_t size);
@@ -0,0 +1,262 @@
+#include "devices/lapic.h"
+#include <debug.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/pte.h"
+#include "threads/vaddr.h"
+
+/* Local APIC.
+
+   Every processor has a local APIC, which receives interrupts
+   for it, sends inter-processor interrupts (IPIs) to other
+   processors, and contains a timer.  Its registers are memory
+   mapped, normally at physical address 0xfee00000.
+
+   See [IA32-v3a] chapter 8 "Advanced Programmable Interrupt
+   Controller (APIC)". */
+
+/* Kernel virtual address at which the local APIC's registers are
+   mapped, in every page directory.  Each processor sees its own
+   local APIC at the same address.  This lies far above the
+   kernel's mapping of physical memory. */
+#define LAPIC_VADDR 0xfee00000
+
+/* Register offsets, in bytes. */
+#define LAPIC_ID     0x020      /* Local APIC ID. */
+#define LAPIC_TPR    0x080      /* Task priority. */
+#define LAPIC_EOI    0x0b0      /* End of interrupt. */
+#define LAPIC_SVR    0x0f0      /* Spurious interrupt vector. */
+#define LAPIC_ICRLO  0x300      /* Interrupt command, low half. */
+#define LAPIC_ICRHI  0x310      /* Interrupt command, high half. */
+#define LAPIC_TIMER  0x320      /* Local vector table: timer. */
+#define LAPIC_TICR   0x380      /* Timer initial count. */
+#define LAPIC_TCCR   0x390      /* Timer current count. */
+#define LAPIC_TDCR   0x3e0      /* Timer divide configuration. */
+
+/* Register bits. */
+#define SVR_ENABLE     0x00000100 /* Software enable. */
+#define ICR_INIT       0x00000500 /* INIT IPI. */
+#define ICR_STARTUP    0x00000600 /* Startup IPI. */
+#define ICR_PENDING    0x00001000 /* Delivery status. */
+#define ICR_ASSERT     0x00004000 /* Level assert. */
+#define ICR_LEVEL      0x00008000 /* Level triggered. */
+#define TIMER_MASKED   0x00010000 /* Timer interrupt masked. */
+#define TIMER_PERIODIC 0x00020000 /* Periodic, not one-shot. */
+#define APIC_BASE_MSR  0x1b       /* IA32_APIC_BASE model-specific register. */
+#define TDCR_DIV16     0x00000003 /* Divide bus clock by 16. */
+
+/* Cache-disable and write-through page table bits, for memory
+   mapped I/O.  See [IA32-v3a] 3.7.6 "Page-Directory and
+   Page-Table Entries". */
+#define PTE_PWT 0x08
+#define PTE_PCD 0x10
+
+static volatile uint32_t *lapic;
+
+/* Timer counts per timer tick, as calibrated against the PIT. */
+static uint32_t lapic_timer_count;
+
+static bool lapic_present (void);
+static void lapic_write (int reg, uint32_t value);
+static uint32_t lapic_read (int reg);
+static void icr_send (unsigned apic_id, uint32_t command);
+static intr_handler_func spurious_interrupt;
+
+/* If the processor has a local APIC, maps its registers,
+   enables the bootstrap processor's local APIC, calibrates the
+   local APIC timer against the PIT, and returns true.  The
+   bootstrap processor keeps taking its timer ticks from the PIT
+   and uses its local APIC timer only for lapic_oneshot().
+   Returns false if there is no local APIC.
+
+   Interrupts must be on, for calibration. */
+bool
+lapic_init (void) 
+{
+  uint32_t *pt;
+  uint32_t elapsed;
+  uint64_t base;
+  uintptr_t paddr;
+
+  ASSERT (intr_get_level () == INTR_ON);
+
+  if (!lapic_present ())
+    return false;
+  asm volatile ("rdmsr" : "=A" (base) : "c" (APIC_BASE_MSR));
+  paddr = base & 0xfffff000;
+
+  /* Map the registers, uncached. */
+  ASSERT (base_page_dir[pd_no ((void *) LAPIC_VADDR)] == 0);
+  pt = palloc_get_page (PAL_ASSERT | PAL_ZERO | PAL_TAG (MEM_PAGETABLE));
+  pt[pt_no ((void *) LAPIC_VADDR)] = paddr | PTE_PCD | PTE_PWT | PTE_W | PTE_P;
+  base_page_dir[pd_no ((void *) LAPIC_VADDR)] = pde_create (pt);
+  asm volatile ("movl %0, %%cr3" : : "r" (vtop (base_page_dir)) : "memory");
+  lapic = (volatile uint32_t *) LAPIC_VADDR;
+
+  intr_register_int (LAPIC_SPURIOUS_VEC, 0, INTR_OFF, spurious_interrupt,
+                     "LAPIC spurious");
+  lapic_write (LAPIC_SVR, SVR_ENABLE | LAPIC_SPURIOUS_VEC);
+  lapic_write (LAPIC_TPR, 0);
+
+  /* Count down from the maximum, masked, for 10 timer ticks. */
+  lapic_write (LAPIC_TDCR, TDCR_DIV16);
+  lapic_write (LAPIC_TIMER, TIMER_MASKED | LAPIC_TIMER_VEC);
+  lapic_write (LAPIC_TICR, 0xffffffff);
+  timer_sleep (10);
+  elapsed = 0xffffffff - lapic_read (LAPIC_TCCR);
+  lapic_write (LAPIC_TICR, 0);
+  lapic_timer_count = elapsed / 10;
+  printf ("lapic: id %u, timer %'u counts per tick\n",
+          lapic_id (), lapic_timer_count);
+  return true;
+}
+
+/* Returns true if lapic_init() found a local APIC. */
+bool
+lapic_enabled (void) 
+{
+  return lapic != NULL;
+}
+
+/* Enables the running application processor's local APIC and
+   starts its timer, interrupting TIMER_FREQ times per second on
+   LAPIC_TIMER_VEC.  The application processors take their
+   scheduler ticks from it. */
+void
+lapic_init_ap (void) 
+{
+  ASSERT (lapic != NULL);
+
+  lapic_write (LAPIC_SVR, SVR_ENABLE | LAPIC_SPURIOUS_VEC);
+  lapic_write (LAPIC_TPR, 0);
+  lapic_write (LAPIC_TDCR, TDCR_DIV16);
+  lapic_write (LAPIC_TIMER, TIMER_PERIODIC | LAPIC_TIMER_VEC);
+  lapic_write (LAPIC_TICR, lapic_timer_count);
+}
+
+/* Makes the running processor's local APIC timer interrupt once,
+   on LAPIC_ONESHOT_VEC, NS nanoseconds from now, replacing any
+   one-shot already programmed.  If NS is 0 or less, the
+   interrupt is immediate; if NS is INT64_MAX, the timer is
+   stopped instead. */
+void
+lapic_oneshot (int64_t ns) 
+{
+  const int64_t ns_per_tick = 1000 * 1000 * 1000 / TIMER_FREQ;
+  int64_t count;
+
+  ASSERT (lapic != NULL);
+
+  if (ns == INT64_MAX) 
+    {
+      lapic_write (LAPIC_TICR, 0);
+      return;
+    }
+
+  /* Don't overflow the 32-bit counter, or the multiplication:
+     an early interrupt just reprograms the timer. */
+  if (ns > 100 * ns_per_tick)
+    ns = 100 * ns_per_tick;
+  count = ns * lapic_timer_count / ns_per_tick;
+  if (count < 1)
+    count = 1;
+  else if (count > 0xffffffff)
+    count = 0xffffffff;
+
+  lapic_write (LAPIC_TIMER, LAPIC_ONESHOT_VEC);
+  lapic_write (LAPIC_TICR, count);
+}
+
+/* Returns the running processor's local APIC ID. */
+unsigned
+lapic_id (void) 
+{
+  return lapic_read (LAPIC_ID) >> 24;
+}
+
+/* Acknowledges the interrupt being handled by the running
+   processor's local APIC. */
+void
+lapic_eoi (void) 
+{
+  lapic_write (LAPIC_EOI, 0);
+}
+
+/* Starts the application processor with local APIC ID APIC_ID
+   executing real-mode code at physical address PADDR, which
+   must be page-aligned and below 1 MB, with the INIT-SIPI-SIPI
+   sequence of [MP] appendix B.4.  Sleeps, so interrupts must be
+   on. */
+void
+lapic_start_ap (unsigned apic_id, uintptr_t paddr) 
+{
+  int i;
+
+  ASSERT (pg_ofs ((void *) paddr) == 0 && paddr < 0x100000);
+
+  icr_send (apic_id, ICR_INIT | ICR_LEVEL | ICR_ASSERT);
+  timer_usleep (200);
+  icr_send (apic_id, ICR_INIT | ICR_LEVEL);
+  timer_msleep (10);
+
+  for (i = 0; i < 2; i++) 
+    {
+      icr_send (apic_id, ICR_STARTUP | (paddr >> 12));
+      timer_usleep (200);
+    }
+}
+
+/* Sends interrupt VEC to the processor whose local APIC has ID
+   APIC_ID. */
+void
+lapic_send_ipi (unsigned apic_id, uint8_t vec) 
+{
+  icr_send (apic_id, vec);
+}
+
+/* Returns true if the processor has a local APIC, according to
+   CPUID.  See [IA32-v2a] "CPUID". */
+static bool
+lapic_present (void) 
+{
+  uint32_t eax = 1, ebx, ecx, edx;
+
+  asm volatile ("cpuid" : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+  return (edx & (1u << 9)) != 0;
+}
+
+/* Sends COMMAND to the local APIC with ID APIC_ID and waits for
+   it to be delivered. */
+static void
+icr_send (unsigned apic_id, uint32_t command) 
+{
+  lapic_write (LAPIC_ICRHI, apic_id << 24);
+  lapic_write (LAPIC_ICRLO, command);
+  while (lapic_read (LAPIC_ICRLO) & ICR_PENDING)
+    continue;
+}
+
+/* Writes VALUE to local APIC register REG, then reads a register
+   to wait for the write to finish. */
+static void
+lapic_write (int reg, uint32_t value) 
+{
+  lapic[reg / 4] = value;
+  (void) lapic[LAPIC_ID / 4];
+}
+
+/* Returns the value of local APIC register REG. */
+static uint32_t
+lapic_read (int reg) 
+{
+  return lapic[reg / 4];
+}
+
+/* Spurious interrupts need no acknowledgment. */
+static void
+spurious_interrupt (struct intr_frame *f UNUSED) 
+{
+}
@@ -0,0 +1,24 @@
+#ifndef DEVICES_LAPIC_H
+#define DEVICES_LAPIC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Interrupt vectors used by the local APIC.  They lie outside
+   the range 0x20...0x2f used by the 8259A PICs. */
+#define LAPIC_TIMER_VEC 0x40    /* Local APIC timer, periodic. */
+#define LAPIC_ONESHOT_VEC 0x41  /* Local APIC timer, one-shot. */
+#define LAPIC_RESCHED_VEC 0x42  /* IPI: reschedule. */
+#define LAPIC_TLB_VEC 0x43      /* IPI: flush the TLB. */
+#define LAPIC_SPURIOUS_VEC 0xff /* Spurious interrupt. */
+
+bool lapic_init (void);
+bool lapic_enabled (void);
+void lapic_init_ap (void);
+void lapic_oneshot (int64_t ns);
+unsigned lapic_id (void);
+void lapic_eoi (void);
+void lapic_start_ap (unsigned apic_id, uintptr_t paddr);
+void lapic_send_ipi (unsigned apic_id, uint8_t vec);
+
+#endif /* devices/lapic.h */
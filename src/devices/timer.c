@@ -3,10 +3,13 @@
 #include <inttypes.h>
 #include <round.h>
 #include <stdio.h>
+#include "devices/lapic.h"
 #include "threads/interrupt.h"
 #include "threads/io.h"
+#include "threads/smp.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
+#include "threads/tsc.h"
   
 /* See [8254] for hardware details of the 8254 timer chip. */
 
@@ -24,7 +27,82 @@ static int64_t ticks;
    Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
 
+/* TSC cycles per timer tick, or 0 until timer_calibrate() has
+   measured it, and the TSC value at which tick 0 began. */
+static uint64_t tsc_per_tick;
+static uint64_t tsc_base;
+
+/* If true, the idle thread stops the periodic timer interrupt
+   while nothing is runnable.  Controlled by kernel command-line
+   option "-tickless". */
+bool timer_tickless;
+
+/* PIT input clock cycles per timer tick. */
+static uint16_t pit_tick_count;
+
+/* Tickless state.  While ONESHOT_TICKS is nonzero, the PIT is in
+   one-shot mode rather than periodic mode, and its next
+   interrupt marks the end of ONESHOT_TICKS ticks.  The one-shot
+   count was ONESHOT_COUNT, and ONESHOT_PHASE PIT cycles of the
+   current tick had already elapsed when it was programmed.
+   IDLE_ONESHOT is true if the one-shot was started by the idle
+   thread, so that an earlier interrupt has to catch up. */
+static int64_t oneshot_ticks;
+static unsigned oneshot_count;
+static unsigned oneshot_phase;
+static bool idle_oneshot;
+
+/* Hierarchical timing wheel for pending timer events.
+
+   The root wheel has one slot per tick for the next TVR_SIZE
+   ticks.  Each of the TVN_CNT outer wheels has TVN_SIZE slots,
+   each slot covering TVN_SIZE times as many ticks as a slot of
+   the wheel inside it.  An event is filed in the innermost
+   wheel whose range covers its expiry time, so arming and
+   cancelling are O(1).  Each time the root wheel wraps around,
+   the next slot of the first outer wheel is "cascaded", that is,
+   its events are refiled into the root wheel, and so on
+   outward.  Each event is cascaded at most TVN_CNT times, so
+   expiry is O(1) amortized.
+
+   Events more than 2**32 ticks away are filed as if they
+   expired 2**32 - 1 ticks from now; cascading files them again
+   later, so they still fire at the right time. */
+#define TVR_BITS 8
+#define TVN_BITS 6
+#define TVN_CNT 4
+#define TVR_SIZE (1 << TVR_BITS)
+#define TVN_SIZE (1 << TVN_BITS)
+#define TVR_MASK (TVR_SIZE - 1)
+#define TVN_MASK (TVN_SIZE - 1)
+#define TV_MAX_DELTA 0xffffffffLL
+
+/* Pending high-resolution timer events, ordered by expiry.
+   HIRES is true if the local APIC timer signals the earliest
+   one; otherwise they are run from the timer tick. */
+static struct rbtree hrtimers;
+static bool hires;
+static long long hrtimer_fired;
+
+static struct list wheel_root[TVR_SIZE];
+static struct list wheel_outer[TVN_CNT][TVN_SIZE];
+
+/* Next tick whose root wheel slot has not been run yet. */
+static int64_t wheel_ticks;
+
 static intr_handler_func timer_interrupt;
+static void wheel_add (struct timer_event *);
+static void wheel_cascade (struct list *slot);
+static void wheel_run (void);
+static timer_event_func wake_sleeper;
+static void timer_advance (void);
+static void pit_set_periodic (void);
+static void pit_set_oneshot (unsigned count);
+static rb_less_func hrtimer_less;
+static intr_handler_func hrtimer_interrupt;
+static void hrtimer_run (void);
+static void hrtimer_program (void);
+static void hrtimer_sleep (int64_t ns);
 static bool too_many_loops (unsigned loops);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
@@ -37,20 +115,29 @@ timer_init (void)
 {
   /* 8254 input frequency divided by TIMER_FREQ, rounded to
      nearest. */
-  uint16_t count = (1193180 + TIMER_FREQ / 2) / TIMER_FREQ;
+  int i, j;
 
-  outb (0x43, 0x34);    /* CW: counter 0, LSB then MSB, mode 2, binary. */
-  outb (0x40, count & 0xff);
-  outb (0x40, count >> 8);
+  for (i = 0; i < TVR_SIZE; i++)
+    list_init (&wheel_root[i]);
+  for (i = 0; i < TVN_CNT; i++)
+    for (j = 0; j < TVN_SIZE; j++)
+      list_init (&wheel_outer[i][j]);
+  rb_init (&hrtimers, hrtimer_less, NULL);
+
+  pit_tick_count = (1193180 + TIMER_FREQ / 2) / TIMER_FREQ;
+  pit_set_periodic ();
 
   intr_register_ext (0x20, timer_interrupt, "8254 Timer");
 }
 
-/* Calibrates loops_per_tick, used to implement brief delays. */
+/* Calibrates loops_per_tick, used to implement brief delays,
+   and the TSC rate used by timer_ns(). */
 void
 timer_calibrate (void) 
 {
   unsigned high_bit, test_bit;
+  int64_t start;
+  uint64_t tsc;
 
   ASSERT (intr_get_level () == INTR_ON);
   printf ("Calibrating timer...  ");
@@ -71,6 +158,34 @@ timer_calibrate (void)
       loops_per_tick |= test_bit;
 
   printf ("%'"PRIu64" loops/s.\n", (uint64_t) loops_per_tick * TIMER_FREQ);
+
+  /* Count TSC cycles over 4 ticks, from one tick boundary to
+     another. */
+  start = ticks;
+  while (ticks == start)
+    barrier ();
+  tsc = rdtsc ();
+  start = ticks;
+  while (ticks - start < 4)
+    barrier ();
+  tsc_per_tick = (rdtsc () - tsc) / 4;
+  tsc_base = tsc - start * tsc_per_tick;
+}
+
+/* Starts delivering high-resolution timer events with the local
+   APIC timer, if there is one.  Must be called after
+   timer_calibrate(). */
+void
+timer_hires_init (void) 
+{
+  ASSERT (tsc_per_tick != 0);
+
+  hires = lapic_init ();
+  if (hires)
+    intr_register_int (LAPIC_ONESHOT_VEC, 0, INTR_OFF, hrtimer_interrupt,
+                       "LAPIC one-shot");
+  printf ("Clock: TSC at %'"PRIu64" kHz, %s high-resolution timer events.\n",
+          timer_tsc_hz () / 1000, hires ? "local APIC" : "tick-driven");
 }
 
 /* Returns the number of timer ticks since the OS booted. */
@@ -96,13 +211,67 @@ timer_elapsed (int64_t then)
 void
 timer_sleep (int64_t ticks) 
 {
+  struct timer_event alarm;
+  enum intr_level old_level;
   int64_t start = timer_ticks ();
 
   ASSERT (intr_get_level () == INTR_ON);
-  // while (timer_elapsed (start) < ticks) 
-  //   thread_yield ();
+  if (ticks <= 0)
+    return;
 
-  thread_sleep(start + ticks);
+  timer_event_init (&alarm, wake_sleeper, thread_current ());
+  old_level = intr_disable ();
+  timer_event_arm (&alarm, start + ticks);
+  thread_block ();
+  intr_set_level (old_level);
+}
+
+/* Timer event function for timer_sleep(): wakes up thread T_,
+   preempting the running thread if T_ has higher priority. */
+static void
+wake_sleeper (void *t_) 
+{
+  struct thread *t = t_;
+
+  thread_unblock (t);
+  if (t->priority > thread_current ()->priority)
+    intr_yield_on_return ();
+}
+
+/* Returns nanoseconds since the OS booted.  Before
+   timer_calibrate(), the result only advances once per tick. */
+int64_t
+timer_ns (void) 
+{
+  uint64_t tsc;
+
+  if (tsc_per_tick == 0)
+    return timer_ticks () * TIMER_NS_PER_TICK;
+  tsc = rdtsc ();
+  return tsc > tsc_base ? timer_tsc_to_ns (tsc - tsc_base) : 0;
+}
+
+/* Returns the number of nanoseconds in CYCLES TSC cycles, or 0
+   before timer_calibrate(). */
+int64_t
+timer_tsc_to_ns (uint64_t cycles) 
+{
+  const uint64_t ns_per_s = 1000 * 1000 * 1000;
+  uint64_t hz = timer_tsc_hz ();
+
+  /* Split into whole seconds and a remainder, so that neither
+     multiplication overflows. */
+  if (hz == 0)
+    return 0;
+  return cycles / hz * ns_per_s + cycles % hz * ns_per_s / hz;
+}
+
+/* Returns the TSC frequency in Hz, or 0 before
+   timer_calibrate(). */
+uint64_t
+timer_tsc_hz (void) 
+{
+  return tsc_per_tick * TIMER_FREQ;
 }
 
 /* Suspends execution for approximately MS milliseconds. */
@@ -131,19 +300,460 @@ void
 timer_print_stats (void) 
 {
   printf ("Timer: %"PRId64" ticks\n", timer_ticks ());
+  if (hrtimer_fired > 0)
+    printf ("Timer: %lld high-resolution events\n", hrtimer_fired);
 }
 
+/* Initializes timer event EV to call FUNC with AUX when it
+   expires.  The event is not armed. */
+void
+timer_event_init (struct timer_event *ev, timer_event_func *func, void *aux) 
+{
+  ASSERT (ev != NULL);
+  ASSERT (func != NULL);
+
+  ev->expires = 0;
+  ev->func = func;
+  ev->aux = aux;
+  ev->pending = false;
+}
+
+/* Arms EV to fire when timer_ticks() reaches EXPIRES.  If EV is
+   already pending, it is moved to the new expiry time.  If
+   EXPIRES has already passed, EV fires on the next tick.
+
+   This function may be called from an interrupt handler. */
+void
+timer_event_arm (struct timer_event *ev, int64_t expires) 
+{
+  enum intr_level old_level;
+
+  ASSERT (ev != NULL);
+
+  old_level = intr_disable ();
+  if (ev->pending)
+    list_remove (&ev->elem);
+  ev->expires = expires;
+  ev->pending = true;
+  wheel_add (ev);
+  intr_set_level (old_level);
+}
+
+/* Cancels EV.  Returns true if EV was pending, false if it had
+   already fired or was never armed.  Once this function
+   returns, EV's function will not be called (unless EV is
+   armed again).
+
+   This function may be called from an interrupt handler. */
+bool
+timer_event_cancel (struct timer_event *ev) 
+{
+  enum intr_level old_level;
+  bool was_pending;
+
+  ASSERT (ev != NULL);
+
+  old_level = intr_disable ();
+  was_pending = ev->pending;
+  if (was_pending)
+    {
+      list_remove (&ev->elem);
+      ev->pending = false;
+    }
+  intr_set_level (old_level);
+
+  return was_pending;
+}
+
+/* Initializes high-resolution timer event EV to call FUNC with
+   AUX when it expires.  The event is not armed. */
+void
+hrtimer_init (struct hrtimer *ev, timer_event_func *func, void *aux) 
+{
+  ASSERT (ev != NULL);
+  ASSERT (func != NULL);
+
+  ev->expires = 0;
+  ev->func = func;
+  ev->aux = aux;
+  ev->pending = false;
+}
+
+/* Arms EV to fire when timer_ns() reaches EXPIRES.  If EV is
+   already pending, it is moved to the new expiry time.  If
+   EXPIRES has already passed, EV fires as soon as possible.
+
+   This function may be called from an interrupt handler. */
+void
+hrtimer_arm (struct hrtimer *ev, int64_t expires) 
+{
+  enum intr_level old_level;
+
+  ASSERT (ev != NULL);
+
+  old_level = intr_disable ();
+  if (ev->pending)
+    rb_remove (&hrtimers, &ev->node);
+  ev->expires = expires;
+  ev->pending = true;
+  rb_insert (&hrtimers, &ev->node);
+  if (rb_min (&hrtimers) == &ev->node)
+    hrtimer_program ();
+  intr_set_level (old_level);
+}
+
+/* Cancels EV.  Returns true if EV was pending, false if it had
+   already fired or was never armed.  Once this function
+   returns, EV's function will not be called (unless EV is
+   armed again).
+
+   This function may be called from an interrupt handler. */
+bool
+hrtimer_cancel (struct hrtimer *ev) 
+{
+  enum intr_level old_level;
+  bool was_pending;
+
+  ASSERT (ev != NULL);
+
+  old_level = intr_disable ();
+  was_pending = ev->pending;
+  if (was_pending)
+    {
+      rb_remove (&hrtimers, &ev->node);
+      ev->pending = false;
+    }
+  intr_set_level (old_level);
+
+  /* If EV was the earliest, the local APIC may still interrupt
+     for it; hrtimer_run() then finds nothing due and moves on. */
+  return was_pending;
+}
+
+/* Called by the idle thread, with interrupts off, just before
+   it halts the CPU.  In tickless mode, if no timer event is due
+   within the next tick, reprograms the PIT to interrupt only at
+   the tick when the earliest one is due.  Any interrupt that
+   arrives first calls timer_idle_exit() to catch up. */
+void
+timer_idle_enter (void) 
+{
+  unsigned max_ticks, n, elapsed;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!timer_tickless || oneshot_ticks != 0)
+    return;
+
+  /* Threads on the other processors need timer_ticks() to keep
+     counting. */
+  if (smp_online_cnt () > 1)
+    return;
+
+  /* Without the local APIC, high-resolution events need the
+     periodic tick. */
+  if (!hires && !rb_empty (&hrtimers))
+    return;
+
+  /* Find the first tick with something to do, looking no further
+     than the PIT's 16-bit counter can reach and no further than
+     the next cascade from the outer wheels.  wheel_ticks is
+     ticks + 1 here, so every slot examined holds only events
+     due at exactly that tick. */
+  max_ticks = 0xffff / pit_tick_count;
+  for (n = 1; n <= max_ticks; n++)
+    {
+      int64_t t = ticks + n;
+      if (!list_empty (&wheel_root[t & TVR_MASK]) || (t & TVR_MASK) == 0)
+        break;
+    }
+  if (n > max_ticks)
+    n = max_ticks;
+  if (n < 2)
+    return;
+
+  /* Latch the current count so that the one-shot ends exactly on
+     a tick boundary. */
+  outb (0x43, 0x00);    /* CW: counter 0, latch count. */
+  elapsed = inb (0x40);
+  elapsed |= inb (0x40) << 8;
+  elapsed = elapsed <= pit_tick_count ? pit_tick_count - elapsed : 0;
+
+  oneshot_ticks = n;
+  oneshot_phase = elapsed;
+  oneshot_count = n * pit_tick_count - elapsed;
+  idle_oneshot = true;
+  pit_set_oneshot (oneshot_count);
+}
+
+/* Called at the start of every external interrupt.  If the idle
+   thread's one-shot is still counting down, accounts for the
+   whole ticks that have passed, as idle time, and reprograms the
+   PIT to interrupt at the next tick boundary, after which it
+   goes back to periodic mode. */
+void
+timer_idle_exit (void) 
+{
+  unsigned status, count, since, whole;
+
+  ASSERT (intr_context ());
+
+  if (!idle_oneshot)
+    return;
+
+  outb (0x43, 0xc2);    /* CW: read back status and count of counter 0. */
+  status = inb (0x40);
+  count = inb (0x40);
+  count |= inb (0x40) << 8;
+  if (status & 0x80)
+    {
+      /* OUT is high: the one-shot has expired and its interrupt
+         is pending or being handled. */
+      return;
+    }
+
+  since = oneshot_phase + (oneshot_count - count);
+  whole = since / pit_tick_count;
+  oneshot_ticks = 0;
+  idle_oneshot = false;
+  while (whole-- > 0)
+    timer_advance ();
+
+  oneshot_ticks = 1;
+  oneshot_phase = since % pit_tick_count;
+  oneshot_count = pit_tick_count - oneshot_phase;
+  pit_set_oneshot (oneshot_count);
+}
+
 /* Timer interrupt handler. */
 static void
 timer_interrupt (struct intr_frame *args UNUSED)
+{
+  int64_t n = 1;
+
+  if (oneshot_ticks != 0)
+    {
+      n = oneshot_ticks;
+      oneshot_ticks = 0;
+      idle_oneshot = false;
+      pit_set_periodic ();
+    }
+  while (n-- > 0)
+    timer_advance ();
+}
+
+/* Does the work of a single timer tick. */
+static void
+timer_advance (void) 
 {
   ticks++;
   thread_tick ();
-  thread_check_sleepers(ticks);
+  wheel_run ();
+  hrtimer_run ();
   if (thread_mlfqs)
     thread_refresh_mlfqs(ticks);
 }
 
+/* Programs the PIT to interrupt once per tick. */
+static void
+pit_set_periodic (void) 
+{
+  outb (0x43, 0x34);    /* CW: counter 0, LSB then MSB, mode 2, binary. */
+  outb (0x40, pit_tick_count & 0xff);
+  outb (0x40, pit_tick_count >> 8);
+}
+
+/* Programs the PIT to interrupt once, COUNT input clock cycles
+   from now. */
+static void
+pit_set_oneshot (unsigned count) 
+{
+  ASSERT (count > 0 && count <= 0xffff);
+
+  outb (0x43, 0x30);    /* CW: counter 0, LSB then MSB, mode 0, binary. */
+  outb (0x40, count & 0xff);
+  outb (0x40, count >> 8);
+}
+
+/* Local APIC one-shot timer interrupt handler. */
+static void
+hrtimer_interrupt (struct intr_frame *args UNUSED) 
+{
+  hrtimer_run ();
+}
+
+/* Fires every high-resolution timer event that is due, then
+   programs the local APIC timer for the next one.  Interrupts
+   must be off. */
+static void
+hrtimer_run (void) 
+{
+  int64_t now;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (rb_empty (&hrtimers))
+    return;
+
+  now = timer_ns ();
+  while (!rb_empty (&hrtimers)) 
+    {
+      struct hrtimer *ev = rb_entry (rb_min (&hrtimers), struct hrtimer, node);
+      if (ev->expires > now)
+        break;
+      rb_remove (&hrtimers, &ev->node);
+      ev->pending = false;
+      hrtimer_fired++;
+      ev->func (ev->aux);
+    }
+  hrtimer_program ();
+}
+
+/* Programs the local APIC timer to interrupt when the earliest
+   pending high-resolution timer event is due.  Interrupts must
+   be off.
+
+   Only the bootstrap processor's local APIC timer is used this
+   way; the others give their processors scheduler ticks.  On
+   another processor, interrupts the bootstrap processor instead,
+   to have it reprogram its timer. */
+static void
+hrtimer_program (void) 
+{
+  struct hrtimer *ev;
+
+  if (!hires)
+    return;
+  if (!thread_cpu ()->bsp) 
+    {
+      if (!rb_empty (&hrtimers))
+        lapic_send_ipi (cpus[0].apic_id, LAPIC_ONESHOT_VEC);
+      return;
+    }
+  if (rb_empty (&hrtimers))
+    {
+      lapic_oneshot (INT64_MAX);
+      return;
+    }
+  ev = rb_entry (rb_min (&hrtimers), struct hrtimer, node);
+  lapic_oneshot (ev->expires - timer_ns ());
+}
+
+/* Orders high-resolution timer events by ascending expiry. */
+static bool
+hrtimer_less (const struct rb_node *a_, const struct rb_node *b_,
+              void *aux UNUSED) 
+{
+  const struct hrtimer *a = rb_entry (a_, struct hrtimer, node);
+  const struct hrtimer *b = rb_entry (b_, struct hrtimer, node);
+
+  return a->expires < b->expires;
+}
+
+/* Blocks the running thread for at least NS nanoseconds. */
+static void
+hrtimer_sleep (int64_t ns) 
+{
+  struct hrtimer alarm;
+  enum intr_level old_level;
+
+  hrtimer_init (&alarm, wake_sleeper, thread_current ());
+  old_level = intr_disable ();
+  hrtimer_arm (&alarm, timer_ns () + ns);
+  thread_block ();
+  intr_set_level (old_level);
+}
+
+/* Files EV in the timing wheel slot for its expiry time,
+   relative to wheel_ticks.  Interrupts must be off. */
+static void
+wheel_add (struct timer_event *ev) 
+{
+  int64_t expires = ev->expires;
+  int64_t delta = expires - wheel_ticks;
+  struct list *slot;
+
+  if (delta < 0)
+    {
+      /* Already due.  Fire when the current slot is run. */
+      slot = &wheel_root[wheel_ticks & TVR_MASK];
+    }
+  else if (delta < TVR_SIZE)
+    slot = &wheel_root[expires & TVR_MASK];
+  else 
+    {
+      int level, shift;
+
+      if (delta > TV_MAX_DELTA)
+        {
+          delta = TV_MAX_DELTA;
+          expires = wheel_ticks + delta;
+        }
+      for (level = 0; level < TVN_CNT - 1; level++)
+        if (delta < 1LL << (TVR_BITS + (level + 1) * TVN_BITS))
+          break;
+      shift = TVR_BITS + level * TVN_BITS;
+      slot = &wheel_outer[level][(expires >> shift) & TVN_MASK];
+    }
+  list_push_back (slot, &ev->elem);
+}
+
+/* Refiles all of the events in SLOT of an outer wheel into the
+   wheels inside it.  Interrupts must be off. */
+static void
+wheel_cascade (struct list *slot) 
+{
+  struct list moving;
+
+  list_init (&moving);
+  while (!list_empty (slot))
+    list_push_back (&moving, list_pop_front (slot));
+  while (!list_empty (&moving))
+    wheel_add (list_entry (list_pop_front (&moving),
+                           struct timer_event, elem));
+}
+
+/* Fires every event that has expired as of the current value of
+   `ticks'.  Runs in the timer interrupt handler. */
+static void
+wheel_run (void) 
+{
+  while (wheel_ticks <= ticks)
+    {
+      int index = wheel_ticks & TVR_MASK;
+      struct list *slot = &wheel_root[index];
+
+      /* When the root wheel wraps around, pull the events for
+         the next TVR_SIZE ticks in from the outer wheels. */
+      if (index == 0)
+        {
+          int level;
+
+          for (level = 0; level < TVN_CNT; level++)
+            {
+              int shift = TVR_BITS + level * TVN_BITS;
+              int outer_index = (wheel_ticks >> shift) & TVN_MASK;
+
+              wheel_cascade (&wheel_outer[level][outer_index]);
+              if (outer_index != 0)
+                break;
+            }
+        }
+      wheel_ticks++;
+
+      /* An event armed by one of these functions for a time that
+         has already passed goes into the next slot, not this
+         one, so this loop terminates. */
+      while (!list_empty (slot))
+        {
+          struct timer_event *ev = list_entry (list_pop_front (slot),
+                                               struct timer_event, elem);
+          ev->pending = false;
+          ev->func (ev->aux);
+        }
+    }
+}
+
 /* Returns true if LOOPS iterations waits for more than one timer
    tick, otherwise false. */
 static bool
@@ -197,6 +807,14 @@ real_time_sleep (int64_t num, int32_t denom)
          processes. */                
       timer_sleep (ticks); 
     }
+  else if (hires)
+    {
+      /* Block on a high-resolution timer for sub-tick timing.
+         NUM is less than DENOM / TIMER_FREQ here, so this can't
+         overflow. */
+      if (num > 0)
+        hrtimer_sleep (num * 1000 * 1000 * 1000 / denom);
+    }
   else 
     {
       /* Otherwise, use a busy-wait loop for more accurate
@@ -1,14 +1,21 @@
 #ifndef DEVICES_TIMER_H
 #define DEVICES_TIMER_H
 
+#include <list.h>
+#include <rbtree.h>
 #include <round.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 /* Number of timer interrupts per second. */
 #define TIMER_FREQ 100
 
+/* Nanoseconds per timer tick. */
+#define TIMER_NS_PER_TICK (1000 * 1000 * 1000 / TIMER_FREQ)
+
 void timer_init (void);
 void timer_calibrate (void);
+void timer_hires_init (void);
 
 int64_t timer_ticks (void);
 int64_t timer_elapsed (int64_t);
@@ -20,4 +27,70 @@ void timer_nsleep (int64_t nanoseconds);
 
 void timer_print_stats (void);
 
+/* Monotonic clock.
+
+   timer_ns() counts nanoseconds since boot, interpolated between
+   timer ticks with the CPU's time-stamp counter, which
+   timer_calibrate() measures against the PIT.  It is cheap
+   enough for instrumentation: an RDTSC and a few divisions.
+   timer_tsc_to_ns() converts TSC cycle counts, as recorded by
+   rdtsc() in threads/tsc.h, to nanoseconds. */
+int64_t timer_ns (void);
+int64_t timer_tsc_to_ns (uint64_t cycles);
+uint64_t timer_tsc_hz (void);
+
+/* Tickless idle. */
+extern bool timer_tickless;
+void timer_idle_enter (void);
+void timer_idle_exit (void);
+
+/* Timer events.
+
+   A timer event calls FUNC, passing AUX, from the timer
+   interrupt handler once timer_ticks() reaches EXPIRES.  FUNC
+   therefore runs in an external interrupt context: it must not
+   sleep, although it may call thread_unblock(),
+   intr_yield_on_return(), or re-arm its own event.
+
+   Arming, cancelling, and expiring an event all take constant
+   time, regardless of how many events are pending. */
+typedef void timer_event_func (void *aux);
+
+struct timer_event
+  {
+    struct list_elem elem;      /* Element in a timer wheel slot. */
+    int64_t expires;            /* Tick at which to fire. */
+    timer_event_func *func;     /* Function to call. */
+    void *aux;                  /* Auxiliary data for FUNC. */
+    bool pending;               /* Armed but not yet fired or cancelled? */
+  };
+
+void timer_event_init (struct timer_event *, timer_event_func *, void *aux);
+void timer_event_arm (struct timer_event *, int64_t expires);
+bool timer_event_cancel (struct timer_event *);
+
+/* High-resolution timer events.
+
+   Like a timer event, but expiring when timer_ns() reaches
+   EXPIRES, in nanoseconds.  Where the CPU has a local APIC, its
+   timer interrupts in one-shot mode when the earliest event is
+   due.  Otherwise, events fire on the first timer tick at or
+   after their expiry.  FUNC runs in an external interrupt
+   context, with the same restrictions as for timer events.
+
+   Arming and cancelling take O(log n) time for n pending
+   events. */
+struct hrtimer
+  {
+    struct rb_node node;        /* Element in pending tree. */
+    int64_t expires;            /* timer_ns() at which to fire. */
+    timer_event_func *func;     /* Function to call. */
+    void *aux;                  /* Auxiliary data for FUNC. */
+    bool pending;               /* Armed but not yet fired or cancelled? */
+  };
+
+void hrtimer_init (struct hrtimer *, timer_event_func *, void *aux);
+void hrtimer_arm (struct hrtimer *, int64_t expires);
+bool hrtimer_cancel (struct hrtimer *);
+
 #endif /* devices/timer.h */
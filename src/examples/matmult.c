@@ -3,6 +3,8 @@
    Test program to do matrix multiplication on large arrays.
  
    Intended to stress virtual memory system.
+
+   The rows of the product are divided among THREAD_CNT threads.
    
    Ideally, we could read the matrices off of the file system,
    and store the result back to the file system!
@@ -10,6 +12,7 @@
 
 #include <stdio.h>
 #include <syscall.h>
+#include <thread.h>
 
 /* You should define DIM to be large enough that the arrays
    don't fit in physical memory.
@@ -28,14 +31,30 @@
  16,384 3,145,728 kB */
 #define DIM 128
 
+/* Number of threads to multiply with. */
+#define THREAD_CNT 4
+
 int A[DIM][DIM];
 int B[DIM][DIM];
 int C[DIM][DIM];
 
+/* Computes rows (int) AUX, AUX + THREAD_CNT, ... of C. */
+static void
+multiply (void *aux)
+{
+  int i, j, k;
+
+  for (i = (int) aux; i < DIM; i += THREAD_CNT)
+    for (j = 0; j < DIM; j++)
+      for (k = 0; k < DIM; k++)
+	C[i][j] += A[i][k] * B[k][j];
+}
+
 int
 main (void)
 {
-  int i, j, k;
+  tid_t tids[THREAD_CNT];
+  int i, j;
 
   /* Initialize the matrices. */
   for (i = 0; i < DIM; i++)
@@ -46,11 +65,18 @@ main (void)
 	C[i][j] = 0;
       }
 
-  /* Multiply matrices. */
-  for (i = 0; i < DIM; i++)	
-    for (j = 0; j < DIM; j++)
-      for (k = 0; k < DIM; k++)
-	C[i][j] += A[i][k] * B[k][j];
+  /* Multiply matrices.  We compute share 0 ourselves, as well as
+     any share whose thread cannot be created. */
+  for (i = 1; i < THREAD_CNT; i++)
+    {
+      tids[i] = thread_create (multiply, (void *) i);
+      if (tids[i] == TID_ERROR)
+	multiply ((void *) i);
+    }
+  multiply ((void *) 0);
+  for (i = 1; i < THREAD_CNT; i++)
+    if (tids[i] != TID_ERROR)
+      thread_join (tids[i]);
 
   /* Done. */
   exit (C[DIM - 1][DIM - 1]);
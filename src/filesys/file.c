@@ -17,7 +17,7 @@ struct file
 struct file *
 file_open (struct inode *inode) 
 {
-  struct file *file = calloc (1, sizeof *file);
+  struct file *file = calloc_tagged (1, sizeof *file, MEM_FILESYS);
   if (inode != NULL && file != NULL)
     {
       file->inode = inode;
@@ -81,7 +81,7 @@ inode_create (disk_sector_t sector, off_t length)
      one sector in size, and you should fix that. */
   ASSERT (sizeof *disk_inode == DISK_SECTOR_SIZE);
 
-  disk_inode = calloc (1, sizeof *disk_inode);
+  disk_inode = calloc_tagged (1, sizeof *disk_inode, MEM_FILESYS);
   if (disk_inode != NULL)
     {
       size_t sectors = bytes_to_sectors (length);
@@ -127,7 +127,7 @@ inode_open (disk_sector_t sector)
     }
 
   /* Allocate memory. */
-  inode = malloc (sizeof *inode);
+  inode = malloc_tagged (sizeof *inode, MEM_FILESYS);
   if (inode == NULL)
     return NULL;
 
@@ -231,7 +231,7 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
              into caller's buffer. */
           if (bounce == NULL) 
             {
-              bounce = malloc (DISK_SECTOR_SIZE);
+              bounce = malloc_tagged (DISK_SECTOR_SIZE, MEM_FILESYS);
               if (bounce == NULL)
                 break;
             }
@@ -291,7 +291,7 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
           /* We need a bounce buffer. */
           if (bounce == NULL) 
             {
-              bounce = malloc (DISK_SECTOR_SIZE);
+              bounce = malloc_tagged (DISK_SECTOR_SIZE, MEM_FILESYS);
               if (bounce == NULL)
                 break;
             }
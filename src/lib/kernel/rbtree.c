@@ -0,0 +1,345 @@
+#include "rbtree.h"
+#include "../debug.h"
+
+/* The algorithms are those of Cormen, Leiserson, Rivest, and
+   Stein, _Introduction to Algorithms_, chapter 13, except that
+   null pointers stand in for the black sentinel leaves. */
+
+static void rotate_left (struct rbtree *, struct rb_node *);
+static void rotate_right (struct rbtree *, struct rb_node *);
+static void transplant (struct rbtree *, struct rb_node *,
+                        struct rb_node *);
+static void insert_fixup (struct rbtree *, struct rb_node *);
+static void remove_fixup (struct rbtree *, struct rb_node *,
+                          struct rb_node *);
+
+/* Returns true if node N is red.  Null nodes are black. */
+static inline bool
+is_red (const struct rb_node *n) 
+{
+  return n != NULL && n->red;
+}
+
+/* Initializes TREE as an empty tree ordered by LESS, given
+   auxiliary data AUX. */
+void
+rb_init (struct rbtree *tree, rb_less_func *less, void *aux) 
+{
+  ASSERT (tree != NULL);
+  ASSERT (less != NULL);
+
+  tree->root = NULL;
+  tree->min = NULL;
+  tree->size = 0;
+  tree->less = less;
+  tree->aux = aux;
+}
+
+/* Inserts NODE into TREE.  NODE is placed after any nodes that
+   compare equal to it. */
+void
+rb_insert (struct rbtree *tree, struct rb_node *node) 
+{
+  struct rb_node *parent = NULL;
+  struct rb_node **link = &tree->root;
+  bool leftmost = true;
+
+  ASSERT (tree != NULL);
+  ASSERT (node != NULL);
+
+  while (*link != NULL) 
+    {
+      parent = *link;
+      if (tree->less (node, parent, tree->aux))
+        link = &parent->left;
+      else 
+        {
+          link = &parent->right;
+          leftmost = false;
+        }
+    }
+
+  node->parent = parent;
+  node->left = node->right = NULL;
+  node->red = true;
+  *link = node;
+  if (leftmost)
+    tree->min = node;
+  tree->size++;
+
+  insert_fixup (tree, node);
+}
+
+/* Removes NODE, which must be in TREE, from TREE. */
+void
+rb_remove (struct rbtree *tree, struct rb_node *node) 
+{
+  struct rb_node *x, *x_parent;
+  bool removed_red = node->red;
+
+  ASSERT (tree != NULL);
+  ASSERT (node != NULL);
+  ASSERT (tree->size > 0);
+
+  if (tree->min == node)
+    tree->min = rb_next (node);
+
+  if (node->left == NULL) 
+    {
+      x = node->right;
+      x_parent = node->parent;
+      transplant (tree, node, node->right);
+    }
+  else if (node->right == NULL) 
+    {
+      x = node->left;
+      x_parent = node->parent;
+      transplant (tree, node, node->left);
+    }
+  else 
+    {
+      /* Replace NODE by its successor Y. */
+      struct rb_node *y = node->right;
+      while (y->left != NULL)
+        y = y->left;
+      removed_red = y->red;
+      x = y->right;
+      if (y->parent == node)
+        x_parent = y;
+      else 
+        {
+          x_parent = y->parent;
+          transplant (tree, y, y->right);
+          y->right = node->right;
+          y->right->parent = y;
+        }
+      transplant (tree, node, y);
+      y->left = node->left;
+      y->left->parent = y;
+      y->red = node->red;
+    }
+  tree->size--;
+
+  if (!removed_red)
+    remove_fixup (tree, x, x_parent);
+}
+
+/* Returns the smallest node in TREE, or a null pointer if TREE
+   is empty.  Takes constant time. */
+struct rb_node *
+rb_min (const struct rbtree *tree) 
+{
+  return tree->min;
+}
+
+/* Returns the node that follows NODE in its tree, or a null
+   pointer if NODE is the largest. */
+struct rb_node *
+rb_next (struct rb_node *node) 
+{
+  ASSERT (node != NULL);
+
+  if (node->right != NULL) 
+    {
+      node = node->right;
+      while (node->left != NULL)
+        node = node->left;
+      return node;
+    }
+  while (node->parent != NULL && node == node->parent->right)
+    node = node->parent;
+  return node->parent;
+}
+
+/* Returns the number of nodes in TREE. */
+size_t
+rb_size (const struct rbtree *tree) 
+{
+  return tree->size;
+}
+
+/* Returns true if TREE is empty, false otherwise. */
+bool
+rb_empty (const struct rbtree *tree) 
+{
+  return tree->root == NULL;
+}
+
+/* Makes X's right child take X's place in TREE, with X as its
+   left child. */
+static void
+rotate_left (struct rbtree *tree, struct rb_node *x) 
+{
+  struct rb_node *y = x->right;
+
+  x->right = y->left;
+  if (y->left != NULL)
+    y->left->parent = x;
+  transplant (tree, x, y);
+  y->left = x;
+  x->parent = y;
+}
+
+/* Makes X's left child take X's place in TREE, with X as its
+   right child. */
+static void
+rotate_right (struct rbtree *tree, struct rb_node *x) 
+{
+  struct rb_node *y = x->left;
+
+  x->left = y->right;
+  if (y->right != NULL)
+    y->right->parent = x;
+  transplant (tree, x, y);
+  y->right = x;
+  x->parent = y;
+}
+
+/* Replaces the subtree rooted at U by the one rooted at V, which
+   may be null. */
+static void
+transplant (struct rbtree *tree, struct rb_node *u, struct rb_node *v) 
+{
+  if (u->parent == NULL)
+    tree->root = v;
+  else if (u == u->parent->left)
+    u->parent->left = v;
+  else
+    u->parent->right = v;
+  if (v != NULL)
+    v->parent = u->parent;
+}
+
+/* Restores the red-black properties after inserting red node N
+   into TREE. */
+static void
+insert_fixup (struct rbtree *tree, struct rb_node *n) 
+{
+  struct rb_node *p;
+
+  while ((p = n->parent) != NULL && p->red) 
+    {
+      /* P is red, so it is not the root and G exists. */
+      struct rb_node *g = p->parent;
+
+      if (p == g->left) 
+        {
+          struct rb_node *u = g->right;
+          if (is_red (u)) 
+            {
+              p->red = u->red = false;
+              g->red = true;
+              n = g;
+              continue;
+            }
+          if (n == p->right) 
+            {
+              rotate_left (tree, p);
+              n = p;
+              p = n->parent;
+            }
+          p->red = false;
+          g->red = true;
+          rotate_right (tree, g);
+        }
+      else 
+        {
+          struct rb_node *u = g->left;
+          if (is_red (u)) 
+            {
+              p->red = u->red = false;
+              g->red = true;
+              n = g;
+              continue;
+            }
+          if (n == p->left) 
+            {
+              rotate_right (tree, p);
+              n = p;
+              p = n->parent;
+            }
+          p->red = false;
+          g->red = true;
+          rotate_left (tree, g);
+        }
+    }
+  tree->root->red = false;
+}
+
+/* Restores the red-black properties after removing a black node
+   from TREE.  X, which may be null, is the node that took its
+   place, and PARENT is X's parent. */
+static void
+remove_fixup (struct rbtree *tree, struct rb_node *x,
+              struct rb_node *parent) 
+{
+  while (x != tree->root && !is_red (x)) 
+    {
+      if (x == parent->left) 
+        {
+          struct rb_node *w = parent->right;
+          if (w->red) 
+            {
+              w->red = false;
+              parent->red = true;
+              rotate_left (tree, parent);
+              w = parent->right;
+            }
+          if (!is_red (w->left) && !is_red (w->right)) 
+            {
+              w->red = true;
+              x = parent;
+              parent = x->parent;
+            }
+          else 
+            {
+              if (!is_red (w->right)) 
+                {
+                  w->left->red = false;
+                  w->red = true;
+                  rotate_right (tree, w);
+                  w = parent->right;
+                }
+              w->red = parent->red;
+              parent->red = false;
+              w->right->red = false;
+              rotate_left (tree, parent);
+              x = tree->root;
+            }
+        }
+      else 
+        {
+          struct rb_node *w = parent->left;
+          if (w->red) 
+            {
+              w->red = false;
+              parent->red = true;
+              rotate_right (tree, parent);
+              w = parent->left;
+            }
+          if (!is_red (w->right) && !is_red (w->left)) 
+            {
+              w->red = true;
+              x = parent;
+              parent = x->parent;
+            }
+          else 
+            {
+              if (!is_red (w->left)) 
+                {
+                  w->right->red = false;
+                  w->red = true;
+                  rotate_left (tree, w);
+                  w = parent->left;
+                }
+              w->red = parent->red;
+              parent->red = false;
+              w->left->red = false;
+              rotate_right (tree, parent);
+              x = tree->root;
+            }
+        }
+    }
+  if (x != NULL)
+    x->red = false;
+}
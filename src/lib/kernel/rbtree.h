@@ -0,0 +1,69 @@
+#ifndef __LIB_KERNEL_RBTREE_H
+#define __LIB_KERNEL_RBTREE_H
+
+/* Red-black tree.
+
+   A balanced binary search tree: insertion and removal take
+   O(lg n) time, and the minimum element is cached so that it can
+   be found in O(1) time.  This makes it suitable for priority
+   queues, such as run queues ordered by a scheduling key.
+
+   Like the linked list and hash table implementations, the tree
+   does not use dynamic allocation.  Each structure that can be
+   in a tree must embed a struct rb_node member, and the
+   rb_entry macro converts a struct rb_node back to the structure
+   that contains it.  Refer to lib/kernel/list.h for a detailed
+   explanation of the technique.
+
+   Elements that compare equal are kept in insertion order, so
+   that rb_min() returns the one inserted first. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Tree node. */
+struct rb_node 
+  {
+    struct rb_node *parent;     /* Parent, or null for the root. */
+    struct rb_node *left;       /* Left child, or null. */
+    struct rb_node *right;      /* Right child, or null. */
+    bool red;                   /* Red or black? */
+  };
+
+/* Converts pointer to tree node RB_NODE into a pointer to the
+   structure that RB_NODE is embedded inside.  Supply the name of
+   the outer structure STRUCT and the member name MEMBER of the
+   tree node. */
+#define rb_entry(RB_NODE, STRUCT, MEMBER)                       \
+        ((STRUCT *) ((uint8_t *) &(RB_NODE)->parent             \
+                     - offsetof (STRUCT, MEMBER.parent)))
+
+/* Compares the value of two tree nodes A and B, given auxiliary
+   data AUX.  Returns true if A is less than B, or false if A is
+   greater than or equal to B. */
+typedef bool rb_less_func (const struct rb_node *a,
+                           const struct rb_node *b,
+                           void *aux);
+
+/* Red-black tree. */
+struct rbtree 
+  {
+    struct rb_node *root;       /* Root node, or null if empty. */
+    struct rb_node *min;        /* Leftmost node, or null if empty. */
+    size_t size;                /* Number of nodes. */
+    rb_less_func *less;         /* Comparison function. */
+    void *aux;                  /* Auxiliary data for `less'. */
+  };
+
+void rb_init (struct rbtree *, rb_less_func *, void *aux);
+
+void rb_insert (struct rbtree *, struct rb_node *);
+void rb_remove (struct rbtree *, struct rb_node *);
+
+struct rb_node *rb_min (const struct rbtree *);
+struct rb_node *rb_next (struct rb_node *);
+size_t rb_size (const struct rbtree *);
+bool rb_empty (const struct rbtree *);
+
+#endif /* lib/kernel/rbtree.h */
@@ -0,0 +1,79 @@
+#ifndef __LIB_MEMSTAT_H
+#define __LIB_MEMSTAT_H
+
+#include <stdint.h>
+
+/* Memory allocation statistics, kept by the kernel and reported
+   by the memstat() system call. */
+
+/* Subsystems that allocate kernel memory.  Allocations that do
+   not name a tag are charged to MEM_MISC, or to MEM_USER for
+   user pool pages. */
+enum mem_tag
+  {
+    MEM_MISC,                   /* Not otherwise tagged. */
+    MEM_THREAD,                 /* Thread structures and stacks. */
+    MEM_PAGETABLE,              /* Page directories and tables. */
+    MEM_MALLOC,                 /* malloc() arenas (pages only). */
+    MEM_SLAB,                   /* Object cache slabs (pages only). */
+    MEM_USER,                   /* User pages. */
+    MEM_PROCESS,                /* Process bookkeeping. */
+    MEM_VM,                     /* Virtual memory bookkeeping. */
+    MEM_FILESYS,                /* File system. */
+    MEM_TAG_CNT
+  };
+
+/* Names of the tags, in order. */
+#define MEM_TAG_NAMES                                           \
+  { "misc", "thread", "pagetable", "malloc", "slab", "user",     \
+    "process", "vm", "filesys" }
+
+/* Usage by one tag.  Pages are counted where they come from the
+   page allocator, bytes where objects come from malloc() or an
+   object cache, so malloc() and cache pages are counted twice:
+   once as MEM_MALLOC or MEM_SLAB pages, and again as bytes of
+   the tags of the objects in them. */
+struct mem_tag_stats
+  {
+    uint32_t pages;             /* Pages allocated now. */
+    uint32_t peak_pages;        /* Most pages ever allocated at once. */
+    uint32_t bytes;             /* Bytes allocated now. */
+    uint32_t peak_bytes;        /* Most bytes ever allocated at once. */
+    uint64_t allocs;            /* Allocations, pages or objects. */
+    uint64_t frees;             /* Frees, pages or objects. */
+  };
+
+/* Occupancy of one malloc() size class. */
+#define MEM_CLASS_MAX 10
+struct mem_class_stats
+  {
+    uint32_t block_size;        /* Size of each block. */
+    uint32_t arenas;            /* Arenas (pages) in use. */
+    uint32_t blocks;            /* Blocks in those arenas. */
+    uint32_t used;              /* Blocks allocated. */
+  };
+
+/* Filled in by the memstat() system call. */
+struct memstat
+  {
+    int64_t ticks;                      /* Timer ticks since boot. */
+    uint32_t kernel_pages;              /* Kernel pool size. */
+    uint32_t kernel_free;               /* ...of which free. */
+    uint32_t kernel_lent;               /* ...of which lent to user pool. */
+    uint32_t kernel_largest;            /* Largest free block, in pages. */
+    uint32_t user_pages;                /* User pool size. */
+    uint32_t user_free;                 /* ...of which free. */
+    uint32_t user_zeroed;               /* ...of which pre-zeroed. */
+    uint32_t user_lent;                 /* ...of which lent to kernel pool. */
+    uint32_t user_largest;              /* Largest free block, in pages. */
+    uint64_t zero_hits;                 /* Zeroed user pages from reserve. */
+    uint64_t zero_misses;               /* ...and cleared on demand. */
+    uint64_t large_maps;                /* 4 MB user pages mapped. */
+    uint64_t large_fallbacks;           /* ...or not, for lack of frames. */
+    uint32_t user_large;                /* 4 MB user pages mapped now. */
+    struct mem_tag_stats tags[MEM_TAG_CNT];
+    uint32_t class_cnt;                 /* Number of size classes. */
+    struct mem_class_stats classes[MEM_CLASS_MAX];
+  };
+
+#endif /* lib/memstat.h */
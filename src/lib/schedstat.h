@@ -0,0 +1,58 @@
+#ifndef __LIB_SCHEDSTAT_H
+#define __LIB_SCHEDSTAT_H
+
+#include <stdint.h>
+
+/* Scheduler statistics, kept by the kernel and reported by the
+   schedstat() system call.  All times are in CPU time-stamp
+   counter (TSC) cycles. */
+
+/* Wakeup latency histograms.  Priorities are grouped into
+   SCHED_BANDS bands of SCHED_BAND_WIDTH priorities each.  Bucket
+   0 counts latencies below 2**SCHED_HIST_SHIFT cycles, bucket B
+   counts latencies of at least 2**(SCHED_HIST_SHIFT + B - 1)
+   cycles, and the last bucket also counts everything longer. */
+#define SCHED_BANDS 8
+#define SCHED_BAND_WIDTH 8
+#define SCHED_HIST_BUCKETS 20
+#define SCHED_HIST_SHIFT 10
+
+/* Statistics for one thread. */
+struct sched_thread_stats
+  {
+    uint64_t run_time;          /* Time spent running. */
+    uint64_t wait_time;         /* Time spent ready but not running. */
+    uint64_t max_latency;       /* Longest wakeup-to-run latency. */
+    uint32_t wakeups;           /* Times unblocked. */
+    uint32_t vol_switches;      /* Times switched out by blocking. */
+    uint32_t invol_switches;    /* Times switched out while still ready. */
+    uint32_t preemptions;       /* Involuntary switches to a thread
+                                   of higher priority. */
+    uint32_t donations;         /* Times given a donated priority. */
+    uint32_t rt_misses;         /* Real-time deadlines missed. */
+  };
+
+/* System-wide statistics. */
+struct sched_sys_stats
+  {
+    uint64_t switches;          /* Context switches. */
+    uint64_t vol_switches;      /* ...by blocking. */
+    uint64_t invol_switches;    /* ...by yielding or preemption. */
+    uint64_t preemptions;       /* ...to a higher-priority thread. */
+    uint64_t wakeups;           /* Calls to thread_unblock(). */
+    uint64_t donations;         /* Priority donations. */
+    uint64_t rt_jobs;           /* Real-time jobs released. */
+    uint64_t rt_misses;         /* ...that missed their deadlines. */
+    uint64_t rt_throttles;      /* ...that ran out of budget. */
+    uint64_t rt_overruns;       /* ...that ran past the next release. */
+    uint32_t latency_hist[SCHED_BANDS][SCHED_HIST_BUCKETS];
+  };
+
+/* Filled in by the schedstat() system call. */
+struct schedstat
+  {
+    struct sched_thread_stats thread;   /* Calling thread. */
+    struct sched_sys_stats sys;         /* Whole system. */
+  };
+
+#endif /* lib/schedstat.h */
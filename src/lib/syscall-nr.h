@@ -28,7 +28,16 @@ enum
     SYS_MKDIR,                  /* Create a directory. */
     SYS_READDIR,                /* Reads a directory entry. */
     SYS_ISDIR,                  /* Tests if a fd represents a directory. */
-    SYS_INUMBER                 /* Returns the inode number for a fd. */
+    SYS_INUMBER,                /* Returns the inode number for a fd. */
+
+    /* Local extensions. */
+    SYS_SCHEDSTAT,              /* Obtain scheduler statistics. */
+    SYS_THREAD_SPAWN,           /* Start a thread in this process. */
+    SYS_THREAD_JOIN,            /* Wait for a thread to exit. */
+    SYS_FUTEX_WAIT,             /* Sleep while a user word is unchanged. */
+    SYS_FUTEX_WAKE,             /* Wake threads sleeping on a user word. */
+    SYS_MEMSTAT,                /* Obtain memory usage statistics. */
+    SYS_LARGEPAGES              /* Use 4 MB pages for a region. */
   };
 
 #endif /* lib/syscall-nr.h */
@@ -182,3 +182,45 @@ inumber (int fd)
 {
   return syscall1 (SYS_INUMBER, fd);
 }
+
+bool
+schedstat (struct schedstat *stats) 
+{
+  return syscall1 (SYS_SCHEDSTAT, stats);
+}
+
+tid_t
+thread_spawn (void (*entry) (void *, void *), void *a, void *b) 
+{
+  return syscall3 (SYS_THREAD_SPAWN, entry, a, b);
+}
+
+int
+thread_join (tid_t tid) 
+{
+  return syscall1 (SYS_THREAD_JOIN, tid);
+}
+
+int
+futex_wait (int *addr, int val) 
+{
+  return syscall2 (SYS_FUTEX_WAIT, addr, val);
+}
+
+int
+futex_wake (int *addr, int cnt) 
+{
+  return syscall2 (SYS_FUTEX_WAKE, addr, cnt);
+}
+
+bool
+memstat (struct memstat *stats) 
+{
+  return syscall1 (SYS_MEMSTAT, stats);
+}
+
+int
+largepages (void *addr, size_t size) 
+{
+  return syscall2 (SYS_LARGEPAGES, addr, size);
+}
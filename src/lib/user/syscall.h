@@ -2,12 +2,19 @@
 #define __LIB_USER_SYSCALL_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <debug.h>
+#include <memstat.h>
+#include <schedstat.h>
 
 /* Process identifier. */
 typedef int pid_t;
 #define PID_ERROR ((pid_t) -1)
 
+/* Thread identifier. */
+typedef int tid_t;
+#define TID_ERROR ((tid_t) -1)
+
 /* Map region identifier. */
 typedef int mapid_t;
 #define MAP_FAILED ((mapid_t) -1)
@@ -45,4 +52,13 @@ bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
 
+/* Local extensions. */
+bool schedstat (struct schedstat *);
+tid_t thread_spawn (void (*entry) (void *, void *), void *, void *);
+int thread_join (tid_t);
+int futex_wait (int *addr, int val);
+int futex_wake (int *addr, int cnt);
+bool memstat (struct memstat *);
+int largepages (void *addr, size_t size);
+
 #endif /* lib/user/syscall.h */
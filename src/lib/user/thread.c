@@ -0,0 +1,90 @@
+#include <thread.h>
+
+/* Atomically replaces *P by NEW if it equals OLD.  Returns the
+   previous value of *P. */
+static inline int
+cmpxchg (int *p, int old, int new) 
+{
+  int prev;
+  asm volatile ("lock cmpxchgl %2, %1"
+                : "=a" (prev), "+m" (*p) : "r" (new), "0" (old) : "memory");
+  return prev;
+}
+
+/* Atomically stores NEW in *P and returns the previous value. */
+static inline int
+xchg (int *p, int new) 
+{
+  asm volatile ("xchgl %0, %1" : "+r" (new), "+m" (*p) : : "memory");
+  return new;
+}
+
+/* Runs FUNC(AUX) in a new thread, then exits it. */
+static void
+thread_start (void *func, void *aux) 
+{
+  ((thread_func *) func) (aux);
+  thread_exit (0);
+}
+
+/* Starts a new thread running FUNC(AUX), which exits the thread
+   with status 0 if it returns.  Returns the new thread's tid, or
+   TID_ERROR if it could not be created. */
+tid_t
+thread_create (thread_func *func, void *aux) 
+{
+  return thread_spawn (thread_start, func, aux);
+}
+
+/* Ends the running thread with exit status STATUS, which
+   thread_join() returns. */
+void
+thread_exit (int status) 
+{
+  exit (status);
+}
+
+/* Initializes mutex M as unlocked. */
+void
+mutex_init (struct mutex *m) 
+{
+  m->state = 0;
+}
+
+/* Acquires mutex M, sleeping until it is available.  This
+   follows the futex mutex in Ulrich Drepper, "Futexes Are
+   Tricky". */
+void
+mutex_lock (struct mutex *m) 
+{
+  int c = cmpxchg (&m->state, 0, 1);
+  if (c == 0)
+    return;
+
+  /* Mark the mutex contended, then sleep until we are the one
+     who changes it from unlocked. */
+  if (c != 2)
+    c = xchg (&m->state, 2);
+  while (c != 0) 
+    {
+      futex_wait (&m->state, 2);
+      c = xchg (&m->state, 2);
+    }
+}
+
+/* Acquires mutex M if it is unlocked, without sleeping.  Returns
+   true if successful. */
+bool
+mutex_trylock (struct mutex *m) 
+{
+  return cmpxchg (&m->state, 0, 1) == 0;
+}
+
+/* Releases mutex M, which the running thread must hold, and
+   wakes one waiter if there may be any. */
+void
+mutex_unlock (struct mutex *m) 
+{
+  if (xchg (&m->state, 0) == 2)
+    futex_wake (&m->state, 1);
+}
@@ -0,0 +1,44 @@
+#ifndef __LIB_USER_THREAD_H
+#define __LIB_USER_THREAD_H
+
+#include <debug.h>
+#include <syscall.h>
+
+/* User threads.
+
+   Threads share their process's memory, open files, and
+   mappings.  Each has its own stack of up to 1 MB.  A process
+   can have at most 15 threads besides its initial thread.
+
+   exit() in a thread other than the initial one ends only that
+   thread.  When the initial thread exits, or any thread is
+   killed by a fault, the process's other threads are ended the
+   next time they enter the kernel or are interrupted, including
+   any sleeping in futex_wait(), and the initial thread waits
+   for them before the process goes away. */
+
+typedef void thread_func (void *aux);
+
+tid_t thread_create (thread_func *, void *aux);
+void thread_exit (int status) NO_RETURN;
+
+/* thread_join() is a system call; see <syscall.h>. */
+
+/* Mutex.
+
+   Locking or unlocking an uncontended mutex is a single atomic
+   instruction.  Only a thread that finds the mutex held enters
+   the kernel, to sleep on it with futex_wait(). */
+struct mutex 
+  {
+    int state;          /* 0: unlocked, 1: locked, 2: locked, waiters. */
+  };
+
+#define MUTEX_INITIALIZER { 0 }
+
+void mutex_init (struct mutex *);
+void mutex_lock (struct mutex *);
+bool mutex_trylock (struct mutex *);
+void mutex_unlock (struct mutex *);
+
+#endif /* lib/user/thread.h */
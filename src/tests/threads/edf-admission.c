@@ -0,0 +1,78 @@
+/* Creates two earliest-deadline-first real-time threads that
+   together reserve 80% of the CPU, then checks that admission
+   control rejects a third that would push the total past the
+   limit.  Each admitted thread then runs five periodic jobs,
+   none of which should miss its deadline. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define PERIOD 10
+#define JOB_CNT 5
+
+struct rt_info 
+  {
+    struct semaphore *done;     /* Upped when all jobs have run. */
+    unsigned misses;            /* Deadlines missed. */
+  };
+
+static thread_func rt_thread;
+
+void
+test_edf_admission (void) 
+{
+  struct semaphore done;
+  struct rt_info info[2];
+  int i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  sema_init (&done, 0);
+  for (i = 0; i < 2; i++) 
+    {
+      char name[16];
+
+      info[i].done = &done;
+      info[i].misses = 0;
+      snprintf (name, sizeof name, "rt %d", i);
+      if (thread_create_rt (name, PERIOD, 4, PERIOD,
+                            rt_thread, &info[i]) == TID_ERROR)
+        fail ("rt thread %d was not admitted", i);
+    }
+  msg ("Admitted two threads at 40%% each.");
+
+  if (thread_create_rt ("rt 2", PERIOD, 2, PERIOD,
+                        rt_thread, &info[0]) != TID_ERROR)
+    fail ("rt thread 2 was admitted past the utilization limit");
+  msg ("Rejected a third thread at 20%%.");
+
+  for (i = 0; i < 2; i++)
+    sema_down (&done);
+  for (i = 0; i < 2; i++)
+    msg ("rt %d missed %u deadlines.", i, info[i].misses);
+}
+
+static void 
+rt_thread (void *info_) 
+{
+  struct rt_info *info = info_;
+  int i;
+
+  for (i = 0; i < JOB_CNT; i++) 
+    {
+      int64_t start = timer_ticks ();
+
+      /* Busy-wait for about two ticks, half the budget. */
+      while (timer_elapsed (start) < 2)
+        continue;
+      if (i < JOB_CNT - 1)
+        thread_rt_wait_period ();
+    }
+  info->misses = thread_rt_misses ();
+  sema_up (info->done);
+}
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(edf-admission) begin
+(edf-admission) Admitted two threads at 40% each.
+(edf-admission) Rejected a third thread at 20%.
+(edf-admission) rt 0 missed 0 deadlines.
+(edf-admission) rt 1 missed 0 deadlines.
+(edf-admission) end
+EOF
+pass;
@@ -0,0 +1,58 @@
+/* Runs with more RAM than fits in the kernel's 1:1 mapping, and
+   checks that the memory beyond it is found and can be reached
+   through kmap(): allocates every high memory page, writes its
+   page number into it, reads the numbers back through fresh
+   mappings, and frees the pages again. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/highmem.h"
+#include "threads/init.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+void
+test_highmem (void) 
+{
+  size_t free_cnt = highmem_free_cnt ();
+  size_t first = 0, cnt = 0, bad = 0;
+  size_t pfn, *p;
+  void *page;
+
+  msg ("RAM extends beyond low memory: %s.",
+       ram_pages > lowmem_pages ? "yes" : "no");
+  msg ("High memory pages available: %s.", free_cnt > 0 ? "yes" : "no");
+
+  page = palloc_get_page (0);
+  msg ("kmap of a low memory page uses the 1:1 mapping: %s.",
+       kmap (vtop (page) >> PGBITS) == page ? "yes" : "no");
+  palloc_free_page (page);
+
+  /* Allocate every high page, chaining them together through
+     their first words. */
+  while ((pfn = highmem_alloc ()) != 0) 
+    {
+      p = kmap (pfn);
+      p[0] = first;
+      p[PGSIZE / sizeof *p - 1] = pfn;
+      kunmap (p);
+      first = pfn;
+      cnt++;
+    }
+  msg ("Allocated every high memory page: %s.",
+       cnt == free_cnt ? "yes" : "no");
+
+  while (first != 0) 
+    {
+      pfn = first;
+      p = kmap (pfn);
+      if (p[PGSIZE / sizeof *p - 1] != pfn)
+        bad++;
+      first = p[0];
+      kunmap (p);
+      highmem_free (pfn);
+    }
+  msg ("Pages with wrong contents: %zu.", bad);
+  msg ("All high memory pages freed: %s.",
+       highmem_free_cnt () == free_cnt ? "yes" : "no");
+}
@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(highmem) begin
+(highmem) RAM extends beyond low memory: yes.
+(highmem) High memory pages available: yes.
+(highmem) kmap of a low memory page uses the 1:1 mapping: yes.
+(highmem) Allocated every high memory page: yes.
+(highmem) Pages with wrong contents: 0.
+(highmem) All high memory pages freed: yes.
+(highmem) end
+EOF
+pass;
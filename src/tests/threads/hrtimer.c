@@ -0,0 +1,66 @@
+/* Checks that high-resolution timer events fire in expiry order,
+   that a cancelled event does not fire, and that sub-tick sleeps
+   last at least as long as requested. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+static struct semaphore done;
+static int64_t start;
+static struct hrtimer *last;
+
+static timer_event_func fire;
+
+void
+test_hrtimer (void) 
+{
+  struct hrtimer events[4];
+  int i;
+
+  sema_init (&done, 0);
+  for (i = 0; i < 4; i++)
+    hrtimer_init (&events[i], fire, &events[i]);
+
+  /* Arm out of order, all well under a tick apart. */
+  last = &events[3];
+  start = timer_ns ();
+  hrtimer_arm (&events[2], start + 3 * TIMER_NS_PER_TICK / 10);
+  hrtimer_arm (&events[0], start + 1 * TIMER_NS_PER_TICK / 10);
+  hrtimer_arm (&events[3], start + 4 * TIMER_NS_PER_TICK / 10);
+  hrtimer_arm (&events[1], start + 2 * TIMER_NS_PER_TICK / 10);
+  if (!hrtimer_cancel (&events[1]))
+    fail ("could not cancel pending event");
+  msg ("Armed events.");
+
+  sema_down (&done);
+  if (hrtimer_cancel (&events[0]))
+    fail ("fired event was still pending");
+  msg ("Events done.");
+
+  for (i = 1; i <= 3; i++) 
+    {
+      int64_t ns = i * TIMER_NS_PER_TICK / 4;
+      int64_t before = timer_ns ();
+      timer_nsleep (ns);
+      msg ("Slept for %s than %d/4 tick.",
+           timer_ns () - before >= ns ? "no less" : "less", i);
+    }
+}
+
+static void
+fire (void *ev_) 
+{
+  struct hrtimer *ev = ev_;
+
+  ASSERT (intr_context () || intr_get_level () == INTR_OFF);
+  msg ("Event with expiry %lld/10 tick fired %s.",
+       (ev->expires - start) * 10 / TIMER_NS_PER_TICK,
+       timer_ns () >= ev->expires ? "on time" : "too early");
+  if (ev == last)
+    sema_up (&done);
+}
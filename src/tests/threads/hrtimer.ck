@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(hrtimer) begin
+(hrtimer) Armed events.
+(hrtimer) Event with expiry 1/10 tick fired on time.
+(hrtimer) Event with expiry 3/10 tick fired on time.
+(hrtimer) Event with expiry 4/10 tick fired on time.
+(hrtimer) Events done.
+(hrtimer) Slept for no less than 1/4 tick.
+(hrtimer) Slept for no less than 2/4 tick.
+(hrtimer) Slept for no less than 3/4 tick.
+(hrtimer) end
+EOF
+pass;
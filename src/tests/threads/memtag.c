@@ -0,0 +1,54 @@
+/* Checks that malloc() and the page allocator charge allocations
+   to the tags their callers name, that realloc() keeps a block's
+   tag, and that freeing credits the tag back. */
+
+#include <stdio.h>
+#include <memstat.h>
+#include "tests/threads/tests.h"
+#include "threads/malloc.h"
+#include "threads/memtag.h"
+#include "threads/palloc.h"
+
+static struct mem_tag_stats get_tag (enum mem_tag);
+
+void
+test_memtag (void) 
+{
+  struct mem_tag_stats before, after;
+  void *p, *page;
+
+  before = get_tag (MEM_FILESYS);
+  p = malloc_tagged (100, MEM_FILESYS);
+  after = get_tag (MEM_FILESYS);
+  msg ("malloc_tagged (100): %d bytes charged.",
+       (int) (after.bytes - before.bytes));
+
+  p = realloc (p, 1000);
+  after = get_tag (MEM_FILESYS);
+  msg ("realloc (1000): %d bytes charged.",
+       (int) (after.bytes - before.bytes));
+
+  free (p);
+  after = get_tag (MEM_FILESYS);
+  msg ("free: %d bytes charged.", (int) (after.bytes - before.bytes));
+
+  before = get_tag (MEM_FILESYS);
+  page = palloc_get_page (PAL_TAG (MEM_FILESYS));
+  after = get_tag (MEM_FILESYS);
+  msg ("palloc_get_page: %d pages charged.",
+       (int) (after.pages - before.pages));
+  palloc_free_page (page);
+  after = get_tag (MEM_FILESYS);
+  msg ("palloc_free_page: %d pages charged.",
+       (int) (after.pages - before.pages));
+}
+
+/* Returns the current statistics for TAG. */
+static struct mem_tag_stats
+get_tag (enum mem_tag tag) 
+{
+  static struct memstat ms;
+
+  memtag_get_stats (&ms);
+  return ms.tags[tag];
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(memtag) begin
+(memtag) malloc_tagged (100): 128 bytes charged.
+(memtag) realloc (1000): 1024 bytes charged.
+(memtag) free: 0 bytes charged.
+(memtag) palloc_get_page: 1 pages charged.
+(memtag) palloc_free_page: 0 pages charged.
+(memtag) end
+EOF
+pass;
@@ -0,0 +1,49 @@
+/* Allocates user pages until none are left, and checks that the
+   user pool borrowed pages from the kernel pool before running
+   out, without dipping into the kernel pool's reserve, and that
+   freeing the pages returns them. */
+
+#include <stdio.h>
+#include <memstat.h>
+#include "tests/threads/tests.h"
+#include "threads/memtag.h"
+#include "threads/palloc.h"
+
+void
+test_palloc_borrow (void) 
+{
+  static struct memstat ms;
+  void *pages = NULL;
+  void *p;
+  size_t cnt = 0;
+
+  memtag_get_stats (&ms);
+  msg ("Kernel pool lent %u pages at start.", (unsigned) ms.kernel_lent);
+
+  /* Allocate user pages until there are no more, linking them
+     through their first words. */
+  while ((p = palloc_get_page (PAL_USER)) != NULL) 
+    {
+      *(void **) p = pages;
+      pages = p;
+      cnt++;
+    }
+
+  memtag_get_stats (&ms);
+  msg ("User pool borrowed from kernel pool: %s.",
+       ms.kernel_lent > 0 ? "yes" : "no");
+  msg ("Got more pages than the user pool holds: %s.",
+       cnt > ms.user_pages ? "yes" : "no");
+  msg ("Kernel pool kept its reserve: %s.",
+       ms.kernel_free >= ms.kernel_pages / 8 ? "yes" : "no");
+
+  while (pages != NULL) 
+    {
+      p = pages;
+      pages = *(void **) p;
+      palloc_free_page (p);
+    }
+
+  memtag_get_stats (&ms);
+  msg ("Kernel pool lent %u pages after freeing.", (unsigned) ms.kernel_lent);
+}
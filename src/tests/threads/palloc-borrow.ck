@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(palloc-borrow) begin
+(palloc-borrow) Kernel pool lent 0 pages at start.
+(palloc-borrow) User pool borrowed from kernel pool: yes.
+(palloc-borrow) Got more pages than the user pool holds: yes.
+(palloc-borrow) Kernel pool kept its reserve: yes.
+(palloc-borrow) Kernel pool lent 0 pages after freeing.
+(palloc-borrow) end
+EOF
+pass;
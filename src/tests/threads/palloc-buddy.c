@@ -0,0 +1,99 @@
+/* Exercises the buddy page allocator through the kernel pool.
+   Makes allocations of power-of-2 and odd sizes and checks that
+   each takes exactly the pages asked for, so that the unused
+   tail of its block went back to the pool; frees them in a
+   scattered order and checks that the blocks merged back into
+   the free page count and largest block seen at the start; and
+   makes one allocation bigger than the largest block. */
+
+#include <stdio.h>
+#include <string.h>
+#include <memstat.h>
+#include "tests/threads/tests.h"
+#include "threads/memtag.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* Sizes of the allocations, in pages. */
+static const size_t sizes[] = {1, 3, 8, 5, 2, 13, 16, 7, 4, 31, 64, 33};
+#define ALLOC_CNT (sizeof sizes / sizeof *sizes)
+
+/* Order in which to free them. */
+static const size_t free_order[ALLOC_CNT] = {7, 2, 10, 0, 5, 11, 3, 8, 1, 9, 6, 4};
+
+static bool pages_hold (const uint8_t *, size_t page_cnt, uint8_t value);
+
+void
+test_palloc_buddy (void) 
+{
+  static struct memstat ms;
+  uint8_t *pages[ALLOC_CNT];
+  size_t start_free, start_largest, free_cnt, huge_cnt;
+  bool exact = true, intact = true;
+  uint8_t *huge;
+  size_t i;
+
+  memtag_get_stats (&ms);
+  start_free = ms.kernel_free;
+  start_largest = ms.kernel_largest;
+
+  /* Allocate, checking that each allocation takes exactly its
+     own size from the pool, and fill each with its own byte. */
+  for (i = 0; i < ALLOC_CNT; i++) 
+    {
+      free_cnt = ms.kernel_free;
+      pages[i] = palloc_get_multiple (0, sizes[i]);
+      if (pages[i] == NULL)
+        fail ("allocation of %zu pages failed", sizes[i]);
+      memset (pages[i], i + 1, sizes[i] * PGSIZE);
+      memtag_get_stats (&ms);
+      if (free_cnt - ms.kernel_free != sizes[i])
+        exact = false;
+    }
+  msg ("Each allocation took exactly its own pages: %s.",
+       exact ? "yes" : "no");
+
+  for (i = 0; i < ALLOC_CNT; i++)
+    if (!pages_hold (pages[i], sizes[i], i + 1))
+      intact = false;
+  msg ("No allocations overlap: %s.", intact ? "yes" : "no");
+
+  for (i = 0; i < ALLOC_CNT; i++)
+    palloc_free_multiple (pages[free_order[i]], sizes[free_order[i]]);
+
+  memtag_get_stats (&ms);
+  msg ("Free pages back to start after freeing: %s.",
+       ms.kernel_free == start_free ? "yes" : "no");
+  msg ("Largest block back to start after freeing: %s.",
+       ms.kernel_largest == start_largest ? "yes" : "no");
+
+  /* One allocation bigger than any block, which has to be made
+     from a run of adjacent largest blocks. */
+  huge_cnt = ((size_t) 1 << PALLOC_MAX_ORDER) + 3;
+  huge = palloc_get_multiple (0, huge_cnt);
+  if (huge == NULL)
+    fail ("allocation of %zu pages failed", huge_cnt);
+  memtag_get_stats (&ms);
+  msg ("Allocation bigger than the largest block took exactly its "
+       "own pages: %s.", start_free - ms.kernel_free == huge_cnt ? "yes" : "no");
+  palloc_free_multiple (huge, huge_cnt);
+
+  memtag_get_stats (&ms);
+  msg ("Free pages back to start after freeing: %s.",
+       ms.kernel_free == start_free ? "yes" : "no");
+  msg ("Largest block back to start after freeing: %s.",
+       ms.kernel_largest == start_largest ? "yes" : "no");
+}
+
+/* Returns true if each byte in the PAGE_CNT pages at PAGES is
+   VALUE. */
+static bool
+pages_hold (const uint8_t *pages, size_t page_cnt, uint8_t value) 
+{
+  size_t i;
+
+  for (i = 0; i < page_cnt * PGSIZE; i++)
+    if (pages[i] != value)
+      return false;
+  return true;
+}
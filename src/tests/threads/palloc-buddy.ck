@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(palloc-buddy) begin
+(palloc-buddy) Each allocation took exactly its own pages: yes.
+(palloc-buddy) No allocations overlap: yes.
+(palloc-buddy) Free pages back to start after freeing: yes.
+(palloc-buddy) Largest block back to start after freeing: yes.
+(palloc-buddy) Allocation bigger than the largest block took exactly its own pages: yes.
+(palloc-buddy) Free pages back to start after freeing: yes.
+(palloc-buddy) Largest block back to start after freeing: yes.
+(palloc-buddy) end
+EOF
+pass;
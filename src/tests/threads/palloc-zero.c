@@ -0,0 +1,50 @@
+/* Checks that zeroed user page allocations are served from the
+   reserve that the zeroer thread fills in the background, and
+   that the pages they return are really zero. */
+
+#include <stdio.h>
+#include <string.h>
+#include <memstat.h>
+#include "tests/threads/tests.h"
+#include "threads/memtag.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+#include "devices/timer.h"
+
+#define PAGE_CNT 8
+
+void
+test_palloc_zero (void) 
+{
+  static struct memstat before, after;
+  uint8_t *pages[PAGE_CNT];
+  int i, j;
+
+  /* Dirty some user pages, then give the zeroer time to refill
+     its reserve. */
+  for (i = 0; i < PAGE_CNT; i++) 
+    {
+      pages[i] = palloc_get_page (PAL_USER | PAL_ASSERT);
+      memset (pages[i], 0xff, PGSIZE);
+    }
+  for (i = 0; i < PAGE_CNT; i++)
+    palloc_free_page (pages[i]);
+  timer_sleep (TIMER_FREQ / 10);
+
+  memtag_get_stats (&before);
+  for (i = 0; i < PAGE_CNT; i++)
+    pages[i] = palloc_get_page (PAL_USER | PAL_ZERO | PAL_ASSERT);
+  memtag_get_stats (&after);
+
+  for (i = 0; i < PAGE_CNT; i++)
+    for (j = 0; j < PGSIZE; j++)
+      if (pages[i][j] != 0)
+        fail ("byte %d of page %d is %#x, not zero", j, i, pages[i][j]);
+  msg ("All %d pages are zero.", PAGE_CNT);
+  msg ("%d came from the reserve, %d were cleared on demand.",
+       (int) (after.zero_hits - before.zero_hits),
+       (int) (after.zero_misses - before.zero_misses));
+
+  for (i = 0; i < PAGE_CNT; i++)
+    palloc_free_page (pages[i]);
+}
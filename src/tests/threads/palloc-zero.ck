@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(palloc-zero) begin
+(palloc-zero) All 8 pages are zero.
+(palloc-zero) 8 came from the reserve, 0 were cleared on demand.
+(palloc-zero) end
+EOF
+pass;
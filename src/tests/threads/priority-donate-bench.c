@@ -0,0 +1,153 @@
+/* Measures how the cost of priority donation scales.
+
+   A donation is timed by changing the priority of a thread that
+   is blocked on a lock, which must reposition it among the
+   lock's waiters and pass the change on to the holder, and from
+   there along any chain of holders that are themselves waiting.
+
+   First, with the main thread holding one lock, WAITER_CNTS[i]
+   higher-priority threads wait for it, and one of them has its
+   priority changed.  This should cost about the same for any
+   number of waiters.
+
+   Second, DEPTHS[i] threads form a chain: each holds a lock and
+   waits for the lock held by the one before it, and the first
+   waits for a lock held by the main thread.  The last thread in
+   the chain has its priority changed, which must be passed all
+   the way to the main thread.  This should cost time
+   proportional to the depth of the chain.
+
+   The cycle counts vary from machine to machine, so the .ck file
+   checks only that each measurement ran, not the numbers. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/tsc.h"
+
+#define ITER_CNT 1000
+#define MAX_WAITERS 64
+#define MAX_DEPTH 16
+
+static const int waiter_cnts[] = {1, 4, 16, MAX_WAITERS};
+static const int depths[] = {1, 4, MAX_DEPTH};
+
+/* A thread that acquires WAIT, first acquiring HOLD if it is
+   nonnull. */
+struct waiter 
+  {
+    struct lock *wait;
+    struct lock *hold;
+    struct thread *thread;
+  };
+
+static struct waiter waiters[MAX_WAITERS];
+static struct lock locks[MAX_DEPTH + 1];
+static struct semaphore done_sema;
+
+static thread_func waiter_thread;
+static void start_waiter (struct waiter *, struct lock *wait,
+                          struct lock *hold, int priority);
+static uint64_t time_donations (struct thread *);
+
+void
+test_priority_donate_bench (void) 
+{
+  size_t i;
+  int j;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  /* Make sure our priority is the default. */
+  ASSERT (thread_get_priority () == PRI_DEFAULT);
+
+  sema_init (&done_sema, 0);
+
+  for (i = 0; i < sizeof waiter_cnts / sizeof *waiter_cnts; i++) 
+    {
+      int cnt = waiter_cnts[i];
+
+      lock_init (&locks[0]);
+      lock_acquire (&locks[0]);
+      for (j = 0; j < cnt; j++)
+        start_waiter (&waiters[j], &locks[0], NULL, PRI_DEFAULT + 1 + j % 16);
+      msg ("%d waiters on one lock: %llu cycles per donation.",
+           cnt, time_donations (waiters[cnt - 1].thread));
+      lock_release (&locks[0]);
+      for (j = 0; j < cnt; j++)
+        sema_down (&done_sema);
+    }
+
+  for (i = 0; i < sizeof depths / sizeof *depths; i++) 
+    {
+      int depth = depths[i];
+
+      for (j = 0; j <= depth; j++)
+        lock_init (&locks[j]);
+      lock_acquire (&locks[0]);
+      for (j = 1; j <= depth; j++)
+        start_waiter (&waiters[j - 1], &locks[j - 1], &locks[j],
+                      PRI_DEFAULT + j);
+      msg ("Chain of depth %d: %llu cycles per donation.",
+           depth, time_donations (waiters[depth - 1].thread));
+      lock_release (&locks[0]);
+      for (j = 0; j < depth; j++)
+        sema_down (&done_sema);
+    }
+
+  msg ("Main thread finishing with priority %d.", thread_get_priority ());
+}
+
+/* Starts a thread at PRIORITY, which must be higher than ours,
+   that acquires HOLD, if nonnull, then waits for WAIT.  Returns
+   once it is blocked on WAIT. */
+static void
+start_waiter (struct waiter *w, struct lock *wait, struct lock *hold,
+              int priority) 
+{
+  w->wait = wait;
+  w->hold = hold;
+  w->thread = NULL;
+  thread_create ("waiter", priority, waiter_thread, w);
+  ASSERT (w->thread != NULL);
+}
+
+/* Returns the average number of cycles taken to change the
+   priority of T, a thread blocked on a lock, between PRI_MAX
+   and PRI_MAX - 1, which donates the new priority to the
+   holder. */
+static uint64_t
+time_donations (struct thread *t) 
+{
+  enum intr_level old_level;
+  uint64_t start, cycles;
+  int i;
+
+  old_level = intr_disable ();
+  start = rdtsc ();
+  for (i = 0; i < ITER_CNT; i++)
+    thread_update_priority (t, i % 2 ? PRI_MAX - 1 : PRI_MAX);
+  cycles = rdtsc () - start;
+  intr_set_level (old_level);
+  ASSERT (thread_get_priority () == PRI_MAX - 1);
+  return cycles / ITER_CNT;
+}
+
+static void
+waiter_thread (void *w_) 
+{
+  struct waiter *w = w_;
+
+  w->thread = thread_current ();
+  if (w->hold != NULL)
+    lock_acquire (w->hold);
+  lock_acquire (w->wait);
+  lock_release (w->wait);
+  if (w->hold != NULL)
+    lock_release (w->hold);
+  sema_up (&done_sema);
+}
@@ -0,0 +1,22 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+@output = get_core_output ("run", @output);
+
+# Cycle counts vary, so only check that each measurement ran.
+my (@expected) = (qr/^\(priority-donate-bench\) begin$/);
+push (@expected, qr/ $_ waiters on one lock: \d+ cycles per donation\.$/)
+  foreach (1, 4, 16, 64);
+push (@expected, qr/Chain of depth $_: \d+ cycles per donation\.$/)
+  foreach (1, 4, 16);
+push (@expected, qr/Main thread finishing with priority 31\.$/,
+      qr/^\(priority-donate-bench\) end$/);
+foreach my $re (@expected) {
+    fail "Output did not match $re\n" if !grep (/$re/, @output);
+}
+pass;
@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(rwlock-batch-readers) begin
+(rwlock-batch-readers) reader 1 reading.
+(rwlock-batch-readers) Writer is waiting.
+(rwlock-batch-readers) reader 2 reading.
+(rwlock-batch-readers) Releasing read lock.
+(rwlock-batch-readers) writer writing at priority 32.
+(rwlock-batch-readers) Main thread finished.
+(rwlock-batch-readers) end
+EOF
+pass;
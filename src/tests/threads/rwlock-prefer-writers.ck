@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(rwlock-prefer-writers) begin
+(rwlock-prefer-writers) reader 1 reading.
+(rwlock-prefer-writers) Writer is waiting.
+(rwlock-prefer-writers) Releasing read lock.
+(rwlock-prefer-writers) writer writing at priority 33.
+(rwlock-prefer-writers) reader 2 reading.
+(rwlock-prefer-writers) Main thread finished.
+(rwlock-prefer-writers) end
+EOF
+pass;
@@ -0,0 +1,72 @@
+/* Checks reader-writer lock policies and priority donation.
+
+   The main thread holds a reader-writer lock for reading while a
+   higher-priority reader comes and goes, then a writer starts
+   waiting for it.  A third, still higher-priority thread then
+   tries to read.  Under RWLOCK_PREFER_WRITERS it must wait for
+   the writer, donating its priority to the writer; under
+   RWLOCK_BATCH_READERS it joins the main thread as a reader
+   without waiting. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+static thread_func reader_thread;
+static thread_func writer_thread;
+
+static void
+test_rwlock (enum rwlock_policy policy) 
+{
+  struct rwlock rw;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  /* Make sure our priority is the default. */
+  ASSERT (thread_get_priority () == PRI_DEFAULT);
+
+  rwlock_init (&rw, policy);
+  rwlock_acquire_read (&rw);
+  thread_create ("reader 1", PRI_DEFAULT + 1, reader_thread, &rw);
+  thread_create ("writer", PRI_DEFAULT + 1, writer_thread, &rw);
+  msg ("Writer is waiting.");
+  thread_create ("reader 2", PRI_DEFAULT + 2, reader_thread, &rw);
+  msg ("Releasing read lock.");
+  rwlock_release_read (&rw);
+  msg ("Main thread finished.");
+}
+
+void
+test_rwlock_prefer_writers (void) 
+{
+  test_rwlock (RWLOCK_PREFER_WRITERS);
+}
+
+void
+test_rwlock_batch_readers (void) 
+{
+  test_rwlock (RWLOCK_BATCH_READERS);
+}
+
+static void
+reader_thread (void *rw_) 
+{
+  struct rwlock *rw = rw_;
+
+  rwlock_acquire_read (rw);
+  msg ("%s reading.", thread_name ());
+  rwlock_release_read (rw);
+}
+
+static void
+writer_thread (void *rw_) 
+{
+  struct rwlock *rw = rw_;
+
+  rwlock_acquire_write (rw);
+  msg ("writer writing at priority %d.", thread_get_priority ());
+  rwlock_release_write (rw);
+}
@@ -0,0 +1,181 @@
+/* Checks memcpy(), memmove(), memset(), memcmp(), and strlen()
+   against byte-at-a-time versions at every alignment, then
+   measures them, and the whole-page operations, in cycles per
+   KB next to the byte-at-a-time versions they replaced.
+
+   The cycle counts vary from machine to machine, so the .ck file
+   checks only that the test ran, not the numbers. */
+
+#include <stdio.h>
+#include <string.h>
+#include "tests/threads/tests.h"
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/pgops.h"
+#include "threads/tsc.h"
+#include "threads/vaddr.h"
+
+#define ITER_CNT 64
+
+static uint8_t *a, *b;
+
+static void check (void);
+static void byte_memcpy (void *, const void *, size_t);
+static void byte_memset (void *, int, size_t);
+static int byte_memcmp (const void *, const void *, size_t);
+static size_t byte_strlen (const char *);
+
+/* Returns cycles per KB for ITER_CNT runs of STMT on a page. */
+#define PER_KB(STMT)                                            \
+  ({                                                            \
+    enum intr_level old_level = intr_disable ();                \
+    uint64_t start = rdtsc ();                                  \
+    int i;                                                      \
+    for (i = 0; i < ITER_CNT; i++)                              \
+      STMT;                                                     \
+    start = rdtsc () - start;                                   \
+    intr_set_level (old_level);                                 \
+    (unsigned long long) start / ITER_CNT / (PGSIZE / 1024);    \
+  })
+
+#define REPORT(NAME, OLD, NEW)                                  \
+  do                                                            \
+    {                                                           \
+      unsigned long long old_ = PER_KB (OLD);                   \
+      unsigned long long new_ = PER_KB (NEW);                   \
+      msg ("%s: %llu cycles/KB, was %llu.", NAME, new_, old_);  \
+    }                                                           \
+  while (0)
+
+void
+test_string_bench (void) 
+{
+  volatile int sink;
+
+  a = palloc_get_page (PAL_ASSERT);
+  b = palloc_get_page (PAL_ASSERT);
+
+  check ();
+
+  memset (a, 'x', PGSIZE);
+  a[PGSIZE - 1] = '\0';
+  memcpy (b, a, PGSIZE);
+  REPORT ("memcpy", byte_memcpy (b, a, PGSIZE), memcpy (b, a, PGSIZE));
+  REPORT ("memset", byte_memset (b, 0, PGSIZE), memset (b, 0, PGSIZE));
+  memcpy (b, a, PGSIZE);
+  REPORT ("memcmp", sink = byte_memcmp (a, b, PGSIZE),
+          sink = memcmp (a, b, PGSIZE));
+  REPORT ("strlen", sink = byte_strlen ((char *) a),
+          sink = strlen ((char *) a));
+  REPORT ("copy_page", byte_memcpy (b, a, PGSIZE), copy_page (b, a));
+  REPORT ("clear_page", byte_memset (b, 0, PGSIZE), clear_page (b));
+  (void) sink;
+
+  palloc_free_page (a);
+  palloc_free_page (b);
+}
+
+/* Compares each function against its byte-at-a-time version
+   for every combination of alignments and a range of sizes. */
+static void
+check (void) 
+{
+  size_t dst_ofs, src_ofs, size;
+  int i;
+
+  for (i = 0; i < PGSIZE; i++)
+    a[i] = i * 7 + 1;
+
+  for (dst_ofs = 0; dst_ofs < 4; dst_ofs++)
+    for (src_ofs = 0; src_ofs < 4; src_ofs++)
+      for (size = 0; size < 70; size++) 
+        {
+          uint8_t *dst = b + 100 + dst_ofs;
+          uint8_t *src = a + src_ofs;
+          uint8_t *ovl = b + 100 + src_ofs;
+
+          byte_memset (b, 0, PGSIZE);
+          memcpy (dst, src, size);
+          if (byte_memcmp (dst, src, size) || dst[-1] || dst[size])
+            fail ("memcpy of %zu bytes at %zu from %zu failed",
+                  size, dst_ofs, src_ofs);
+
+          memset (dst, 0xa5, size);
+          for (i = 0; i < (int) size; i++)
+            if (dst[i] != 0xa5)
+              fail ("memset of %zu bytes at %zu failed", size, dst_ofs);
+          if (dst[-1] || dst[size])
+            fail ("memset of %zu bytes at %zu overran", size, dst_ofs);
+
+          byte_memcpy (dst, src, size);
+          if (memcmp (dst, src, size) != 0)
+            fail ("memcmp of equal %zu bytes failed", size);
+          if (size > 0) 
+            {
+              int expected;
+
+              dst[size - 1] ^= 1;
+              expected = byte_memcmp (dst, src, size);
+              if ((memcmp (dst, src, size) > 0) != (expected > 0)
+                  || (memcmp (src, dst, size) > 0) != (expected < 0))
+                fail ("memcmp of unequal %zu bytes failed", size);
+            }
+
+          /* Overlapping moves, up and down. */
+          byte_memcpy (b, a, PGSIZE);
+          memmove (ovl + 3, ovl, size);
+          if (byte_memcmp (ovl + 3, a + 100 + src_ofs, size))
+            fail ("memmove of %zu bytes up failed", size);
+          byte_memcpy (b, a, PGSIZE);
+          memmove (ovl, ovl + 3, size);
+          if (byte_memcmp (ovl, a + 103 + src_ofs, size))
+            fail ("memmove of %zu bytes down failed", size);
+
+          byte_memset (dst, 'x', size);
+          dst[size] = '\0';
+          if (strlen ((char *) dst) != size)
+            fail ("strlen of %zu bytes at %zu failed", size, dst_ofs);
+        }
+  msg ("Results match byte-at-a-time versions.");
+}
+
+static void __attribute__ ((noinline))
+byte_memcpy (void *dst_, const void *src_, size_t size) 
+{
+  uint8_t *dst = dst_;
+  const uint8_t *src = src_;
+
+  while (size-- > 0)
+    *dst++ = *src++;
+}
+
+static void __attribute__ ((noinline))
+byte_memset (void *dst_, int value, size_t size) 
+{
+  uint8_t *dst = dst_;
+
+  while (size-- > 0)
+    *dst++ = value;
+}
+
+static int __attribute__ ((noinline))
+byte_memcmp (const void *a_, const void *b_, size_t size) 
+{
+  const uint8_t *a = a_;
+  const uint8_t *b = b_;
+
+  for (; size-- > 0; a++, b++)
+    if (*a != *b)
+      return *a > *b ? +1 : -1;
+  return 0;
+}
+
+static size_t __attribute__ ((noinline))
+byte_strlen (const char *string) 
+{
+  const char *p;
+
+  for (p = string; *p != '\0'; p++)
+    continue;
+  return p - string;
+}
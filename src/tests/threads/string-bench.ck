@@ -0,0 +1,24 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+@output = get_core_output ("run", @output);
+
+# Cycle counts vary, so only check that each measurement ran.
+my (@expected) = (qr/^\(string-bench\) begin$/,
+		  qr/Results match byte-at-a-time versions\.$/,
+		  qr/memcpy: \d+ cycles\/KB, was \d+\.$/,
+		  qr/memset: \d+ cycles\/KB, was \d+\.$/,
+		  qr/memcmp: \d+ cycles\/KB, was \d+\.$/,
+		  qr/strlen: \d+ cycles\/KB, was \d+\.$/,
+		  qr/copy_page: \d+ cycles\/KB, was \d+\.$/,
+		  qr/clear_page: \d+ cycles\/KB, was \d+\.$/,
+		  qr/^\(string-bench\) end$/);
+foreach my $re (@expected) {
+    fail "Output did not match $re\n" if !grep (/$re/, @output);
+}
+pass;
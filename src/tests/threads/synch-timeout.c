@@ -0,0 +1,84 @@
+/* Checks that sema_down_timeout(), lock_acquire_timeout(), and
+   cond_timedwait() time out when nothing wakes them, return
+   early when something does, and withdraw a timed-out lock
+   waiter's priority donation. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+static struct semaphore sema;
+static struct lock lock;
+static struct condition cond;
+
+static thread_func up_thread;
+static thread_func lock_thread;
+static thread_func signal_thread;
+
+void
+test_synch_timeout (void) 
+{
+  int64_t start;
+  bool ok;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  sema_init (&sema, 0);
+  lock_init (&lock);
+  cond_init (&cond);
+
+  start = timer_ticks ();
+  ok = sema_down_timeout (&sema, 3);
+  msg ("sema_down_timeout() with no up: %s, %s.",
+       ok ? "decremented" : "timed out",
+       timer_elapsed (start) >= 3 ? "after its timeout" : "too early");
+
+  thread_create ("up", PRI_DEFAULT, up_thread, NULL);
+  ok = sema_down_timeout (&sema, 1000);
+  msg ("sema_down_timeout() with an up: %s.",
+       ok ? "decremented" : "timed out");
+
+  lock_acquire (&lock);
+  thread_create ("lock", PRI_DEFAULT + 1, lock_thread, NULL);
+  msg ("Holder priority while waited on: %d.", thread_get_priority ());
+  timer_sleep (10);
+  msg ("Holder priority after timeout: %d.", thread_get_priority ());
+  lock_release (&lock);
+
+  lock_acquire (&lock);
+  ok = cond_timedwait (&cond, &lock, 3);
+  msg ("cond_timedwait() with no signal: %s.",
+       ok ? "signaled" : "timed out");
+  thread_create ("signal", PRI_DEFAULT, signal_thread, NULL);
+  ok = cond_timedwait (&cond, &lock, 1000);
+  msg ("cond_timedwait() with a signal: %s.",
+       ok ? "signaled" : "timed out");
+  lock_release (&lock);
+}
+
+static void
+up_thread (void *aux UNUSED) 
+{
+  timer_sleep (2);
+  sema_up (&sema);
+}
+
+static void
+lock_thread (void *aux UNUSED) 
+{
+  bool ok = lock_acquire_timeout (&lock, 5);
+  msg ("lock_acquire_timeout(): %s.", ok ? "acquired" : "timed out");
+}
+
+static void
+signal_thread (void *aux UNUSED) 
+{
+  timer_sleep (2);
+  lock_acquire (&lock);
+  cond_signal (&cond, &lock);
+  lock_release (&lock);
+}
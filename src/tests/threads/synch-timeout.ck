@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(synch-timeout) begin
+(synch-timeout) sema_down_timeout() with no up: timed out, after its timeout.
+(synch-timeout) sema_down_timeout() with an up: decremented.
+(synch-timeout) Holder priority while waited on: 32.
+(synch-timeout) lock_acquire_timeout(): timed out.
+(synch-timeout) Holder priority after timeout: 31.
+(synch-timeout) cond_timedwait() with no signal: timed out.
+(synch-timeout) cond_timedwait() with a signal: signaled.
+(synch-timeout) end
+EOF
+pass;
@@ -25,6 +25,19 @@ static const struct test tests[] =
     {"priority-donate-sema", test_priority_donate_sema},
     {"priority-donate-lower", test_priority_donate_lower},
     {"priority-donate-chain", test_priority_donate_chain},
+    {"priority-donate-bench", test_priority_donate_bench},
+    {"rwlock-prefer-writers", test_rwlock_prefer_writers},
+    {"rwlock-batch-readers", test_rwlock_batch_readers},
+    {"edf-admission", test_edf_admission},
+    {"workqueue", test_workqueue},
+    {"hrtimer", test_hrtimer},
+    {"synch-timeout", test_synch_timeout},
+    {"memtag", test_memtag},
+    {"string-bench", test_string_bench},
+    {"palloc-zero", test_palloc_zero},
+    {"palloc-borrow", test_palloc_borrow},
+    {"palloc-buddy", test_palloc_buddy},
+    {"highmem", test_highmem},
     {"priority-fifo", test_priority_fifo},
     {"priority-preempt", test_priority_preempt},
     {"priority-sema", test_priority_sema},
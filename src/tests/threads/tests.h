@@ -19,6 +19,19 @@ extern test_func test_priority_donate_sema;
 extern test_func test_priority_donate_nest;
 extern test_func test_priority_donate_lower;
 extern test_func test_priority_donate_chain;
+extern test_func test_priority_donate_bench;
+extern test_func test_rwlock_prefer_writers;
+extern test_func test_rwlock_batch_readers;
+extern test_func test_edf_admission;
+extern test_func test_workqueue;
+extern test_func test_hrtimer;
+extern test_func test_synch_timeout;
+extern test_func test_memtag;
+extern test_func test_string_bench;
+extern test_func test_palloc_zero;
+extern test_func test_palloc_borrow;
+extern test_func test_palloc_buddy;
+extern test_func test_highmem;
 extern test_func test_priority_fifo;
 extern test_func test_priority_preempt;
 extern test_func test_priority_sema;
@@ -0,0 +1,64 @@
+/* Checks that work items run in order in a worker thread, that
+   delayed work waits for its delay, and that cancelled work does
+   not run. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/workqueue.h"
+#include "devices/timer.h"
+
+static struct workqueue wq;
+static struct semaphore done;
+static int64_t start;
+
+static work_func print_work;
+static work_func delayed_work;
+
+void
+test_workqueue (void) 
+{
+  struct work a, b, c, d;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  if (!workqueue_create (&wq, "test-wq", PRI_DEFAULT + 1, 1))
+    fail ("could not create work queue");
+  sema_init (&done, 0);
+
+  work_init (&a, print_work, "a");
+  work_init (&b, print_work, "b");
+  work_init (&c, delayed_work, "c");
+  work_init (&d, print_work, "d");
+
+  start = timer_ticks ();
+  work_queue_delayed (&wq, &c, 5);
+  work_queue_delayed (&wq, &d, 3);
+  work_queue (&wq, &a);
+  work_queue (&wq, &b);
+  if (work_queue (&wq, &b))
+    fail ("work item queued twice");
+  if (!work_cancel (&d))
+    fail ("could not cancel delayed work item");
+  msg ("Queued work.");
+
+  sema_down (&done);
+  msg ("Delayed work done.");
+}
+
+static void
+print_work (void *name) 
+{
+  msg ("Work item %s ran in %s.", (const char *) name, thread_name ());
+}
+
+static void
+delayed_work (void *name) 
+{
+  msg ("Work item %s ran %s.", (const char *) name,
+       timer_elapsed (start) >= 5 ? "after its delay" : "too early");
+  sema_up (&done);
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(workqueue) begin
+(workqueue) Queued work.
+(workqueue) Work item a ran in test-wq/0.
+(workqueue) Work item b ran in test-wq/0.
+(workqueue) Work item c ran after its delay.
+(workqueue) Delayed work done.
+(workqueue) end
+EOF
+pass;
@@ -0,0 +1,78 @@
+/* Fills two 8 MB arrays, one with ordinary 4 kB pages and one
+   after asking for 4 MB pages with largepages(), then times the
+   same TLB-bound access pattern over each: one byte from every
+   page, visiting the pages in a scattered order, so that nearly
+   every access needs a different TLB entry when the pages are
+   small.  The cycle counts vary, so the .ck file only checks
+   that they were printed. */
+
+#include <memstat.h>
+#include <stdint.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (8 * 1024 * 1024)
+#define PAGE_SIZE 4096
+#define PAGE_CNT (SIZE / PAGE_SIZE)
+#define ROUNDS 16
+
+static char small[SIZE];
+static char large[SIZE];
+
+static inline uint64_t
+rdtsc (void) 
+{
+  uint32_t lo, hi;
+  asm volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+  return ((uint64_t) hi << 32) | lo;
+}
+
+/* Reads a byte from each page of BUF, ROUNDS times over, and
+   returns the average number of cycles per read.  Stores the
+   sum of the bytes read in *SUM. */
+static unsigned
+walk (const char *buf, unsigned *sum) 
+{
+  uint64_t start = rdtsc ();
+  unsigned total = 0;
+  int r, i;
+
+  for (r = 0; r < ROUNDS; r++)
+    for (i = 0; i < PAGE_CNT; i++) 
+      {
+        /* 521 is odd, so this visits every page once. */
+        int page = (i * 521) % PAGE_CNT;
+        total += buf[page * PAGE_SIZE + (i % 64) * 64];
+      }
+  *sum = total;
+  return (rdtsc () - start) / (ROUNDS * PAGE_CNT);
+}
+
+void
+test_main (void) 
+{
+  struct memstat ms;
+  unsigned small_sum, large_sum;
+  unsigned small_cycles, large_cycles;
+
+  memset (small, 1, SIZE);
+  CHECK (largepages (large, SIZE) > 0,
+         "largepages() covers at least one 4 MB region");
+  memset (large, 1, SIZE);
+
+  CHECK (memstat (&ms), "memstat");
+  msg ("4 MB pages mapped: %s.", ms.user_large > 0 ? "yes" : "no");
+
+  /* Warm up the caches, then measure. */
+  walk (small, &small_sum);
+  walk (large, &large_sum);
+  small_cycles = walk (small, &small_sum);
+  large_cycles = walk (large, &large_sum);
+  msg ("Both arrays read back correctly: %s.",
+       small_sum == ROUNDS * PAGE_CNT && large_sum == small_sum
+       ? "yes" : "no");
+  msg ("4 kB pages: %u cycles per access.", small_cycles);
+  msg ("4 MB pages: %u cycles per access.", large_cycles);
+}
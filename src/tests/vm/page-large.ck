@@ -0,0 +1,22 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+@output = get_core_output ("run", @output);
+
+# Cycle counts vary, so only check that each measurement ran.
+my (@expected) = (qr/^\(page-large\) begin$/,
+		  qr/largepages\(\) covers at least one 4 MB region$/,
+		  qr/4 MB pages mapped: yes\.$/,
+		  qr/Both arrays read back correctly: yes\.$/,
+		  qr/4 kB pages: \d+ cycles per access\.$/,
+		  qr/4 MB pages: \d+ cycles per access\.$/,
+		  qr/^\(page-large\) end$/);
+foreach my $re (@expected) {
+    fail "Output did not match $re\n" if !grep (/$re/, @output);
+}
+pass;
@@ -0,0 +1,37 @@
+/* Exits the initial thread while one other thread loops in user
+   mode and another sleeps on a futex that is never woken.  Both
+   must be ended, so that the process exits instead of waiting
+   for them forever. */
+
+#include <syscall.h>
+#include <thread.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static volatile int started;
+static int never;
+
+static void
+spinner (void *aux UNUSED) 
+{
+  started++;
+  for (;;)
+    continue;
+}
+
+static void
+sleeper (void *aux UNUSED) 
+{
+  started++;
+  for (;;)
+    futex_wait (&never, 0);
+}
+
+void
+test_main (void) 
+{
+  CHECK (thread_create (spinner, NULL) != TID_ERROR, "create spinner");
+  CHECK (thread_create (sleeper, NULL) != TID_ERROR, "create sleeper");
+  while (started < 2)
+    continue;
+}
@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(thread-exit) begin
+(thread-exit) create spinner
+(thread-exit) create sleeper
+(thread-exit) end
+thread-exit: exit(0)
+EOF
+pass;
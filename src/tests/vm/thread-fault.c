@@ -0,0 +1,33 @@
+/* Faults in one thread while the initial thread waits to join
+   another that loops in user mode.  The fault must kill the
+   whole process with exit code -1. */
+
+#include <syscall.h>
+#include <thread.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static void
+spinner (void *aux UNUSED) 
+{
+  for (;;)
+    continue;
+}
+
+static void
+faulter (void *aux UNUSED) 
+{
+  msg ("bad addr read as %d", *(int *) 0x04000000);
+  thread_exit (0);
+}
+
+void
+test_main (void) 
+{
+  tid_t tid;
+
+  CHECK ((tid = thread_create (spinner, NULL)) != TID_ERROR,
+         "create spinner");
+  CHECK (thread_create (faulter, NULL) != TID_ERROR, "create faulter");
+  fail ("join returned %d", thread_join (tid));
+}
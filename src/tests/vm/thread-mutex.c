@@ -0,0 +1,45 @@
+/* Starts several threads in one process that increment a shared
+   counter under a mutex, then joins them and checks the total
+   and each thread's exit status. */
+
+#include <syscall.h>
+#include <thread.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define THREAD_CNT 4
+#define ITERATIONS 2000
+
+static struct mutex mutex = MUTEX_INITIALIZER;
+static int counter;
+
+static void
+worker (void *aux) 
+{
+  int i;
+
+  for (i = 0; i < ITERATIONS; i++) 
+    {
+      mutex_lock (&mutex);
+      counter++;
+      mutex_unlock (&mutex);
+    }
+  thread_exit ((int) aux);
+}
+
+void
+test_main (void) 
+{
+  tid_t tids[THREAD_CNT];
+  int i;
+
+  for (i = 0; i < THREAD_CNT; i++) 
+    CHECK ((tids[i] = thread_create (worker, (void *) (i + 1))) != TID_ERROR,
+           "create thread %d", i);
+
+  for (i = 0; i < THREAD_CNT; i++) 
+    CHECK (thread_join (tids[i]) == i + 1, "join thread %d", i);
+
+  CHECK (counter == THREAD_CNT * ITERATIONS, "counter is %d", counter);
+  CHECK (thread_join (tids[0]) == -1, "join thread 0 again");
+}
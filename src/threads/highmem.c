@@ -0,0 +1,171 @@
+#include "threads/highmem.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/pte.h"
+#include "threads/smp.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Free high memory pages, one bit per page starting at page
+   number lowmem_pages, true if the page is free. */
+static struct bitmap *free_map;
+static struct lock free_lock;
+static size_t high_cnt;             /* Usable high memory pages. */
+static size_t high_free;            /* Free high memory pages. */
+
+/* The kmap() window: a page table whose entries are handed out
+   one at a time.  kmap_sema counts free entries and used_map
+   records which ones are taken, accessed with interrupts off. */
+static uint32_t *kmap_pt;
+static struct semaphore kmap_sema;
+static uint32_t used_map[KMAP_PAGES / 32];
+
+/* Statistics. */
+static unsigned long long kmap_cnt;     /* Calls to kmap() for high pages. */
+static unsigned long long kmap_waits;   /* ...that had to wait for a slot. */
+
+/* Finds the usable pages above low memory and sets up the kmap()
+   window.  Must be called after malloc_init() and paging_init(). */
+void
+highmem_init (void) 
+{
+  size_t i;
+
+  kmap_pt = pde_get_pt (base_page_dir[pd_no (KMAP_BASE)]);
+  sema_init (&kmap_sema, KMAP_PAGES);
+  lock_init (&free_lock);
+
+  if (ram_pages <= lowmem_pages)
+    return;
+  free_map = bitmap_create (ram_pages - lowmem_pages);
+  if (free_map == NULL)
+    PANIC ("highmem_init: no memory for %zu page bitmap",
+           ram_pages - lowmem_pages);
+  for (i = 0; i < ram_range_cnt; i++)
+    if (ram_ranges[i].end > lowmem_pages) 
+      {
+        size_t start = ram_ranges[i].start;
+        if (start < lowmem_pages)
+          start = lowmem_pages;
+        bitmap_set_multiple (free_map, start - lowmem_pages,
+                             ram_ranges[i].end - start, true);
+        high_cnt += ram_ranges[i].end - start;
+      }
+  high_free = high_cnt;
+  printf ("%zu pages available in high memory.\n", high_cnt);
+}
+
+/* Allocates a page of high memory and returns its physical page
+   number, or 0 if none is free.  The page is not mapped; use
+   kmap() to reach it. */
+size_t
+highmem_alloc (void) 
+{
+  size_t idx;
+
+  if (free_map == NULL)
+    return 0;
+  lock_acquire (&free_lock);
+  idx = bitmap_scan_and_flip (free_map, 0, 1, true);
+  if (idx != BITMAP_ERROR)
+    high_free--;
+  lock_release (&free_lock);
+  return idx != BITMAP_ERROR ? lowmem_pages + idx : 0;
+}
+
+/* Frees high memory page PFN, which must have been obtained
+   from highmem_alloc(). */
+void
+highmem_free (size_t pfn) 
+{
+  ASSERT (pfn >= lowmem_pages && pfn < ram_pages);
+
+  lock_acquire (&free_lock);
+  ASSERT (!bitmap_test (free_map, pfn - lowmem_pages));
+  bitmap_mark (free_map, pfn - lowmem_pages);
+  high_free++;
+  lock_release (&free_lock);
+}
+
+/* Returns the number of free high memory pages. */
+size_t
+highmem_free_cnt (void) 
+{
+  return high_free;
+}
+
+/* Returns a kernel virtual address for physical page PFN.  For a
+   page of high memory, this takes a slot in the kmap() window,
+   waiting for one if all are in use, and the caller must release
+   it with kunmap() once done.  Must not be called from an
+   interrupt handler. */
+void *
+kmap (size_t pfn) 
+{
+  enum intr_level old_level;
+  size_t slot;
+  void *va;
+
+  ASSERT (!intr_context ());
+  ASSERT (pfn < ram_pages);
+
+  if (pfn < lowmem_pages)
+    return ptov (pfn << PGBITS);
+
+  if (kmap_sema.value == 0)
+    kmap_waits++;
+  sema_down (&kmap_sema);
+
+  old_level = intr_disable ();
+  for (slot = 0; used_map[slot / 32] == UINT32_MAX; slot += 32)
+    continue;
+  slot += __builtin_ctz (~used_map[slot / 32]);
+  used_map[slot / 32] |= 1u << (slot % 32);
+  kmap_cnt++;
+  intr_set_level (old_level);
+
+  va = (uint8_t *) KMAP_BASE + slot * PGSIZE;
+  kmap_pt[pt_no (va)] = (pfn << PGBITS) | PTE_P | PTE_W;
+  return va;
+}
+
+/* Releases the mapping of VA, which kmap() returned. */
+void
+kunmap (void *va) 
+{
+  enum intr_level old_level;
+  size_t slot;
+
+  if ((uint8_t *) va < (uint8_t *) KMAP_BASE)
+    return;
+  slot = ((uint8_t *) va - (uint8_t *) KMAP_BASE) / PGSIZE;
+  ASSERT (slot < KMAP_PAGES && pg_ofs (va) == 0);
+
+  kmap_pt[pt_no (va)] = 0;
+  asm volatile ("invlpg (%0)" : : "r" (va) : "memory");
+
+  /* The caller may have used VA on another processor before
+     migrating here. */
+  smp_flush_tlb (NULL);
+
+  old_level = intr_disable ();
+  ASSERT (used_map[slot / 32] & (1u << (slot % 32)));
+  used_map[slot / 32] &= ~(1u << (slot % 32));
+  intr_set_level (old_level);
+  sema_up (&kmap_sema);
+}
+
+/* Prints high memory statistics. */
+void
+highmem_print_stats (void) 
+{
+  if (high_cnt == 0 && kmap_cnt == 0)
+    return;
+  printf ("Highmem: %zu of %zu pages free, %llu kmaps, %llu waits\n",
+          high_free, high_cnt, kmap_cnt, kmap_waits);
+}
@@ -0,0 +1,27 @@
+#ifndef THREADS_HIGHMEM_H
+#define THREADS_HIGHMEM_H
+
+#include <stddef.h>
+
+/* High memory.
+
+   The kernel maps physical memory 1:1 at PHYS_BASE, but only
+   the first LOWMEM_LIMIT bytes of it fit below the top of the
+   virtual address space.  Pages above that are handed out by
+   page number with highmem_alloc() and reached through short
+   lived mappings in a window at KMAP_BASE: kmap() maps a page
+   and returns its address, and kunmap() removes the mapping.
+   kmap() also accepts low memory pages, for which it simply
+   returns the page's address in the 1:1 mapping. */
+
+void highmem_init (void);
+size_t highmem_alloc (void);
+void highmem_free (size_t pfn);
+size_t highmem_free_cnt (void);
+
+void *kmap (size_t pfn);
+void kunmap (void *);
+
+void highmem_print_stats (void);
+
+#endif /* threads/highmem.h */
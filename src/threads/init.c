@@ -13,13 +13,19 @@
 #include "devices/serial.h"
 #include "devices/timer.h"
 #include "devices/vga.h"
+#include "threads/highmem.h"
 #include "threads/interrupt.h"
 #include "threads/io.h"
 #include "threads/loader.h"
 #include "threads/malloc.h"
+#include "threads/memtag.h"
 #include "threads/palloc.h"
 #include "threads/pte.h"
+#include "threads/slab.h"
+#include "threads/smp.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
+#include "threads/workqueue.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #include "userprog/exception.h"
@@ -35,14 +41,32 @@
 #include "filesys/fsutil.h"
 #include "vm/swap.h"
 #endif
+#ifdef USERPROG
 #include "vm/frame.h"
+#endif
 
 /* Amount of physical memory, in 4 kB pages. */
 size_t ram_pages;
+size_t lowmem_pages;
+
+/* Usable ranges of physical memory. */
+struct ram_range ram_ranges[RAM_RANGE_MAX];
+size_t ram_range_cnt;
+
+/* Next free page, for allocations made before the page
+   allocator is up.  See early_page(). */
+static uint8_t *early_free;
 
 /* Page directory with kernel mappings only. */
 uint32_t *base_page_dir;
 
+/* Are 4 MB pages enabled? */
+bool pse_enabled;
+
+/* Pages of each size in the kernel's mapping of low memory. */
+static size_t direct_large_cnt;
+static size_t direct_small_cnt;
+
 #ifdef FILESYS
 /* -f: Format the file system? */
 static bool format_filesys;
@@ -52,13 +76,20 @@ static bool format_filesys;
 bool power_off_when_done;
 
 static void ram_init (void);
+static bool e820_init (void);
+static void cmos_init (void);
 static void paging_init (void);
+static bool pse_init (void);
 
 static char **read_command_line (void);
 static char **parse_options (char **argv);
 static void run_actions (char **argv);
 static void usage (void);
 
+/* -trace: Number of pages in the trace buffer, or 0 to disable
+   tracing. */
+static size_t trace_page_cnt;
+
 static void print_stats (void);
 
 
@@ -83,12 +114,16 @@ main (void)
   console_init ();  
 
   /* Greet user. */
-  printf ("Pintos booting with %'zu kB RAM...\n", ram_pages * PGSIZE / 1024);
+  printf ("Pintos booting with %'zu kB RAM...\n",
+          ram_pages * (PGSIZE / 1024));
 
   /* Initialize memory system. */
-  palloc_init ();
-  malloc_init ();
   paging_init ();
+  palloc_init (early_free);
+  malloc_init ();
+  highmem_init ();
+  if (trace_page_cnt > 0)
+    trace_init (trace_page_cnt);
 
   /* Segmentation. */
 #ifdef USERPROG
@@ -108,8 +143,13 @@ main (void)
 
   /* Start thread scheduler and enable interrupts. */
   thread_start ();
+  workqueue_init ();
+  palloc_zero_init ();
   serial_init_queue ();
   timer_calibrate ();
+  timer_hires_init ();
+  if (smp_enabled)
+    smp_init ();
 
 #ifdef FILESYS
   /* Initialize file system. */
@@ -117,7 +157,12 @@ main (void)
   filesys_init (format_filesys);
   swap_init ();
 #endif
+#ifdef USERPROG
+  /* Frame and supplemental page tables, which process loading
+     uses even without -DVM. */
   finit();
+  spt_init();
+#endif
 
   printf ("Boot complete.\n");
   
@@ -143,8 +188,163 @@ ram_init (void)
   extern char _start_bss, _end_bss;
   memset (&_start_bss, 0, &_end_bss - &_start_bss);
 
-  /* Get RAM size from loader.  See loader.S. */
-  ram_pages = *(uint32_t *) ptov (LOADER_RAM_PGS);
+  /* Get the memory map from the loader.  See loader.S. */
+  if (!e820_init ())
+    cmos_init ();
+  if (ram_pages > LOWMEM_LIMIT / PGSIZE)
+    lowmem_pages = LOWMEM_LIMIT / PGSIZE;
+  else
+    lowmem_pages = ram_pages;
+}
+
+/* Adds pages START up to END to the usable RAM ranges. */
+static void
+add_ram_range (size_t start, size_t end) 
+{
+  if (start >= end)
+    return;
+  if (ram_range_cnt >= RAM_RANGE_MAX)
+    {
+      printf ("too many memory ranges, ignoring pages %zu to %zu\n",
+              start, end);
+      return;
+    }
+  ram_ranges[ram_range_cnt].start = start;
+  ram_ranges[ram_range_cnt].end = end;
+  ram_range_cnt++;
+}
+
+/* Removes pages START up to END from the usable RAM ranges. */
+static void
+remove_ram_range (size_t start, size_t end) 
+{
+  size_t i;
+
+  for (i = 0; i < ram_range_cnt; i++) 
+    {
+      struct ram_range *r = &ram_ranges[i];
+      size_t r_end = r->end;
+
+      if (start >= r_end || end <= r->start)
+        continue;
+
+      /* Keep whatever lies before and after START...END. */
+      if (start > r->start)
+        {
+          r->end = start;
+          if (end < r_end)
+            add_ram_range (end, r_end);
+        }
+      else if (end < r_end)
+        r->start = end;
+      else
+        {
+          /* Nothing left.  Move the last range into this slot
+             and look at it again. */
+          *r = ram_ranges[--ram_range_cnt];
+          i--;
+        }
+    }
+}
+
+/* Reads the BIOS E820 memory map that the loader stored at
+   LOADER_E820_MAP into ram_ranges[].  Only memory below 4 GB is
+   used, since we do not enable PAE.  Returns false if the map
+   is empty, which means that the BIOS does not support E820. */
+static bool
+e820_init (void) 
+{
+  struct e820_entry
+    {
+      uint64_t base;            /* Physical address. */
+      uint64_t length;          /* Length in bytes. */
+      uint32_t type;            /* 1 for usable RAM. */
+    }
+  __attribute__ ((packed));
+  const struct e820_entry *map = ptov (LOADER_E820_MAP);
+  size_t cnt = ((*(uint16_t *) ptov (LOADER_E820_END) - LOADER_E820_MAP)
+                / sizeof *map);
+  const uint64_t limit = (uint64_t) 1 << 32;
+  size_t i;
+
+  if (cnt == 0 || cnt > 128)
+    return false;
+
+  /* Entries may overlap, and reserved memory takes precedence,
+     so add all of the usable ranges before removing any of the
+     others.  Partial pages at the edges of usable ranges are
+     dropped; partial reserved pages are removed entirely. */
+  for (i = 0; i < cnt; i++) 
+    if (map[i].type == 1 && map[i].base < limit) 
+      {
+        uint64_t end = map[i].base + map[i].length;
+        if (end > limit)
+          end = limit;
+        add_ram_range ((map[i].base + PGMASK) >> PGBITS, end >> PGBITS);
+      }
+  for (i = 0; i < cnt; i++) 
+    if (map[i].type != 1 && map[i].base < limit) 
+      {
+        uint64_t end = map[i].base + map[i].length;
+        if (end > limit)
+          end = limit;
+        remove_ram_range (map[i].base >> PGBITS, (end + PGMASK) >> PGBITS);
+      }
+
+  for (i = 0; i < ram_range_cnt; i++)
+    if (ram_ranges[i].end > ram_pages)
+      ram_pages = ram_ranges[i].end;
+  return ram_pages > 0;
+}
+
+/* Reads CMOS register REG. */
+static uint8_t
+cmos_read (uint8_t reg) 
+{
+  outb (0x70, reg);
+  return inb (0x71);
+}
+
+/* Sizes memory from the CMOS, for BIOSes without E820.
+   Registers 0x30 and 0x31 hold the kB of memory above 1 MB, up
+   to 64 MB.  Bochs and QEMU also store the number of 64 kB
+   blocks above 16 MB in registers 0x34 and 0x35.  Either way,
+   the 384 kB below 1 MB that holds video memory and the BIOS
+   is not usable. */
+static void
+cmos_init (void) 
+{
+  size_t ext_kb = cmos_read (0x30) | (cmos_read (0x31) << 8);
+  size_t ext16_blocks = cmos_read (0x34) | (cmos_read (0x35) << 8);
+
+  if (ext16_blocks > 0) 
+    ram_pages = (16 * 1024 * 1024 + ext16_blocks * 65536) / PGSIZE;
+  else
+    ram_pages = (1024 + ext_kb) / (PGSIZE / 1024);
+  add_ram_range (0, 0xa0000 / PGSIZE);
+  add_ram_range (0x100000 / PGSIZE, ram_pages);
+}
+
+/* Returns a zeroed page from the memory just past the kernel,
+   for use before the page allocator is initialized.  palloc_init()
+   starts its pools after the last page handed out here. */
+static void *
+early_page (void) 
+{
+  void *page;
+
+  if (early_free == NULL) 
+    {
+      /* End of the kernel as recorded by the linker.
+         See kernel.lds.S. */
+      extern char _end;
+      early_free = pg_round_up (&_end);
+    }
+  page = early_free;
+  early_free += PGSIZE;
+  memset (page, 0, PGSIZE);
+  memtag_pages (MEM_PAGETABLE, 1);
+  return page;
 }
 
 /* Populates the base page directory and page table with the
@@ -152,10 +352,19 @@ ram_init (void)
    new page directory.  Points base_page_dir to the page
    directory it creates.
 
-   At the time this function is called, the active page table
-   (set up by loader.S) only maps the first 4 MB of RAM, so we
-   should not try to use extravagant amounts of memory.
-   Fortunately, there is no need to do so. */
+   Only low memory is mapped.  Each 4 MB of it is mapped with a
+   single large page, if the CPU supports them, which saves the
+   page tables and lets one TLB entry cover what would otherwise
+   take 1024.  The exception is memory that contains kernel code,
+   which gets 4 kB pages so that the code can be read-only.  The
+   page directory entry for the kmap() window gets an empty page
+   table, so that every page directory copied from this one shares
+   the window.
+
+   This function runs before the page allocator, so it takes
+   its pages with early_page().  The active page table (set up
+   by loader.S) maps the first 64 MB of RAM, which is plenty for
+   the kernel and the page tables for 1 GB of low memory. */
 static void
 paging_init (void)
 {
@@ -163,9 +372,10 @@ paging_init (void)
   size_t page;
   extern char _start, _end_kernel_text;
 
-  pd = base_page_dir = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+  pse_enabled = pse_init ();
+  pd = base_page_dir = early_page ();
   pt = NULL;
-  for (page = 0; page < ram_pages; page++) 
+  for (page = 0; page < lowmem_pages; page++) 
     {
       uintptr_t paddr = page * PGSIZE;
       char *vaddr = ptov (paddr);
@@ -175,12 +385,24 @@ paging_init (void)
 
       if (pd[pde_idx] == 0)
         {
-          pt = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+          if (pse_enabled && pte_idx == 0
+              && page + LARGE_PGCNT <= lowmem_pages
+              && (vaddr + LARGE_PGSIZE <= &_start
+                  || vaddr >= &_end_kernel_text))
+            {
+              pd[pde_idx] = pde_create_large (vaddr, true, false);
+              direct_large_cnt++;
+              page += LARGE_PGCNT - 1;
+              continue;
+            }
+          pt = early_page ();
           pd[pde_idx] = pde_create (pt);
         }
 
       pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text);
+      direct_small_cnt++;
     }
+  pd[pd_no (KMAP_BASE)] = pde_create (early_page ());
 
   /* Store the physical address of the page directory into CR3
      aka PDBR (page directory base register).  This activates our
@@ -190,6 +412,24 @@ paging_init (void)
   asm volatile ("movl %0, %%cr3" : : "r" (vtop (base_page_dir)));
 }
 
+/* Turns on 4 MB pages, if CPUID says that the CPU supports
+   them, and returns true if successful.  See [IA32-v2a] "CPUID"
+   and [IA32-v3a] 2.5 "Control Registers". */
+static bool
+pse_init (void) 
+{
+  enum { CR4_PSE = 0x10 };      /* Page Size Extensions. */
+  uint32_t eax = 1, ebx, ecx, edx, cr4;
+
+  asm volatile ("cpuid" : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+  if ((edx & (1u << 3)) == 0)
+    return false;
+
+  asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+  asm volatile ("movl %0, %%cr4" : : "r" (cr4 | CR4_PSE));
+  return true;
+}
+
 /* Breaks the kernel command line into words and returns them as
    an argv-like array. */
 static char **
@@ -248,6 +488,30 @@ parse_options (char **argv)
         random_init (atoi (value));
       else if (!strcmp (name, "-mlfqs"))
         thread_mlfqs = true;
+      else if (!strcmp (name, "-sched"))
+        {
+          thread_mlfqs = thread_fair = false;
+          if (value == NULL || !strcmp (value, "priority"))
+            ;
+          else if (!strcmp (value, "mlfqs"))
+            thread_mlfqs = true;
+          else if (!strcmp (value, "fair"))
+            thread_fair = true;
+          else
+            PANIC ("unknown scheduler `%s' (use -h for help)", value);
+        }
+      else if (!strcmp (name, "-tickless"))
+        timer_tickless = true;
+      else if (!strcmp (name, "-schedstats"))
+        thread_schedstats = true;
+      else if (!strcmp (name, "-smp"))
+        smp_enabled = true;
+      else if (!strcmp (name, "-intrlat"))
+        intr_latency_init (value != NULL ? atoi (value) : 10);
+      else if (!strcmp (name, "-trace"))
+        trace_page_cnt = value != NULL ? atoi (value) : 16;
+      else if (!strcmp (name, "-memdebug"))
+        memdebug = true;
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
@@ -353,6 +617,17 @@ usage (void)
           "  -f                 Format file system disk during startup.\n"
           "  -rs=SEED           Set random number seed to SEED.\n"
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
+          "  -sched=SCHED       Use scheduler SCHED: priority (default), mlfqs,\n"
+          "                     or fair (nice-weighted fair share; donated\n"
+          "                     priority lowers a lock holder's nice).\n"
+          "  -tickless          Stop the periodic timer while idle.\n"
+          "  -schedstats        Print detailed scheduler statistics at shutdown.\n"
+          "  -smp               Start the other CPUs and schedule threads on them.\n"
+          "  -intrlat[=N]       Report the N longest interrupts-off sections.\n"
+          "  -trace[=PAGES]     Trace kernel events into a PAGES-page buffer\n"
+          "                     (default 16) and dump it at shutdown.\n"
+          "  -memdebug          Record callers of live allocations and report\n"
+          "                     them at shutdown.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
 #endif
@@ -374,6 +649,7 @@ power_off (void)
 #endif
 
   print_stats ();
+  trace_dump ();
 
   printf ("Powering off...\n");
   serial_flush ();
@@ -394,6 +670,18 @@ print_stats (void)
 {
   timer_print_stats ();
   thread_print_stats ();
+  intr_latency_print ();
+  workqueue_print_stats ();
+  smp_print_stats ();
+  palloc_print_stats ();
+  printf ("Paging: low memory mapped with %zu 4 MB and %zu 4 kB pages\n",
+          direct_large_cnt, direct_small_cnt);
+#ifdef USERPROG
+  large_print_stats ();
+#endif
+  highmem_print_stats ();
+  kmem_print_stats ();
+  memtag_print_stats ();
 #ifdef FILESYS
   disk_print_stats ();
 #endif
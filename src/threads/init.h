@@ -6,12 +6,32 @@
 #include <stddef.h>
 #include <stdint.h>
 
-/* Physical memory size, in 4 kB pages. */
+/* Physical memory size, in 4 kB pages: one past the last
+   usable page.  There may be holes below it. */
 extern size_t ram_pages;
 
+/* Pages of physical memory mapped at PHYS_BASE, the smaller of
+   ram_pages and LOWMEM_LIMIT / PGSIZE. */
+extern size_t lowmem_pages;
+
+/* Usable RAM, as reported by the BIOS, in ranges of page
+   numbers.  Each range runs from START up to but not including
+   END.  Ranges do not overlap but are not sorted. */
+struct ram_range
+  {
+    size_t start;
+    size_t end;
+  };
+#define RAM_RANGE_MAX 32
+extern struct ram_range ram_ranges[RAM_RANGE_MAX];
+extern size_t ram_range_cnt;
+
 /* Page directory with kernel mappings only. */
 extern uint32_t *base_page_dir;
 
+/* Are 4 MB pages (CR4.PSE) enabled? */
+extern bool pse_enabled;
+
 /* -q: Power off when kernel tasks complete? */
 extern bool power_off_when_done;
 
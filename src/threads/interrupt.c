@@ -6,9 +6,18 @@
 #include "threads/flags.h"
 #include "threads/intr-stubs.h"
 #include "threads/io.h"
+#include "threads/smp.h"
+#include "threads/spinlock.h"
 #include "threads/thread.h"
+#include "threads/tsc.h"
 #include "threads/vaddr.h"
+#include "devices/lapic.h"
 #include "devices/timer.h"
+#ifdef USERPROG
+#include "userprog/gdt.h"
+#include "userprog/process.h"
+#include "userprog/syscall.h"
+#endif
 
 /* Number of x86 interrupts. */
 #define INTR_CNT 256
@@ -25,13 +34,40 @@ static intr_handler_func *intr_handlers[INTR_CNT];
 /* Names for each interrupt, for debugging purposes. */
 static const char *intr_names[INTR_CNT];
 
+/* The interrupts-off lock.
+
+   The kernel relies on turning interrupts off for mutual
+   exclusion, which by itself excludes only other code on the
+   same processor.  So that it excludes the other processors
+   too, a processor takes this lock whenever it turns interrupts
+   off and releases it whenever it turns them back on, whether
+   with intr_disable() and intr_enable() or by taking and
+   returning from an interrupt.  Thus a processor that runs with
+   interrupts off holds the lock, except for a few instructions
+   on either side, and at most one processor at a time does so.
+   Code that runs with interrupts on, including user programs,
+   runs on every processor at once.
+
+   The bootstrap processor boots with interrupts off, so it
+   starts out holding the lock.
+
+   A few interrupts touch nothing shared and are handled without
+   the lock.  One of them asks for a TLB flush, so a processor
+   that is spinning on the lock also flushes its TLB when asked,
+   to let the lock's holder wait for it. */
+static struct spinlock intr_lock = { 1 };
+
 /* External interrupts are those generated by devices outside the
    CPU, such as the timer.  External interrupts run with
    interrupts turned off, so they never nest, nor are they ever
    pre-empted.  Handlers for external interrupts also may not
    sleep, although they may invoke intr_yield_on_return() to
    request that a new process be scheduled just before the
-   interrupt returns. */
+   interrupt returns.
+
+   An external interrupt holds the interrupts-off lock from
+   start to end, so these describe the interrupt being handled
+   by whichever processor holds it. */
 static bool in_external_intr;   /* Are we processing an external interrupt? */
 static bool yield_on_return;    /* Should we yield on interrupt return? */
 
@@ -46,6 +82,40 @@ static inline uint64_t make_idtr_operand (uint16_t limit, void *base);
 
 /* Interrupt handlers. */
 void intr_handler (struct intr_frame *args);
+
+/* Interrupts-off latency tracing.
+
+   When enabled with the "-intrlat" kernel command-line option,
+   every section of code that runs with interrupts off is timed
+   with the CPU time-stamp counter, from the intr_disable() or
+   interrupt entry that turned interrupts off to the
+   intr_enable() or interrupt return that turned them back on.
+   The longest sections are kept per call site that turned
+   interrupts off, and the worst offenders are printed at
+   shutdown.  Sections may span a context switch.  A section
+   lies within one hold of the interrupts-off lock, so sections
+   on different processors never overlap. */
+struct intr_latency 
+  {
+    void *off_caller;           /* Where interrupts were turned off. */
+    void *on_caller;            /* Where the longest one ended. */
+    uint64_t max;               /* Longest section, in cycles. */
+    uint64_t total;             /* Sum of all sections, in cycles. */
+    unsigned count;             /* Number of sections. */
+  };
+static struct intr_latency latency_top[INTR_LATENCY_MAX];
+static int latency_top_cnt;     /* Offenders to keep, 0 if disabled. */
+static bool latency_open;       /* Are we timing a section? */
+static uint64_t latency_start;  /* TSC when the section started. */
+static void *latency_caller;    /* Where the section started. */
+static uint64_t latency_sections; /* Number of sections timed. */
+
+static enum intr_level enable (void *caller);
+static enum intr_level disable (void *caller);
+static void acquire_intr_lock (void);
+static void release_intr_lock (void);
+static void latency_begin (void *caller);
+static void latency_end (void *caller);
 
 /* Returns the current interrupt status. */
 enum intr_level
@@ -67,16 +137,39 @@ intr_get_level (void)
 enum intr_level
 intr_set_level (enum intr_level level) 
 {
-  return level == INTR_ON ? intr_enable () : intr_disable ();
+  void *caller = __builtin_return_address (0);
+
+  return level == INTR_ON ? enable (caller) : disable (caller);
 }
 
 /* Enables interrupts and returns the previous interrupt status. */
 enum intr_level
 intr_enable (void) 
+{
+  return enable (__builtin_return_address (0));
+}
+
+/* Disables interrupts and returns the previous interrupt status. */
+enum intr_level
+intr_disable (void) 
+{
+  return disable (__builtin_return_address (0));
+}
+
+/* Enables interrupts on behalf of CALLER and returns the
+   previous interrupt status. */
+static enum intr_level
+enable (void *caller) 
 {
   enum intr_level old_level = intr_get_level ();
   ASSERT (!intr_context ());
 
+  if (old_level == INTR_OFF) 
+    {
+      latency_end (caller);
+      release_intr_lock ();
+    }
+
   /* Enable interrupts by setting the interrupt flag.
 
      See [IA32-v2b] "STI" and [IA32-v3a] 5.8.1 "Masking Maskable
@@ -86,9 +179,10 @@ intr_enable (void)
   return old_level;
 }
 
-/* Disables interrupts and returns the previous interrupt status. */
-enum intr_level
-intr_disable (void) 
+/* Disables interrupts on behalf of CALLER and returns the
+   previous interrupt status. */
+static enum intr_level
+disable (void *caller) 
 {
   enum intr_level old_level = intr_get_level ();
 
@@ -97,14 +191,72 @@ intr_disable (void)
      Hardware Interrupts". */
   asm volatile ("cli" : : : "memory");
 
+  if (old_level == INTR_ON) 
+    {
+      acquire_intr_lock ();
+      latency_begin (caller);
+    }
+
   return old_level;
 }
+
+/* Acquires the interrupts-off lock.  Interrupts must be off.
+   Flushes the TLB while spinning, if asked to. */
+static void
+acquire_intr_lock (void) 
+{
+  while (!spin_trylock (&intr_lock))
+    while (intr_lock.locked) 
+      {
+        smp_tlb_poll ();
+        asm volatile ("pause");
+      }
+}
+
+/* Releases the interrupts-off lock.  Interrupts must be off. */
+static void
+release_intr_lock (void) 
+{
+  spin_unlock (&intr_lock);
+}
+
+/* Called by an application processor, with interrupts off, once
+   it can run threads: waits for the interrupts-off lock, which
+   it then holds, like any processor with interrupts off. */
+void
+intr_start_ap (void) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  acquire_intr_lock ();
+}
+
+/* Turns interrupts on and halts until the next interrupt, for
+   the idle thread.  Interrupts must be off.
+
+   The `sti' instruction disables interrupts until the
+   completion of the next instruction, so these two instructions
+   are executed atomically.  This atomicity is important;
+   otherwise, an interrupt could be handled between re-enabling
+   interrupts and waiting for the next one to occur, wasting as
+   much as one clock tick worth of time.
+
+   See [IA32-v2a] "HLT", [IA32-v2b] "STI", and [IA32-v3a]
+   7.11.1 "HLT Instruction". */
+void
+intr_idle (void) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  latency_end (__builtin_return_address (0));
+  release_intr_lock ();
+  asm volatile ("sti; hlt" : : : "memory");
+}
 
 /* Initializes the interrupt system. */
 void
 intr_init (void)
 {
-  uint64_t idtr_operand;
   int i;
 
   /* Initialize interrupt controller. */
@@ -114,11 +266,7 @@ intr_init (void)
   for (i = 0; i < INTR_CNT; i++)
     idt[i] = make_intr_gate (intr_stubs[i], 0);
 
-  /* Load IDT register.
-     See [IA32-v2a] "LIDT" and [IA32-v3a] 5.10 "Interrupt
-     Descriptor Table (IDT)". */
-  idtr_operand = make_idtr_operand (sizeof idt - 1, idt);
-  asm volatile ("lidt %0" : : "m" (idtr_operand));
+  intr_load_idt ();
 
   /* Initialize intr_names. */
   for (i = 0; i < INTR_CNT; i++)
@@ -172,6 +320,17 @@ intr_register_ext (uint8_t vec_no, intr_handler_func *handler,
   register_handler (vec_no, 0, INTR_OFF, handler, name);
 }
 
+/* Loads the IDT into the running processor's IDT register.
+   Application processors share the bootstrap processor's IDT.
+   See [IA32-v2a] "LIDT" and [IA32-v3a] 5.10 "Interrupt
+   Descriptor Table (IDT)". */
+void
+intr_load_idt (void) 
+{
+  uint64_t idtr_operand = make_idtr_operand (sizeof idt - 1, idt);
+  asm volatile ("lidt %0" : : "m" (idtr_operand));
+}
+
 /* Registers internal interrupt VEC_NO to invoke HANDLER, which
    is named NAME for debugging purposes.  The interrupt handler
    will be invoked with interrupt status LEVEL.
@@ -194,11 +353,12 @@ intr_register_int (uint8_t vec_no, int dpl, enum intr_level level,
 }
 
 /* Returns true during processing of an external interrupt
-   and false at all other times. */
+   and false at all other times.  A processor with interrupts on
+   is not processing one, whatever another processor is doing. */
 bool
 intr_context (void) 
 {
-  return in_external_intr;
+  return intr_get_level () == INTR_OFF && in_external_intr;
 }
 
 /* During processing of an external interrupt, directs the
@@ -338,14 +498,32 @@ make_idtr_operand (uint16_t limit, void *base)
 void
 intr_handler (struct intr_frame *frame) 
 {
-  bool external;
+  bool pic, external, local;
   intr_handler_func *handler;
 
   /* External interrupts are special.
      We only handle one at a time (so interrupts must be off)
      and they need to be acknowledged on the PIC (see below).
-     An external interrupt handler cannot sleep. */
-  external = frame->vec_no >= 0x20 && frame->vec_no < 0x30;
+     An external interrupt handler cannot sleep.
+
+     Interrupts from the local APIC's timer and reschedule IPIs
+     are handled like external interrupts, on whichever processor
+     they arrive, and acknowledged on its local APIC.  Spurious
+     and TLB shootdown interrupts are "local": they run without
+     the interrupts-off lock, so they must touch nothing but the
+     running processor's own state. */
+  pic = frame->vec_no >= 0x20 && frame->vec_no < 0x30;
+  external = (pic
+              || frame->vec_no == LAPIC_ONESHOT_VEC
+              || frame->vec_no == LAPIC_TIMER_VEC
+              || frame->vec_no == LAPIC_RESCHED_VEC);
+  local = (frame->vec_no == LAPIC_SPURIOUS_VEC
+           || frame->vec_no == LAPIC_TLB_VEC);
+  if ((frame->eflags & FLAG_IF) && intr_get_level () == INTR_OFF && !local) 
+    {
+      acquire_intr_lock ();
+      latency_begin (frame->eip);
+    }
   if (external) 
     {
       ASSERT (intr_get_level () == INTR_OFF);
@@ -353,6 +531,11 @@ intr_handler (struct intr_frame *frame)
 
       in_external_intr = true;
       yield_on_return = false;
+
+      /* Catch up on ticks skipped while the bootstrap processor
+         was idle in tickless mode. */
+      if (thread_cpu ()->bsp)
+        timer_idle_exit ();
     }
 
   /* Invoke the interrupt's handler. */
@@ -380,11 +563,140 @@ intr_handler (struct intr_frame *frame)
       ASSERT (intr_context ());
 
       in_external_intr = false;
-      pic_end_of_interrupt (frame->vec_no); 
+      if (pic)
+        pic_end_of_interrupt (frame->vec_no); 
+      else
+        lapic_eoi ();
 
       if (yield_on_return) 
         thread_yield (); 
     }
+
+#ifdef USERPROG
+  /* A user thread whose process is exiting ends itself instead
+     of returning to user mode.  System calls and faults return
+     through here too, as does the timer interrupt that
+     preempts a thread looping in user mode. */
+  if (frame->cs == SEL_UCSEG && !local && process_killed ()) 
+    {
+      intr_enable ();
+      exit_impl (-1);
+      NOT_REACHED ();
+    }
+#endif
+
+  /* Returning will turn interrupts back on.  The thread may have
+     moved to another processor while yielding, but whichever
+     processor it is on now holds the lock. */
+  if ((frame->eflags & FLAG_IF) && intr_get_level () == INTR_OFF && !local) 
+    {
+      latency_end (frame->eip);
+      release_intr_lock ();
+    }
+}
+
+/* Starts interrupts-off latency tracing, keeping the TOP_CNT
+   worst offenders.  TOP_CNT is capped at INTR_LATENCY_MAX. */
+void
+intr_latency_init (int top_cnt) 
+{
+  if (top_cnt > INTR_LATENCY_MAX)
+    top_cnt = INTR_LATENCY_MAX;
+  latency_top_cnt = top_cnt > 0 ? top_cnt : 0;
+}
+
+/* Prints the worst interrupts-off sections, longest first. */
+void
+intr_latency_print (void) 
+{
+  bool printed[INTR_LATENCY_MAX];
+  int i;
+
+  if (latency_top_cnt == 0)
+    return;
+
+  printf ("Interrupts off: %llu sections, longest first:\n",
+          latency_sections);
+  for (i = 0; i < latency_top_cnt; i++)
+    printed[i] = false;
+  for (;;) 
+    {
+      struct intr_latency *l;
+      int best = -1;
+
+      for (i = 0; i < latency_top_cnt; i++)
+        if (!printed[i] && latency_top[i].count > 0
+            && (best < 0 || latency_top[i].max > latency_top[best].max))
+          best = i;
+      if (best < 0)
+        break;
+      printed[best] = true;
+
+      l = &latency_top[best];
+      printf ("  %10llu cycles max (%7lld us), %10llu mean, %6u times: "
+              "off at %p, on at %p\n",
+              l->max, timer_tsc_to_ns (l->max) / 1000,
+              l->total / l->count, l->count,
+              l->off_caller, l->on_caller);
+    }
+}
+
+/* Starts timing an interrupts-off section that CALLER began.
+   Interrupts must be off. */
+static void
+latency_begin (void *caller) 
+{
+  if (latency_top_cnt == 0)
+    return;
+
+  latency_open = true;
+  latency_caller = caller;
+  latency_start = rdtsc ();
+}
+
+/* Ends the interrupts-off section being timed, if any, with
+   CALLER turning interrupts back on, and records it.
+   Interrupts must be off. */
+static void
+latency_end (void *caller) 
+{
+  struct intr_latency *l, *victim;
+  uint64_t cycles;
+  int i;
+
+  if (!latency_open)
+    return;
+  cycles = rdtsc () - latency_start;
+  latency_open = false;
+  latency_sections++;
+
+  /* Find this call site's entry, or else the entry with the
+     shortest maximum, to replace if this section is longer. */
+  victim = NULL;
+  for (i = 0; i < latency_top_cnt; i++) 
+    {
+      l = &latency_top[i];
+      if (l->count > 0 && l->off_caller == latency_caller) 
+        {
+          if (cycles > l->max) 
+            {
+              l->max = cycles;
+              l->on_caller = caller;
+            }
+          l->total += cycles;
+          l->count++;
+          return;
+        }
+      if (victim == NULL || l->max < victim->max)
+        victim = l;
+    }
+  if (victim != NULL && (victim->count == 0 || cycles > victim->max)) 
+    {
+      victim->off_caller = latency_caller;
+      victim->on_caller = caller;
+      victim->max = victim->total = cycles;
+      victim->count = 1;
+    }
 }
 
 /* Dumps interrupt frame F to the console, for debugging. */
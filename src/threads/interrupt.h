@@ -58,13 +58,21 @@ struct intr_frame
 typedef void intr_handler_func (struct intr_frame *);
 
 void intr_init (void);
+void intr_load_idt (void);
 void intr_register_ext (uint8_t vec, intr_handler_func *, const char *name);
 void intr_register_int (uint8_t vec, int dpl, enum intr_level,
                         intr_handler_func *, const char *name);
 bool intr_context (void);
 void intr_yield_on_return (void);
+void intr_start_ap (void);
+void intr_idle (void);
 
 void intr_dump_frame (const struct intr_frame *);
 const char *intr_name (uint8_t vec);
 
+/* Interrupts-off latency tracing. */
+#define INTR_LATENCY_MAX 32     /* Maximum number of offenders kept. */
+void intr_latency_init (int top_cnt);
+void intr_latency_print (void);
+
 #endif /* threads/interrupt.h */
@@ -5,6 +5,11 @@
 #define LOADER_BASE 0x7c00      /* Physical address of loader's base. */
 #define LOADER_END  0x7e00      /* Physical address of end of loader. */
 
+/* Physical address to which threads/mpentry.S is copied, where
+   application processors start executing in real mode.  Must be
+   page-aligned and below 1 MB. */
+#define LOADER_MPENTRY 0x7000
+
 /* Physical address of kernel base. */
 #define LOADER_KERN_BASE 0x100000       /* 1 MB. */
 
@@ -21,13 +26,18 @@
 #define LOADER_SIG (LOADER_END - LOADER_SIG_LEN)   /* 0xaa55 BIOS signature. */
 #define LOADER_ARGS (LOADER_SIG - LOADER_ARGS_LEN)     /* Command-line args. */
 #define LOADER_ARG_CNT (LOADER_ARGS - LOADER_ARG_CNT_LEN) /* Number of args. */
-#define LOADER_RAM_PGS (LOADER_ARG_CNT - LOADER_RAM_PGS_LEN) /* # RAM pages. */
+#define LOADER_E820_END (LOADER_ARG_CNT - LOADER_E820_END_LEN) /* Map end. */
 
 /* Sizes of loader data structures. */
 #define LOADER_SIG_LEN 2
 #define LOADER_ARGS_LEN 128
 #define LOADER_ARG_CNT_LEN 4
-#define LOADER_RAM_PGS_LEN 4
+#define LOADER_E820_END_LEN 4
+
+/* Physical address at which the loader stores the BIOS E820
+   memory map, as an array of 20-byte entries ending at the
+   address stored at LOADER_E820_END. */
+#define LOADER_E820_MAP 0x8000
 
 /* GDT selectors defined by loader.
    More selectors are defined by userprog/gdt.h. */
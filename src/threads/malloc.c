@@ -5,6 +5,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/memtag.h"
 #include "threads/palloc.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
@@ -32,14 +33,23 @@
    because they're too big to fit in a single page with a
    descriptor.  We handle those by allocating contiguous pages
    with the page allocator and sticking the allocation size at
-   the beginning of the allocated block's arena header. */
+   the beginning of the allocated block's arena header.
+
+   For allocation accounting, an arena's header is followed by a
+   byte per block giving the tag the block is charged to and,
+   under -memdebug, by a pointer per block to the code that
+   allocated it.  The blocks come after that. */
 
 /* Descriptor. */
 struct desc
   {
     size_t block_size;          /* Size of each element in bytes. */
     size_t blocks_per_arena;    /* Number of blocks in an arena. */
+    size_t block_ofs;           /* Offset of first block in an arena. */
     struct list free_list;      /* List of free blocks. */
+    struct list arenas;         /* List of arenas. */
+    size_t arena_cnt;           /* Number of arenas. */
+    size_t used_cnt;            /* Number of blocks allocated. */
     struct lock lock;           /* Lock. */
   };
 
@@ -52,6 +62,9 @@ struct arena
     unsigned magic;             /* Always set to ARENA_MAGIC. */
     struct desc *desc;          /* Owning descriptor, null for big block. */
     size_t free_cnt;            /* Free blocks; pages in big block. */
+    struct list_elem elem;      /* In desc's `arenas' or `big_arenas'. */
+    enum mem_tag tag;           /* Tag, for a big block. */
+    void *caller;               /* Allocating code, for a big block. */
   };
 
 /* Free block. */
@@ -64,34 +77,74 @@ struct block
 static struct desc descs[10];   /* Descriptors. */
 static size_t desc_cnt;         /* Number of descriptors. */
 
+/* Arenas holding big blocks. */
+static struct list big_arenas;
+static struct lock big_lock;
+
 static struct arena *block_to_arena (struct block *);
 static struct block *arena_to_block (struct arena *, size_t idx);
+static size_t block_idx (struct arena *, struct block *);
+static uint8_t *arena_tags (struct arena *);
+static void **arena_callers (struct arena *);
+static void *do_malloc (size_t, enum mem_tag, void *caller);
+static void *do_calloc (size_t, size_t, enum mem_tag, void *caller);
 
 /* Initializes the malloc() descriptors. */
 void
 malloc_init (void) 
 {
   size_t block_size;
+  size_t per_block = sizeof (uint8_t) + (memdebug ? sizeof (void *) : 0);
 
   for (block_size = 16; block_size < PGSIZE / 2; block_size *= 2)
     {
       struct desc *d = &descs[desc_cnt++];
+      size_t n;
+
       ASSERT (desc_cnt <= sizeof descs / sizeof *descs);
+      ASSERT (desc_cnt <= MEM_CLASS_MAX);
+      n = (PGSIZE - sizeof (struct arena)) / (block_size + per_block);
+      while (ROUND_UP (sizeof (struct arena) + n * per_block,
+                       sizeof (void *)) + n * block_size > PGSIZE)
+        n--;
       d->block_size = block_size;
-      d->blocks_per_arena = (PGSIZE - sizeof (struct arena)) / block_size;
+      d->blocks_per_arena = n;
+      d->block_ofs = ROUND_UP (sizeof (struct arena) + n * per_block,
+                               sizeof (void *));
       list_init (&d->free_list);
+      list_init (&d->arenas);
+      d->arena_cnt = 0;
+      d->used_cnt = 0;
       lock_init (&d->lock);
     }
+  list_init (&big_arenas);
+  lock_init (&big_lock);
 }
 
 /* Obtains and returns a new block of at least SIZE bytes.
    Returns a null pointer if memory is not available. */
 void *
 malloc (size_t size) 
+{
+  return do_malloc (size, MEM_MISC, MEM_CALLER);
+}
+
+/* Like malloc(), but charges the block to TAG. */
+void *
+malloc_tagged (size_t size, enum mem_tag tag) 
+{
+  return do_malloc (size, tag, MEM_CALLER);
+}
+
+/* Allocates a block of at least SIZE bytes for CALLER, charging
+   it to TAG. */
+static void *
+do_malloc (size_t size, enum mem_tag tag, void *caller) 
 {
   struct desc *d;
   struct block *b;
   struct arena *a;
+  size_t idx;
 
   /* A null pointer satisfies a request for 0 bytes. */
   if (size == 0)
@@ -107,7 +160,7 @@ malloc (size_t size)
       /* SIZE is too big for any descriptor.
          Allocate enough pages to hold SIZE plus an arena. */
       size_t page_cnt = DIV_ROUND_UP (size + sizeof *a, PGSIZE);
-      a = palloc_get_multiple (0, page_cnt);
+      a = palloc_get_multiple (PAL_TAG (MEM_MALLOC), page_cnt);
       if (a == NULL)
         return NULL;
 
@@ -116,6 +169,12 @@ malloc (size_t size)
       a->magic = ARENA_MAGIC;
       a->desc = NULL;
       a->free_cnt = page_cnt;
+      a->tag = tag;
+      a->caller = caller;
+      lock_acquire (&big_lock);
+      list_push_back (&big_arenas, &a->elem);
+      lock_release (&big_lock);
+      memtag_bytes (tag, page_cnt * PGSIZE);
       return a + 1;
     }
 
@@ -127,7 +186,7 @@ malloc (size_t size)
       size_t i;
 
       /* Allocate a page. */
-      a = palloc_get_page (0);
+      a = palloc_get_page (PAL_TAG (MEM_MALLOC));
       if (a == NULL) 
         {
           lock_release (&d->lock);
@@ -138,10 +197,14 @@ malloc (size_t size)
       a->magic = ARENA_MAGIC;
       a->desc = d;
       a->free_cnt = d->blocks_per_arena;
+      list_push_back (&d->arenas, &a->elem);
+      d->arena_cnt++;
       for (i = 0; i < d->blocks_per_arena; i++) 
         {
           struct block *b = arena_to_block (a, i);
           list_push_back (&d->free_list, &b->free_elem);
+          if (memdebug)
+            arena_callers (a)[i] = NULL;
         }
     }
 
@@ -149,7 +212,13 @@ malloc (size_t size)
   b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
   a = block_to_arena (b);
   a->free_cnt--;
+  d->used_cnt++;
+  idx = block_idx (a, b);
+  arena_tags (a)[idx] = tag;
+  if (memdebug)
+    arena_callers (a)[idx] = caller;
   lock_release (&d->lock);
+  memtag_bytes (tag, d->block_size);
   return b;
 }
 
@@ -157,6 +226,21 @@ malloc (size_t size)
    Returns a null pointer if memory is not available. */
 void *
 calloc (size_t a, size_t b) 
+{
+  return do_calloc (a, b, MEM_MISC, MEM_CALLER);
+}
+
+/* Like calloc(), but charges the block to TAG. */
+void *
+calloc_tagged (size_t a, size_t b, enum mem_tag tag) 
+{
+  return do_calloc (a, b, tag, MEM_CALLER);
+}
+
+/* Allocates A times B zeroed bytes for CALLER, charging them to
+   TAG. */
+static void *
+do_calloc (size_t a, size_t b, enum mem_tag tag, void *caller) 
 {
   void *p;
   size_t size;
@@ -167,7 +251,7 @@ calloc (size_t a, size_t b)
     return NULL;
 
   /* Allocate and zero memory. */
-  p = malloc (size);
+  p = do_malloc (size, tag, caller);
   if (p != NULL)
     memset (p, 0, size);
 
@@ -185,12 +269,23 @@ block_size (void *block)
   return d != NULL ? d->block_size : PGSIZE * a->free_cnt - pg_ofs (block);
 }
 
+/* Returns the tag that BLOCK is charged to. */
+static enum mem_tag
+block_tag (void *block) 
+{
+  struct block *b = block;
+  struct arena *a = block_to_arena (b);
+
+  return a->desc != NULL ? arena_tags (a)[block_idx (a, b)] : a->tag;
+}
+
 /* Attempts to resize OLD_BLOCK to NEW_SIZE bytes, possibly
    moving it in the process.
    If successful, returns the new block; on failure, returns a
    null pointer.
    A call with null OLD_BLOCK is equivalent to malloc(NEW_SIZE).
-   A call with zero NEW_SIZE is equivalent to free(OLD_BLOCK). */
+   A call with zero NEW_SIZE is equivalent to free(OLD_BLOCK).
+   The new block is charged to the same tag as OLD_BLOCK. */
 void *
 realloc (void *old_block, size_t new_size) 
 {
@@ -201,7 +296,8 @@ realloc (void *old_block, size_t new_size)
     }
   else 
     {
-      void *new_block = malloc (new_size);
+      enum mem_tag tag = old_block != NULL ? block_tag (old_block) : MEM_MISC;
+      void *new_block = do_malloc (new_size, tag, MEM_CALLER);
       if (old_block != NULL && new_block != NULL)
         {
           size_t old_size = block_size (old_block);
@@ -227,6 +323,8 @@ free (void *p)
       if (d != NULL) 
         {
           /* It's a normal block.  We handle it here. */
+          size_t idx = block_idx (a, b);
+          enum mem_tag tag;
 
 #ifndef NDEBUG
           /* Clear the block to help detect use-after-free bugs. */
@@ -237,6 +335,10 @@ free (void *p)
 
           /* Add block to free list. */
           list_push_front (&d->free_list, &b->free_elem);
+          d->used_cnt--;
+          tag = arena_tags (a)[idx];
+          if (memdebug)
+            arena_callers (a)[idx] = NULL;
 
           /* If the arena is now entirely unused, free it. */
           if (++a->free_cnt >= d->blocks_per_arena) 
@@ -249,20 +351,86 @@ free (void *p)
                   struct block *b = arena_to_block (a, i);
                   list_remove (&b->free_elem);
                 }
+              list_remove (&a->elem);
+              d->arena_cnt--;
               palloc_free_page (a);
             }
 
           lock_release (&d->lock);
+          memtag_bytes (tag, -(int) d->block_size);
         }
       else
         {
           /* It's a big block.  Free its pages. */
+          lock_acquire (&big_lock);
+          list_remove (&a->elem);
+          lock_release (&big_lock);
+          memtag_bytes (a->tag, -(int) (a->free_cnt * PGSIZE));
           palloc_free_multiple (a, a->free_cnt);
           return;
         }
     }
 }
 
+/* Fills in the size class statistics in MS. */
+void
+malloc_get_stats (struct memstat *ms) 
+{
+  size_t i;
+
+  ms->class_cnt = desc_cnt;
+  for (i = 0; i < desc_cnt; i++) 
+    {
+      struct desc *d = &descs[i];
+      struct mem_class_stats *c = &ms->classes[i];
+
+      lock_acquire (&d->lock);
+      c->block_size = d->block_size;
+      c->arenas = d->arena_cnt;
+      c->blocks = d->arena_cnt * d->blocks_per_arena;
+      c->used = d->used_cnt;
+      lock_release (&d->lock);
+    }
+}
+
+/* Passes each live block to memtag_note_live().  Does nothing
+   unless -memdebug is in effect. */
+void
+malloc_note_live (void) 
+{
+  struct list_elem *e;
+  size_t i, j;
+
+  if (!memdebug)
+    return;
+
+  for (i = 0; i < desc_cnt; i++) 
+    {
+      struct desc *d = &descs[i];
+
+      lock_acquire (&d->lock);
+      for (e = list_begin (&d->arenas); e != list_end (&d->arenas);
+           e = list_next (e)) 
+        {
+          struct arena *a = list_entry (e, struct arena, elem);
+          for (j = 0; j < d->blocks_per_arena; j++)
+            if (arena_callers (a)[j] != NULL)
+              memtag_note_live (arena_callers (a)[j], arena_tags (a)[j],
+                                d->block_size);
+        }
+      lock_release (&d->lock);
+    }
+
+  lock_acquire (&big_lock);
+  for (e = list_begin (&big_arenas); e != list_end (&big_arenas);
+       e = list_next (e)) 
+    {
+      struct arena *a = list_entry (e, struct arena, elem);
+      memtag_note_live (a->caller, a->tag, a->free_cnt * PGSIZE);
+    }
+  lock_release (&big_lock);
+}
+
 /* Returns the arena that block B is inside. */
 static struct arena *
 block_to_arena (struct block *b)
@@ -275,7 +443,7 @@ block_to_arena (struct block *b)
 
   /* Check that the block is properly aligned for the arena. */
   ASSERT (a->desc == NULL
-          || (pg_ofs (b) - sizeof *a) % a->desc->block_size == 0);
+          || (pg_ofs (b) - a->desc->block_ofs) % a->desc->block_size == 0);
   ASSERT (a->desc != NULL || pg_ofs (b) == sizeof *a);
 
   return a;
@@ -289,6 +457,29 @@ arena_to_block (struct arena *a, size_t idx)
   ASSERT (a->magic == ARENA_MAGIC);
   ASSERT (idx < a->desc->blocks_per_arena);
   return (struct block *) ((uint8_t *) a
-                           + sizeof *a
+                           + a->desc->block_ofs
                            + idx * a->desc->block_size);
 }
+
+/* Returns the index of block B within arena A. */
+static size_t
+block_idx (struct arena *a, struct block *b) 
+{
+  return (pg_ofs (b) - a->desc->block_ofs) / a->desc->block_size;
+}
+
+/* Returns the array of block tags in arena A. */
+static uint8_t *
+arena_tags (struct arena *a) 
+{
+  return (uint8_t *) (a + 1);
+}
+
+/* Returns the array of block callers in arena A, which exists
+   only under -memdebug. */
+static void **
+arena_callers (struct arena *a) 
+{
+  ASSERT (memdebug);
+  return (void **) ((uint8_t *) (a + 1) + a->desc->blocks_per_arena);
+}
@@ -2,6 +2,7 @@
 #define THREADS_MALLOC_H
 
 #include <debug.h>
+#include <memstat.h>
 #include <stddef.h>
 
 void malloc_init (void);
@@ -10,4 +11,9 @@ void *calloc (size_t, size_t) __attribute__ ((malloc));
 void *realloc (void *, size_t);
 void free (void *);
 
+void *malloc_tagged (size_t, enum mem_tag) __attribute__ ((malloc));
+void *calloc_tagged (size_t, size_t, enum mem_tag) __attribute__ ((malloc));
+void malloc_get_stats (struct memstat *);
+void malloc_note_live (void);
+
 #endif /* threads/malloc.h */
@@ -0,0 +1,197 @@
+#include "threads/memtag.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/slab.h"
+
+bool memdebug;
+
+/* Usage by tag.  Accessed with interrupts off. */
+static struct mem_tag_stats tag_stats[MEM_TAG_CNT];
+
+static const char *tag_names[MEM_TAG_CNT] = MEM_TAG_NAMES;
+
+/* Live allocations by caller, gathered for the -memdebug
+   report. */
+#define LIVE_MAX 32
+struct live_caller 
+  {
+    void *caller;               /* Return address of allocating call. */
+    enum mem_tag tag;           /* Tag charged. */
+    size_t cnt;                 /* Number of live allocations. */
+    size_t bytes;               /* Their total size. */
+  };
+static struct live_caller live[LIVE_MAX];
+static int live_cnt;
+static size_t live_dropped;
+
+static void account (enum mem_tag, int cnt, uint32_t *now, uint32_t *peak);
+static void print_live (void);
+
+/* Charges PAGE_CNT pages to TAG, or credits -PAGE_CNT pages if
+   PAGE_CNT is negative. */
+void
+memtag_pages (enum mem_tag tag, int page_cnt) 
+{
+  struct mem_tag_stats *s = &tag_stats[tag];
+
+  ASSERT (tag < MEM_TAG_CNT);
+  account (tag, page_cnt, &s->pages, &s->peak_pages);
+}
+
+/* Charges BYTES bytes to TAG, or credits -BYTES bytes if BYTES
+   is negative. */
+void
+memtag_bytes (enum mem_tag tag, int bytes) 
+{
+  struct mem_tag_stats *s = &tag_stats[tag];
+
+  ASSERT (tag < MEM_TAG_CNT);
+  account (tag, bytes, &s->bytes, &s->peak_bytes);
+}
+
+/* Adds CNT, which may be negative, to *NOW for TAG, keeping
+   *PEAK up to date. */
+static void
+account (enum mem_tag tag, int cnt, uint32_t *now, uint32_t *peak) 
+{
+  struct mem_tag_stats *s = &tag_stats[tag];
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  if (cnt >= 0) 
+    {
+      s->allocs++;
+      *now += cnt;
+      if (*now > *peak)
+        *peak = *now;
+    }
+  else 
+    {
+      s->frees++;
+      ASSERT (*now >= (uint32_t) -cnt);
+      *now -= -cnt;
+    }
+  intr_set_level (old_level);
+}
+
+/* Fills in MS with a snapshot of memory usage. */
+void
+memtag_get_stats (struct memstat *ms) 
+{
+  enum intr_level old_level;
+
+  memset (ms, 0, sizeof *ms);
+  ms->ticks = timer_ticks ();
+  old_level = intr_disable ();
+  memcpy (ms->tags, tag_stats, sizeof ms->tags);
+  intr_set_level (old_level);
+  palloc_get_stats (ms);
+  malloc_get_stats (ms);
+}
+
+/* Prints memory usage by tag and by malloc() size class and,
+   under -memdebug, live allocations by caller. */
+void
+memtag_print_stats (void) 
+{
+  struct memstat ms;
+  int64_t secs;
+  unsigned i;
+
+  memtag_get_stats (&ms);
+  secs = ms.ticks / TIMER_FREQ > 0 ? ms.ticks / TIMER_FREQ : 1;
+
+  printf ("Memory: %-9s %6s %6s %9s %9s %9s %9s\n", "tag", "pages", "peak",
+          "bytes", "peak", "allocs", "allocs/s");
+  for (i = 0; i < MEM_TAG_CNT; i++) 
+    {
+      struct mem_tag_stats *s = &ms.tags[i];
+      if (s->allocs == 0)
+        continue;
+      printf ("Memory: %-9s %6"PRIu32" %6"PRIu32" %9"PRIu32" %9"PRIu32
+              " %9"PRIu64" %9"PRIu64"\n",
+              tag_names[i], s->pages, s->peak_pages, s->bytes,
+              s->peak_bytes, s->allocs, s->allocs / secs);
+    }
+  for (i = 0; i < ms.class_cnt; i++) 
+    {
+      struct mem_class_stats *c = &ms.classes[i];
+      if (c->arenas == 0)
+        continue;
+      printf ("Memory: %4"PRIu32"-byte blocks: %"PRIu32" of %"PRIu32
+              " used in %"PRIu32" arenas, %"PRIu32" bytes idle\n",
+              c->block_size, c->used, c->blocks, c->arenas,
+              (c->blocks - c->used) * c->block_size);
+    }
+
+  if (memdebug)
+    print_live ();
+}
+
+/* Adds a live allocation of BYTES bytes, charged to TAG, made
+   by CALLER, to the -memdebug report. */
+void
+memtag_note_live (void *caller, enum mem_tag tag, size_t bytes) 
+{
+  int i;
+
+  for (i = 0; i < live_cnt; i++)
+    if (live[i].caller == caller && live[i].tag == tag)
+      break;
+  if (i == live_cnt) 
+    {
+      if (live_cnt == LIVE_MAX) 
+        {
+          live_dropped++;
+          return;
+        }
+      live[live_cnt].caller = caller;
+      live[live_cnt].tag = tag;
+      live[live_cnt].cnt = 0;
+      live[live_cnt].bytes = 0;
+      live_cnt++;
+    }
+  live[i].cnt++;
+  live[i].bytes += bytes;
+}
+
+/* Prints live allocations by caller, most bytes first. */
+static void
+print_live (void) 
+{
+  bool printed[LIVE_MAX];
+  int i;
+
+  live_cnt = 0;
+  live_dropped = 0;
+  palloc_note_live ();
+  malloc_note_live ();
+  kmem_note_live ();
+
+  printf ("Memory: live allocations by caller:\n");
+  for (i = 0; i < live_cnt; i++)
+    printed[i] = false;
+  for (;;) 
+    {
+      int best = -1;
+
+      for (i = 0; i < live_cnt; i++)
+        if (!printed[i] && (best < 0 || live[i].bytes > live[best].bytes))
+          best = i;
+      if (best < 0)
+        break;
+      printed[best] = true;
+      printf ("  %8zu bytes in %6zu allocations (%s) from %p\n",
+              live[best].bytes, live[best].cnt, tag_names[live[best].tag],
+              live[best].caller);
+    }
+  if (live_dropped > 0)
+    printf ("  (%zu allocations from other callers not shown)\n",
+            live_dropped);
+}
@@ -0,0 +1,33 @@
+#ifndef THREADS_MEMTAG_H
+#define THREADS_MEMTAG_H
+
+#include <memstat.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Allocation accounting.
+
+   The page allocator, malloc(), and the object caches charge
+   every allocation to a tag, an enum mem_tag, named by the
+   caller.  The totals are reported at shutdown and by the
+   memstat() system call.
+
+   With the -memdebug kernel option, each allocator also records
+   the return address of the code that made each live allocation,
+   and the shutdown report lists live allocations by caller, to
+   help track down leaks.  utils/backtrace translates the
+   addresses into function names. */
+
+/* -memdebug: Record the caller of each live allocation? */
+extern bool memdebug;
+
+/* The caller of the function that uses this macro. */
+#define MEM_CALLER __builtin_return_address (0)
+
+void memtag_pages (enum mem_tag, int page_cnt);
+void memtag_bytes (enum mem_tag, int bytes);
+void memtag_get_stats (struct memstat *);
+void memtag_print_stats (void);
+void memtag_note_live (void *caller, enum mem_tag, size_t bytes);
+
+#endif /* threads/memtag.h */
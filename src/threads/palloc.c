@@ -1,7 +1,7 @@
 #include "threads/palloc.h"
-#include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -9,7 +9,10 @@
 #include <string.h>
 #include "threads/init.h"
 #include "threads/loader.h"
+#include "threads/memtag.h"
+#include "threads/pgops.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
 #include "threads/vaddr.h"
 
 /* Page allocator.  Hands out memory in page-size (or
@@ -24,14 +27,70 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   The split is not fixed, though.  When a pool cannot satisfy a
+   request, it borrows the pages from the other pool, so that
+   all of RAM is used before user pages are evicted or kernel
+   allocations fail.  A borrowed page stays in the lending pool's
+   books, marked lent, and goes back to that pool when it is
+   freed.  Neither pool lends its last 1/8, so that a burst of
+   demand on one side cannot starve the other.  The user pool
+   does not borrow if -ul set an explicit limit on it.
+
+   Once the kernel pool has fallen below that last 1/8, the
+   frame evictor takes user pages borrowed from the kernel pool
+   ahead of the user pool's own pages, so that the kernel gets
+   its pages back as user memory turns over (see
+   palloc_reclaim_wanted()).
+
+   Each pool is a binary buddy allocator.  Free memory is kept as
+   blocks of 2**ORDER pages, for ORDER from 0 to PALLOC_MAX_ORDER,
+   each aligned on a multiple of its size in physical memory.  A
+   block's "buddy" is the other half of the block of the next
+   order up.  There is a free list per order, so an allocation
+   takes the smallest free block that is big enough, splitting
+   it in halves as necessary, and a free merges a block with its
+   buddy for as long as the buddy is also free.  Both take time
+   proportional to PALLOC_MAX_ORDER, not to the size of the pool.
+
+   A request that is not a power of 2 pages is rounded up to
+   one, and the unused tail is freed again at once, so that no
+   pages are wasted.  The links for a free list are kept in the
+   first page of each free block itself.
+
+   Each allocated page records the tag it is charged to, and,
+   under -memdebug, the first page of each allocation records
+   the code that allocated it. */
+
+/* Per-page state, one byte per page in a pool. */
+#define PAGE_FREE 0x80          /* First page of a free block, OR'd
+                                   with the block's order. */
+#define PAGE_USED 0x40          /* Page is allocated, OR'd with... */
+#define PAGE_LENT 0x20          /* ...this, if lent to the other pool,
+                                   and... */
+#define PAGE_TAG 0x0f           /* ...its enum mem_tag. */
+
+/* Part of a pool, as a shift count, that it never lends. */
+#define RESERVE_SHIFT 3
 
 /* A memory pool. */
 struct pool
   {
     struct lock lock;                   /* Mutual exclusion. */
-    struct bitmap *used_map;            /* Bitmap of free pages. */
+    uint8_t *state;                     /* PAGE_* state of each page. */
+    void **callers;                     /* Allocating code, if memdebug. */
     uint8_t *base;                      /* Base of pool. */
+    size_t page_cnt;                    /* Number of pages in pool. */
+    size_t free_cnt;                    /* Number of free pages. */
+    struct list free[PALLOC_MAX_ORDER + 1];  /* Free blocks by order. */
+    size_t block_cnt[PALLOC_MAX_ORDER + 1];  /* Length of each list. */
+    size_t reserve;                     /* Free pages never lent. */
+    size_t lent;                        /* Pages lent to other pool. */
+    unsigned long long failures;        /* Allocations that failed. */
+    unsigned long long lends;           /* Allocations lent. */
+    unsigned long long returns;         /* Lent allocations freed. */
+    unsigned long long reclaims;        /* ...of which reclaimed. */
   };
 
 /* Two pools: one for kernel data, one for user pages. */
@@ -40,21 +99,53 @@ struct pool kernel_pool, user_pool;
 /* Maximum number of pages to put in user pool. */
 size_t user_page_limit = SIZE_MAX;
 
+/* Pre-zeroed user pages.
+
+   A low-priority "zeroer" thread keeps a reserve of user pages
+   that are already filled with zeros, so that a single-page
+   PAL_USER | PAL_ZERO allocation, the common case in page faults
+   on zero-fill and stack pages, does not have to clear the page
+   itself.  The zeroer runs only when no other thread wants the
+   CPU.  It refills the reserve to `zeroed_high' pages when it
+   drops below half that, but only while the user pool has more
+   than `zeroed_high' other free pages, and when the user pool is
+   otherwise exhausted the reserve is handed out to any user
+   allocation.
+
+   Reserved pages are allocated from the user pool but charged to
+   no tag.  Protected by the user pool's lock. */
+#define ZEROED_MAX 64
+static size_t zeroed[ZEROED_MAX];       /* Indexes of zeroed pages. */
+static size_t zeroed_cnt;               /* Number of zeroed pages. */
+static size_t zeroed_high;              /* Number to keep. */
+static bool zeroer_wanted;              /* Zeroer woken or running? */
+static struct semaphore zeroer_sema;    /* Wakes the zeroer. */
+static unsigned long long zero_hits;    /* Zeroed allocations from reserve. */
+static unsigned long long zero_misses;  /* ...and cleared on demand. */
+
 static void init_pool (struct pool *, void *base, size_t page_cnt,
                        const char *name);
 static bool page_from_pool (const struct pool *, void *page);
+static size_t alloc_pages (struct pool *, size_t page_cnt);
+static size_t alloc_huge (struct pool *, size_t page_cnt);
+static void free_pages (struct pool *, size_t page_idx, size_t page_cnt);
+static void free_block (struct pool *, size_t page_idx, int order);
+static void print_pool_stats (const struct pool *, const char *name);
+static int largest_order (const struct pool *);
+static size_t largest_pages (const struct pool *);
+static void note_pool_live (struct pool *);
+static size_t take_zeroed (struct pool *, enum palloc_flags, size_t page_cnt);
+static size_t borrow_pages (struct pool *, size_t page_cnt);
+static thread_func zeroer;
 
-/* Initializes the page allocator. */
+/* Initializes the page allocator to manage the usable low
+   memory from FREE_START up. */
 void
-palloc_init (void) 
+palloc_init (void *free_start_) 
 {
-  /* End of the kernel as recorded by the linker.
-     See kernel.lds.S. */
-  extern char _end;
-
-  /* Free memory. */
-  uint8_t *free_start = pg_round_up (&_end);
-  uint8_t *free_end = ptov (ram_pages * PGSIZE);
+  /* Free low memory.  High memory is left to highmem.c. */
+  uint8_t *free_start = free_start_;
+  uint8_t *free_end = (uint8_t *) PHYS_BASE + lowmem_pages * PGSIZE;
   size_t free_pages = (free_end - free_start) / PGSIZE;
   size_t user_pages = free_pages / 2;
   size_t kernel_pages;
@@ -62,44 +153,83 @@ palloc_init (void)
     user_pages = user_page_limit;
   kernel_pages = free_pages - user_pages;
 
-  /* Give half of memory to kernel, half to user. */
+  /* Give half of memory to kernel, half to user, to begin
+     with. */
   init_pool (&kernel_pool, free_start, kernel_pages, "kernel pool");
   init_pool (&user_pool, free_start + kernel_pages * PGSIZE,
              user_pages, "user pool");
 }
 
-/* Obtains and returns a group of PAGE_CNT contiguous free pages.
-   If PAL_USER is set, the pages are obtained from the user pool,
-   otherwise from the kernel pool.  If PAL_ZERO is set in FLAGS,
-   then the pages are filled with zeros.  If too few pages are
-   available, returns a null pointer, unless PAL_ASSERT is set in
-   FLAGS, in which case the kernel panics. */
-void *
-palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
+/* Allocates PAGE_CNT pages as palloc_get_multiple() does, on
+   behalf of CALLER. */
+static void *
+get_pages (enum palloc_flags flags, size_t page_cnt, void *caller)
 {
   struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+  enum mem_tag tag = (flags >> PAL_TAG_SHIFT) & PAGE_TAG;
   void *pages;
-  size_t page_idx;
+  size_t page_idx, i;
 
   if (page_cnt == 0)
     return NULL;
+  if (tag == MEM_MISC && (flags & PAL_USER))
+    tag = MEM_USER;
 
   lock_acquire (&pool->lock);
-  page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
+  page_idx = take_zeroed (pool, flags, page_cnt);
+  if (page_idx != SIZE_MAX)
+    flags &= ~PAL_ZERO;
+  else
+    page_idx = alloc_pages (pool, page_cnt);
+  if (page_idx != SIZE_MAX) 
+    {
+      for (i = 0; i < page_cnt; i++)
+        pool->state[page_idx + i] = PAGE_USED | tag;
+      if (pool->callers != NULL)
+        pool->callers[page_idx] = caller;
+    }
   lock_release (&pool->lock);
 
-  if (page_idx != BITMAP_ERROR)
+  /* Out of pages.  Try to borrow them from the other pool. */
+  if (page_idx == SIZE_MAX
+      && (pool == &kernel_pool || user_page_limit == SIZE_MAX)) 
+    {
+      struct pool *lender = pool == &kernel_pool ? &user_pool : &kernel_pool;
+
+      lock_acquire (&lender->lock);
+      page_idx = borrow_pages (lender, page_cnt);
+      if (page_idx != SIZE_MAX) 
+        {
+          for (i = 0; i < page_cnt; i++)
+            lender->state[page_idx + i] = PAGE_USED | PAGE_LENT | tag;
+          if (lender->callers != NULL)
+            lender->callers[page_idx] = caller;
+        }
+      lock_release (&lender->lock);
+      if (page_idx != SIZE_MAX)
+        pool = lender;
+    }
+
+  if (page_idx != SIZE_MAX)
     pages = pool->base + PGSIZE * page_idx;
   else
     pages = NULL;
 
   if (pages != NULL) 
     {
-      if (flags & PAL_ZERO)
-        memset (pages, 0, PGSIZE * page_cnt);
+      memtag_pages (tag, page_cnt);
+      if (flags & PAL_ZERO) 
+        {
+          size_t i;
+          for (i = 0; i < page_cnt; i++)
+            clear_page ((uint8_t *) pages + PGSIZE * i);
+        }
     }
   else 
     {
+      lock_acquire (&pool->lock);
+      pool->failures++;
+      lock_release (&pool->lock);
       if (flags & PAL_ASSERT)
         PANIC ("palloc_get: out of pages");
     }
@@ -107,6 +237,73 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
   return pages;
 }
 
+/* Returns the index of a page from the zeroed reserve, if POOL
+   is the user pool and a request for PAGE_CNT pages with FLAGS
+   should be satisfied from it, or SIZE_MAX otherwise.  Wakes the
+   zeroer if the reserve is running low.  POOL's lock must be
+   held. */
+static size_t
+take_zeroed (struct pool *pool, enum palloc_flags flags, size_t page_cnt) 
+{
+  size_t page_idx = SIZE_MAX;
+
+  if (pool != &user_pool || page_cnt != 1)
+    return SIZE_MAX;
+
+  if (zeroed_cnt > 0 && ((flags & PAL_ZERO) || pool->free_cnt == 0))
+    page_idx = zeroed[--zeroed_cnt];
+  if (flags & PAL_ZERO) 
+    {
+      if (page_idx != SIZE_MAX)
+        zero_hits++;
+      else
+        zero_misses++;
+    }
+
+  if (zeroed_cnt < zeroed_high / 2 && !zeroer_wanted) 
+    {
+      zeroer_wanted = true;
+      sema_up (&zeroer_sema);
+    }
+  return page_idx;
+}
+
+/* Allocates PAGE_CNT pages from LENDER on behalf of the other
+   pool, unless that would leave LENDER with fewer than its
+   reserve of free pages.  Returns the index of the first page,
+   or SIZE_MAX on failure.  LENDER's lock must be held. */
+static size_t
+borrow_pages (struct pool *lender, size_t page_cnt) 
+{
+  size_t page_idx;
+
+  if (lender->free_cnt < lender->reserve + page_cnt)
+    return SIZE_MAX;
+  page_idx = alloc_pages (lender, page_cnt);
+  if (page_idx != SIZE_MAX) 
+    {
+      lender->lent += page_cnt;
+      lender->lends++;
+    }
+  return page_idx;
+}
+
+/* Obtains and returns a group of PAGE_CNT contiguous free pages.
+   If PAL_USER is set, the pages are obtained from the user pool,
+   otherwise from the kernel pool.  If PAL_ZERO is set in FLAGS,
+   then the pages are filled with zeros.  If too few pages are
+   available, returns a null pointer, unless PAL_ASSERT is set in
+   FLAGS, in which case the kernel panics.  The pages are charged
+   to the tag given by PAL_TAG in FLAGS.
+
+   The pages may come from the other pool, if the requested pool
+   is short of them. */
+void *
+palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
+{
+  return get_pages (flags, page_cnt, MEM_CALLER);
+}
+
 /* Obtains a single free page and returns its kernel virtual
    address.
    If PAL_USER is set, the page is obtained from the user pool,
@@ -117,7 +314,7 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
 void *
 palloc_get_page (enum palloc_flags flags) 
 {
-  return palloc_get_multiple (flags, 1);
+  return get_pages (flags, 1, MEM_CALLER);
 }
 
 /* Frees the PAGE_CNT pages starting at PAGES. */
@@ -125,7 +322,8 @@ void
 palloc_free_multiple (void *pages, size_t page_cnt) 
 {
   struct pool *pool;
-  size_t page_idx;
+  size_t page_idx, i;
+  enum mem_tag tag;
 
   ASSERT (pg_ofs (pages) == 0);
   if (pages == NULL || page_cnt == 0)
@@ -139,13 +337,25 @@ palloc_free_multiple (void *pages, size_t page_cnt)
     NOT_REACHED ();
 
   page_idx = pg_no (pages) - pg_no (pool->base);
+  ASSERT (page_idx + page_cnt <= pool->page_cnt);
 
 #ifndef NDEBUG
   memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
 
-  ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
-  bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+  lock_acquire (&pool->lock);
+  tag = pool->state[page_idx] & PAGE_TAG;
+  if (pool->state[page_idx] & PAGE_LENT) 
+    {
+      pool->lent -= page_cnt;
+      pool->returns++;
+    }
+  if (pool->callers != NULL)
+    for (i = 0; i < page_cnt; i++)
+      pool->callers[page_idx + i] = NULL;
+  free_pages (pool, page_idx, page_cnt);
+  lock_release (&pool->lock);
+  memtag_pages (tag, -(int) page_cnt);
 }
 
 /* Frees the page at PAGE. */
@@ -155,25 +365,200 @@ palloc_free_page (void *page)
   palloc_free_multiple (page, 1);
 }
 
+/* Returns the number of pages in the user pool. */
+size_t
+palloc_user_page_cnt (void) 
+{
+  return user_pool.page_cnt;
+}
+
+/* Returns true if the kernel pool has fallen below its reserve
+   of free pages while some of its pages are lent to the user
+   pool, so that user pages borrowed from it should be evicted
+   first.  Only a hint: the pool's lock is not taken. */
+bool
+palloc_reclaim_wanted (void) 
+{
+  return (kernel_pool.free_cnt < kernel_pool.reserve
+          && kernel_pool.lent > 0);
+}
+
+/* Returns true if PAGE, an allocated page, was lent to the user
+   pool by the kernel pool. */
+bool
+palloc_page_lent (const void *page) 
+{
+  size_t page_idx;
+
+  if (!page_from_pool (&kernel_pool, (void *) page))
+    return false;
+  page_idx = pg_no (page) - pg_no (kernel_pool.base);
+  return (kernel_pool.state[page_idx] & (PAGE_USED | PAGE_LENT))
+         == (PAGE_USED | PAGE_LENT);
+}
+
+/* Frees PAGE, a page that the kernel pool lent to the user pool
+   and that was evicted to give it back, and counts it as
+   reclaimed. */
+void
+palloc_reclaim_page (void *page) 
+{
+  ASSERT (palloc_page_lent (page));
+
+  lock_acquire (&kernel_pool.lock);
+  kernel_pool.reclaims++;
+  lock_release (&kernel_pool.lock);
+  palloc_free_page (page);
+}
+
+/* Prints page allocator statistics. */
+void
+palloc_print_stats (void) 
+{
+  unsigned long long zero_allocs = zero_hits + zero_misses;
+
+  print_pool_stats (&kernel_pool, "kernel");
+  print_pool_stats (&user_pool, "user");
+  printf ("Palloc: user pool %zu of %zu pages pre-zeroed; zeroed allocations "
+          "%llu from reserve, %llu cleared on demand (%llu%% hit)\n",
+          zeroed_cnt, zeroed_high, zero_hits, zero_misses,
+          zero_allocs > 0 ? zero_hits * 100 / zero_allocs : 0);
+}
+
+/* Fills in the pool sizes in MS. */
+void
+palloc_get_stats (struct memstat *ms) 
+{
+  ms->kernel_pages = kernel_pool.page_cnt;
+  ms->kernel_free = kernel_pool.free_cnt;
+  ms->user_pages = user_pool.page_cnt;
+  ms->kernel_lent = kernel_pool.lent;
+  ms->kernel_largest = largest_pages (&kernel_pool);
+  ms->user_free = user_pool.free_cnt + zeroed_cnt;
+  ms->user_lent = user_pool.lent;
+  ms->user_largest = largest_pages (&user_pool);
+  ms->user_zeroed = zeroed_cnt;
+  ms->zero_hits = zero_hits;
+  ms->zero_misses = zero_misses;
+}
+
+/* Starts the zeroer thread, which keeps a reserve of pre-zeroed
+   user pages.  Must be called after thread_start(). */
+void
+palloc_zero_init (void) 
+{
+  zeroed_high = user_pool.page_cnt / 16;
+  if (zeroed_high > ZEROED_MAX)
+    zeroed_high = ZEROED_MAX;
+  if (zeroed_high == 0)
+    return;
+
+  sema_init (&zeroer_sema, 0);
+  zeroer_wanted = true;
+  thread_create ("zeroer", PRI_MIN, zeroer, NULL);
+}
+
+/* The zeroer thread.  Fills the zeroed reserve, a page at a
+   time, then sleeps until take_zeroed() wakes it. */
+static void
+zeroer (void *aux UNUSED) 
+{
+  for (;;) 
+    {
+      size_t page_idx = SIZE_MAX;
+
+      lock_acquire (&user_pool.lock);
+      if (zeroed_cnt < zeroed_high && user_pool.free_cnt > zeroed_high)
+        page_idx = alloc_pages (&user_pool, 1);
+      if (page_idx == SIZE_MAX)
+        zeroer_wanted = false;
+      lock_release (&user_pool.lock);
+
+      if (page_idx == SIZE_MAX) 
+        {
+          sema_down (&zeroer_sema);
+          continue;
+        }
+
+      /* Clear the page without holding the lock, so that
+         allocations proceed meanwhile. */
+      clear_page (user_pool.base + PGSIZE * page_idx);
+
+      lock_acquire (&user_pool.lock);
+      zeroed[zeroed_cnt++] = page_idx;
+      lock_release (&user_pool.lock);
+    }
+}
+
+/* Passes each live allocation to memtag_note_live().  Does
+   nothing unless -memdebug is in effect. */
+void
+palloc_note_live (void) 
+{
+  note_pool_live (&kernel_pool);
+  note_pool_live (&user_pool);
+}
+
 /* Initializes pool P as starting at START and ending at END,
    naming it NAME for debugging purposes. */
 static void
 init_pool (struct pool *p, void *base, size_t page_cnt, const char *name) 
 {
-  /* We'll put the pool's used_map at its base.
-     Calculate the space needed for the bitmap
-     and subtract it from the pool's size. */
-  size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (page_cnt), PGSIZE);
-  if (bm_pages > page_cnt)
-    PANIC ("Not enough memory in %s for bitmap.", name);
-  page_cnt -= bm_pages;
+  /* We'll put the pool's state array, and its callers array
+     under -memdebug, at its base.  Calculate the space needed
+     for the arrays and subtract it from the pool's size. */
+  size_t state_size = ROUND_UP (page_cnt, sizeof (void *));
+  size_t meta_pages = DIV_ROUND_UP (state_size + (memdebug
+                                                  ? page_cnt * sizeof (void *)
+                                                  : 0), PGSIZE);
 
-  printf ("%zu pages available in %s.\n", page_cnt, name);
+  size_t first_page, i;
+  int order;
+
+  if (meta_pages > page_cnt)
+    PANIC ("Not enough memory in %s for page state.", name);
+  page_cnt -= meta_pages;
 
   /* Initialize the pool. */
   lock_init (&p->lock);
-  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_pages * PGSIZE);
-  p->base = base + bm_pages * PGSIZE;
+  p->state = base;
+  memset (p->state, PAGE_USED, page_cnt);
+  p->callers = NULL;
+  if (memdebug) 
+    {
+      p->callers = (void **) ((uint8_t *) base + state_size);
+      memset (p->callers, 0, page_cnt * sizeof (void *));
+    }
+  p->base = base + meta_pages * PGSIZE;
+  p->page_cnt = page_cnt;
+  p->free_cnt = 0;
+  for (order = 0; order <= PALLOC_MAX_ORDER; order++) 
+    {
+      list_init (&p->free[order]);
+      p->block_cnt[order] = 0;
+    }
+  p->reserve = page_cnt >> RESERVE_SHIFT;
+  p->lent = 0;
+  p->failures = 0;
+  p->lends = p->returns = p->reclaims = 0;
+
+  /* Free every usable page, as the largest aligned blocks that
+     fit.  Pages in holes in the memory map stay allocated. */
+  first_page = vtop (p->base) >> PGBITS;
+  for (i = 0; i < ram_range_cnt; i++) 
+    {
+      size_t start = ram_ranges[i].start;
+      size_t end = ram_ranges[i].end;
+
+      if (start < first_page)
+        start = first_page;
+      if (end > first_page + page_cnt)
+        end = first_page + page_cnt;
+      if (start < end)
+        free_pages (p, start - first_page, end - start);
+    }
+
+  printf ("%zu pages available in %s.\n", p->free_cnt, name);
 }
 
 /* Returns true if PAGE was allocated from POOL,
@@ -183,7 +568,268 @@ page_from_pool (const struct pool *pool, void *page)
 {
   size_t page_no = pg_no (page);
   size_t start_page = pg_no (pool->base);
-  size_t end_page = start_page + bitmap_size (pool->used_map);
+  size_t end_page = start_page + pool->page_cnt;
 
   return page_no >= start_page && page_no < end_page;
 }
+
+/* Returns the free list element stored in POOL's page at
+   PAGE_IDX. */
+static inline struct list_elem *
+page_elem (const struct pool *pool, size_t page_idx) 
+{
+  return (struct list_elem *) (pool->base + page_idx * PGSIZE);
+}
+
+/* Returns the index in POOL of the page that holds ELEM. */
+static inline size_t
+elem_page (const struct pool *pool, const struct list_elem *elem) 
+{
+  return pg_no (elem) - pg_no (pool->base);
+}
+
+/* Returns the largest order, up to PALLOC_MAX_ORDER, of a block
+   that may start at POOL's page PAGE_IDX and that has no more
+   than PAGE_CNT pages.  PAGE_CNT must be nonzero. */
+static int
+max_order (const struct pool *pool, size_t page_idx, size_t page_cnt) 
+{
+  size_t pfn = pg_no (pool->base) + page_idx;
+  int order = 0;
+
+  while (order < PALLOC_MAX_ORDER
+         && (pfn & (((size_t) 2 << order) - 1)) == 0
+         && ((size_t) 2 << order) <= page_cnt)
+    order++;
+  return order;
+}
+
+/* Adds the block of 2**ORDER pages at POOL's page PAGE_IDX to
+   the free list for ORDER, without merging it. */
+static void
+push_block (struct pool *pool, size_t page_idx, int order) 
+{
+  pool->state[page_idx] = PAGE_FREE | order;
+  list_push_front (&pool->free[order], page_elem (pool, page_idx));
+  pool->block_cnt[order]++;
+}
+
+/* Removes the free block of 2**ORDER pages at POOL's page
+   PAGE_IDX from its free list. */
+static void
+pop_block (struct pool *pool, size_t page_idx, int order) 
+{
+  ASSERT (pool->state[page_idx] == (PAGE_FREE | order));
+
+  pool->state[page_idx] = 0;
+  list_remove (page_elem (pool, page_idx));
+  pool->block_cnt[order]--;
+}
+
+/* Allocates PAGE_CNT contiguous pages from POOL.  Returns the
+   index of the first page, or SIZE_MAX if no run of free pages
+   is large enough.  POOL's lock must be held. */
+static size_t
+alloc_pages (struct pool *pool, size_t page_cnt) 
+{
+  size_t page_idx, i;
+  int order, want;
+
+  for (want = 0; ((size_t) 1 << want) < page_cnt; want++)
+    if (want == PALLOC_MAX_ORDER)
+      return alloc_huge (pool, page_cnt);
+
+  /* Take the smallest block that is big enough. */
+  for (order = want; order <= PALLOC_MAX_ORDER; order++)
+    if (!list_empty (&pool->free[order]))
+      break;
+  if (order > PALLOC_MAX_ORDER)
+    return SIZE_MAX;
+  page_idx = elem_page (pool, list_front (&pool->free[order]));
+  pop_block (pool, page_idx, order);
+
+  /* Split it down to the size wanted, freeing the upper
+     halves. */
+  while (order > want) 
+    {
+      order--;
+      push_block (pool, page_idx + ((size_t) 1 << order), order);
+    }
+
+  /* Mark the pages used and return any unused tail. */
+  for (i = 0; i < ((size_t) 1 << want); i++)
+    pool->state[page_idx + i] = PAGE_USED;
+  pool->free_cnt -= (size_t) 1 << want;
+  if (page_cnt < ((size_t) 1 << want)) 
+    free_pages (pool, page_idx + page_cnt, ((size_t) 1 << want) - page_cnt);
+  return page_idx;
+}
+
+/* Allocates PAGE_CNT contiguous pages from POOL, where PAGE_CNT
+   is more than the largest block.  Looks for a run of adjacent
+   free blocks of the largest order, which takes time linear in
+   the size of the pool.  Returns the index of the first page,
+   or SIZE_MAX on failure.  POOL's lock must be held. */
+static size_t
+alloc_huge (struct pool *pool, size_t page_cnt) 
+{
+  const size_t block = (size_t) 1 << PALLOC_MAX_ORDER;
+  size_t start, run, i;
+
+  start = ROUND_UP (pg_no (pool->base), block) - pg_no (pool->base);
+  for (run = 0; start + run + block <= pool->page_cnt; ) 
+    {
+      if (pool->state[start + run] != (PAGE_FREE | PALLOC_MAX_ORDER)) 
+        {
+          start += run + block;
+          run = 0;
+          continue;
+        }
+      run += block;
+      if (run >= page_cnt)
+        break;
+    }
+  if (run < page_cnt)
+    return SIZE_MAX;
+
+  for (i = 0; i < run; i += block)
+    pop_block (pool, start + i, PALLOC_MAX_ORDER);
+  for (i = 0; i < run; i++)
+    pool->state[start + i] = PAGE_USED;
+  pool->free_cnt -= run;
+  if (page_cnt < run)
+    free_pages (pool, start + page_cnt, run - page_cnt);
+  return start;
+}
+
+/* Frees the PAGE_CNT pages starting at POOL's page PAGE_IDX, as
+   the largest aligned blocks that fit, merging each one with
+   its buddies.  POOL's lock must be held. */
+static void
+free_pages (struct pool *pool, size_t page_idx, size_t page_cnt) 
+{
+  size_t i;
+
+  for (i = 0; i < page_cnt; i++) 
+    {
+      ASSERT ((pool->state[page_idx + i] & ~(PAGE_LENT | PAGE_TAG))
+              == PAGE_USED);
+      pool->state[page_idx + i] = 0;
+    }
+  pool->free_cnt += page_cnt;
+
+  while (page_cnt > 0) 
+    {
+      int order = max_order (pool, page_idx, page_cnt);
+      free_block (pool, page_idx, order);
+      page_idx += (size_t) 1 << order;
+      page_cnt -= (size_t) 1 << order;
+    }
+}
+
+/* Frees the block of 2**ORDER pages at POOL's page PAGE_IDX,
+   whose pages must already be marked free, merging it with its
+   buddy for as long as the buddy is free too. */
+static void
+free_block (struct pool *pool, size_t page_idx, int order) 
+{
+  size_t base_pfn = pg_no (pool->base);
+
+  while (order < PALLOC_MAX_ORDER) 
+    {
+      size_t buddy_pfn = (base_pfn + page_idx) ^ ((size_t) 1 << order);
+      size_t buddy_idx = buddy_pfn - base_pfn;
+
+      if (buddy_pfn < base_pfn || buddy_idx >= pool->page_cnt
+          || pool->state[buddy_idx] != (PAGE_FREE | order))
+        break;
+      pop_block (pool, buddy_idx, order);
+      if (buddy_idx < page_idx)
+        page_idx = buddy_idx;
+      order++;
+    }
+  push_block (pool, page_idx, order);
+}
+
+/* Returns the order of POOL's largest free block, or -1 if
+   POOL has no free pages. */
+static int
+largest_order (const struct pool *pool) 
+{
+  int order;
+
+  for (order = PALLOC_MAX_ORDER; order >= 0; order--)
+    if (pool->block_cnt[order] > 0)
+      break;
+  return order;
+}
+
+/* Returns the number of pages in POOL's largest free block. */
+static size_t
+largest_pages (const struct pool *pool) 
+{
+  int order = largest_order (pool);
+
+  return order >= 0 ? (size_t) 1 << order : 0;
+}
+
+/* Prints statistics for POOL, naming it NAME. */
+static void
+print_pool_stats (const struct pool *pool, const char *name) 
+{
+  size_t largest = 0, in_largest = 0, fragmented = 0;
+  int order = largest_order (pool);
+
+  if (order >= 0) 
+    {
+      largest = (size_t) 1 << order;
+      in_largest = largest * pool->block_cnt[order];
+    }
+
+  /* Fragmentation is the share of free pages that are not in
+     blocks of the largest free size, in percent. */
+  if (pool->free_cnt > 0)
+    fragmented = 100 - in_largest * 100 / pool->free_cnt;
+  printf ("Palloc: %s pool %zu of %zu pages free, largest block %zu pages, "
+          "%zu%% fragmented, %llu failures\n",
+          name, pool->free_cnt, pool->page_cnt, largest, fragmented,
+          pool->failures);
+  printf ("Palloc: %s pool %zu pages lent to other pool, "
+          "%llu allocations lent, %llu returned, %llu reclaimed\n",
+          name, pool->lent, pool->lends, pool->returns, pool->reclaims);
+  printf ("Palloc: %s pool free blocks by order:", name);
+  for (order = 0; order <= PALLOC_MAX_ORDER; order++)
+    printf (" %zu", pool->block_cnt[order]);
+  printf ("\n");
+}
+
+/* Passes each live allocation in POOL that has a recorded
+   caller to memtag_note_live(). */
+static void
+note_pool_live (struct pool *pool) 
+{
+  size_t i;
+
+  if (pool->callers == NULL)
+    return;
+
+  lock_acquire (&pool->lock);
+  for (i = 0; i < pool->page_cnt; ) 
+    {
+      uint8_t state = pool->state[i];
+      void *caller = pool->callers[i];
+      size_t cnt = 1;
+
+      if (!(state & PAGE_USED) || caller == NULL) 
+        {
+          i++;
+          continue;
+        }
+      while (i + cnt < pool->page_cnt && pool->state[i + cnt] == state
+             && pool->callers[i + cnt] == NULL)
+        cnt++;
+      memtag_note_live (caller, state & PAGE_TAG, cnt * PGSIZE);
+      i += cnt;
+    }
+  lock_release (&pool->lock);
+}
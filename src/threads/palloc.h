@@ -1,6 +1,8 @@
 #ifndef THREADS_PALLOC_H
 #define THREADS_PALLOC_H
 
+#include <memstat.h>
+#include <stdbool.h>
 #include <stddef.h>
 
 /* How to allocate pages. */
@@ -11,13 +13,31 @@ enum palloc_flags
     PAL_USER = 004              /* User page. */
   };
 
+/* Charges an allocation to TAG, an enum mem_tag, when OR'd into
+   the flags, e.g. PAL_ZERO | PAL_TAG (MEM_THREAD). */
+#define PAL_TAG_SHIFT 8
+#define PAL_TAG(TAG) ((TAG) << PAL_TAG_SHIFT)
+
+/* Largest block the page allocator manages internally, as a
+   power of 2 pages: 2**10 pages is 4 MB.  Larger requests still
+   succeed, but take time linear in the size of the pool. */
+#define PALLOC_MAX_ORDER 10
+
 /* Maximum number of pages to put in user pool. */
 extern size_t user_page_limit;
 
-void palloc_init (void);
+void palloc_init (void *free_start);
+void palloc_zero_init (void);
 void *palloc_get_page (enum palloc_flags);
 void *palloc_get_multiple (enum palloc_flags, size_t page_cnt);
 void palloc_free_page (void *);
 void palloc_free_multiple (void *, size_t page_cnt);
+bool palloc_reclaim_wanted (void);
+bool palloc_page_lent (const void *);
+void palloc_reclaim_page (void *);
+size_t palloc_user_page_cnt (void);
+void palloc_print_stats (void);
+void palloc_get_stats (struct memstat *);
+void palloc_note_live (void);
 
 #endif /* threads/palloc.h */
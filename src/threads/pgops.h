@@ -0,0 +1,40 @@
+#ifndef THREADS_PGOPS_H
+#define THREADS_PGOPS_H
+
+#include <debug.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "threads/vaddr.h"
+
+/* Whole-page operations.
+
+   These move a page with a single string instruction, without
+   the alignment and size checks of memcpy() and memset(), for
+   the kernel's page-at-a-time paths: zeroing new pages, loading
+   zero-fill pages, and copying page directories. */
+
+/* Sets the page at PAGE, which must be page-aligned, to zeros. */
+static inline void
+clear_page (void *page) 
+{
+  size_t cnt = PGSIZE / sizeof (uint32_t);
+
+  ASSERT (pg_ofs (page) == 0);
+  asm volatile ("rep stosl"
+                : "+D" (page), "+c" (cnt) : "a" (0) : "memory");
+}
+
+/* Copies the page at SRC to the page at DST.  Both must be
+   page-aligned. */
+static inline void
+copy_page (void *dst, const void *src) 
+{
+  size_t cnt = PGSIZE / sizeof (uint32_t);
+
+  ASSERT (pg_ofs (dst) == 0);
+  ASSERT (pg_ofs (src) == 0);
+  asm volatile ("rep movsl"
+                : "+D" (dst), "+S" (src), "+c" (cnt) : : "memory");
+}
+
+#endif /* threads/pgops.h */
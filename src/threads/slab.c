@@ -0,0 +1,409 @@
+#include "threads/slab.h"
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/interrupt.h"
+#include "threads/memtag.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* Magic number for detecting slab corruption. */
+#define SLAB_MAGIC 0x51ab0b1e
+
+/* A slab: one page holding objects for a cache.  The header is
+   at the start of the page, followed by a stack of the indexes of
+   its free objects, followed by the objects themselves.  Keeping
+   the free stack outside the objects leaves constructed objects
+   intact while they are free. */
+struct slab 
+  {
+    unsigned magic;             /* Always set to SLAB_MAGIC. */
+    struct kmem_cache *cache;   /* Owning cache. */
+    struct list_elem elem;      /* In one of the cache's slab lists. */
+    size_t free_cnt;            /* Number of free objects. */
+    uint16_t free[];            /* Indexes of free objects. */
+  };
+
+/* Every cache, for kmem_print_stats(). */
+#define KMEM_CACHE_MAX 16
+static struct kmem_cache *caches[KMEM_CACHE_MAX];
+static int cache_cnt;
+
+static void *magazine_pop (struct kmem_cache *);
+static bool magazine_push (struct kmem_cache *, void *obj);
+static size_t slab_alloc_batch (struct kmem_cache *, void **objs, size_t cnt);
+static void slab_free_batch (struct kmem_cache *, void **objs, size_t cnt);
+static void **obj_caller (struct kmem_cache *, void *obj);
+
+/* Initializes C as a cache of objects of SIZE bytes each, named
+   NAME, whose objects are charged to TAG.  If CTOR is nonnull,
+   it is called on each object when the object's slab is created,
+   with C's lock held. */
+void
+kmem_cache_init (struct kmem_cache *c, const char *name, size_t size,
+                 kmem_ctor_func *ctor, enum mem_tag tag) 
+{
+  size_t n;
+
+  ASSERT (c != NULL);
+  ASSERT (size > 0);
+  ASSERT (cache_cnt < KMEM_CACHE_MAX);
+
+  c->name = name;
+  c->obj_size = ROUND_UP (size, sizeof (void *));
+  c->obj_stride = c->obj_size + (memdebug ? sizeof (void *) : 0);
+  c->ctor = ctor;
+  c->tag = tag;
+
+  /* Fit as many objects, and their free stack entries, as
+     possible into a page after the header. */
+  n = (PGSIZE - sizeof (struct slab)) / (c->obj_stride + sizeof (uint16_t));
+  while (n > 0
+         && (ROUND_UP (sizeof (struct slab) + n * sizeof (uint16_t),
+                       sizeof (void *))
+             + n * c->obj_stride) > PGSIZE)
+    n--;
+  ASSERT (n > 0);
+  c->objs_per_slab = n;
+  c->obj_ofs = ROUND_UP (sizeof (struct slab) + n * sizeof (uint16_t),
+                         sizeof (void *));
+
+  c->loaded.rounds = 0;
+  c->previous.rounds = 0;
+  lock_init (&c->lock);
+  list_init (&c->partial);
+  list_init (&c->full);
+  list_init (&c->empty);
+  c->slab_cnt = 0;
+  c->in_slabs = 0;
+  c->allocs = c->fast_allocs = 0;
+  c->frees = c->fast_frees = 0;
+
+  caches[cache_cnt++] = c;
+}
+
+/* Allocates and returns an object from C, in its constructed
+   state if C has a constructor.  Returns a null pointer if
+   memory is exhausted.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void *
+kmem_cache_alloc (struct kmem_cache *c) 
+{
+  return kmem_cache_alloc_caller (c, MEM_CALLER);
+}
+
+/* Like kmem_cache_alloc(), but records CALLER as the allocating
+   code under -memdebug, for use by wrappers around it. */
+void *
+kmem_cache_alloc_caller (struct kmem_cache *c, void *caller) 
+{
+  void *batch[KMEM_MAGAZINE_SIZE / 2];
+  enum intr_level old_level;
+  size_t cnt, i;
+  void *obj;
+
+  ASSERT (c != NULL);
+  ASSERT (!intr_context ());
+
+  /* Fast path. */
+  old_level = intr_disable ();
+  obj = magazine_pop (c);
+  if (obj != NULL) 
+    {
+      c->allocs++;
+      c->fast_allocs++;
+    }
+  intr_set_level (old_level);
+  if (obj != NULL)
+    goto done;
+
+  /* Both magazines are empty.  Take a batch from the slabs,
+     keeping one object and loading the rest. */
+  lock_acquire (&c->lock);
+  cnt = slab_alloc_batch (c, batch, sizeof batch / sizeof *batch);
+  lock_release (&c->lock);
+  if (cnt == 0)
+    return NULL;
+
+  old_level = intr_disable ();
+  obj = batch[--cnt];
+  c->allocs++;
+  for (i = 0; i < cnt; i++)
+    if (!magazine_push (c, batch[i]))
+      break;
+  intr_set_level (old_level);
+
+  /* Another thread may have filled the magazines meanwhile. */
+  if (i < cnt) 
+    {
+      lock_acquire (&c->lock);
+      slab_free_batch (c, batch + i, cnt - i);
+      lock_release (&c->lock);
+    }
+
+ done:
+  memtag_bytes (c->tag, c->obj_size);
+  if (memdebug)
+    *obj_caller (c, obj) = caller;
+  return obj;
+}
+
+/* Frees OBJ, which must have been allocated from C and, if C has
+   a constructor, must be back in its constructed state.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+kmem_cache_free (struct kmem_cache *c, void *obj) 
+{
+  void *batch[KMEM_MAGAZINE_SIZE];
+  enum intr_level old_level;
+  size_t cnt;
+
+  ASSERT (c != NULL);
+  ASSERT (!intr_context ());
+
+  if (obj == NULL)
+    return;
+
+  memtag_bytes (c->tag, -(int) c->obj_size);
+  if (memdebug)
+    *obj_caller (c, obj) = NULL;
+
+  /* Fast path. */
+  old_level = intr_disable ();
+  c->frees++;
+  if (magazine_push (c, obj)) 
+    {
+      c->fast_frees++;
+      intr_set_level (old_level);
+      return;
+    }
+
+  /* Both magazines are full.  Empty the spare one, then swap it
+     in for OBJ, and return its objects to the slabs. */
+  cnt = c->previous.rounds;
+  memcpy (batch, c->previous.objs, cnt * sizeof *batch);
+  c->previous.rounds = 0;
+  if (!magazine_push (c, obj))
+    NOT_REACHED ();
+  intr_set_level (old_level);
+
+  lock_acquire (&c->lock);
+  slab_free_batch (c, batch, cnt);
+  lock_release (&c->lock);
+}
+
+/* Prints statistics for every cache. */
+void
+kmem_print_stats (void) 
+{
+  int i;
+
+  for (i = 0; i < cache_cnt; i++) 
+    {
+      struct kmem_cache *c = caches[i];
+      size_t live = c->in_slabs - c->loaded.rounds - c->previous.rounds;
+
+      printf ("Kmem: %s: %zu of %zu %zu-byte objects in use, %zu slabs; "
+              "%llu allocs (%llu fast), %llu frees (%llu fast)\n",
+              c->name, live, c->slab_cnt * c->objs_per_slab, c->obj_size,
+              c->slab_cnt, c->allocs, c->fast_allocs,
+              c->frees, c->fast_frees);
+    }
+}
+
+/* Passes each object allocated from any cache to
+   memtag_note_live().  Does nothing unless -memdebug is in
+   effect. */
+void
+kmem_note_live (void) 
+{
+  int i;
+
+  if (!memdebug)
+    return;
+
+  for (i = 0; i < cache_cnt; i++) 
+    {
+      struct kmem_cache *c = caches[i];
+      struct list *lists[2] = {&c->partial, &c->full};
+      int j;
+
+      lock_acquire (&c->lock);
+      for (j = 0; j < 2; j++) 
+        {
+          struct list_elem *e;
+
+          for (e = list_begin (lists[j]); e != list_end (lists[j]);
+               e = list_next (e)) 
+            {
+              struct slab *s = list_entry (e, struct slab, elem);
+              size_t k;
+
+              for (k = 0; k < c->objs_per_slab; k++) 
+                {
+                  void *obj = (uint8_t *) s + c->obj_ofs + k * c->obj_stride;
+                  void *caller = *obj_caller (c, obj);
+
+                  if (caller != NULL)
+                    memtag_note_live (caller, c->tag, c->obj_size);
+                }
+            }
+        }
+      lock_release (&c->lock);
+    }
+}
+
+/* Returns the -memdebug caller slot that follows OBJ in C. */
+static void **
+obj_caller (struct kmem_cache *c, void *obj) 
+{
+  ASSERT (memdebug);
+  return (void **) ((uint8_t *) obj + c->obj_size);
+}
+
+/* Removes and returns an object from C's magazines, or returns
+   a null pointer if both are empty.  Interrupts must be off. */
+static void *
+magazine_pop (struct kmem_cache *c) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (c->loaded.rounds == 0) 
+    {
+      struct kmem_magazine tmp;
+
+      if (c->previous.rounds == 0)
+        return NULL;
+      tmp = c->loaded;
+      c->loaded = c->previous;
+      c->previous = tmp;
+    }
+  return c->loaded.objs[--c->loaded.rounds];
+}
+
+/* Adds OBJ to C's magazines.  Returns false if both are full.
+   Interrupts must be off. */
+static bool
+magazine_push (struct kmem_cache *c, void *obj) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (c->loaded.rounds == KMEM_MAGAZINE_SIZE) 
+    {
+      struct kmem_magazine tmp;
+
+      if (c->previous.rounds != 0)
+        return false;
+      tmp = c->loaded;
+      c->loaded = c->previous;
+      c->previous = tmp;
+    }
+  c->loaded.objs[c->loaded.rounds++] = obj;
+  return true;
+}
+
+/* Returns a new, empty slab for C, with every object
+   constructed, or a null pointer if memory is exhausted.  C's
+   lock must be held. */
+static struct slab *
+slab_create (struct kmem_cache *c) 
+{
+  struct slab *s;
+  size_t i;
+
+  s = palloc_get_page (PAL_TAG (MEM_SLAB));
+  if (s == NULL)
+    return NULL;
+  s->magic = SLAB_MAGIC;
+  s->cache = c;
+  s->free_cnt = c->objs_per_slab;
+  for (i = 0; i < c->objs_per_slab; i++) 
+    {
+      void *obj = (uint8_t *) s + c->obj_ofs + i * c->obj_stride;
+
+      /* Hand out objects in address order. */
+      s->free[i] = c->objs_per_slab - 1 - i;
+      if (c->ctor != NULL)
+        c->ctor (obj);
+      if (memdebug)
+        *obj_caller (c, obj) = NULL;
+    }
+  c->slab_cnt++;
+  return s;
+}
+
+/* Takes up to CNT objects from C's slabs, creating a slab if
+   needed, and stores them in OBJS.  Returns the number taken,
+   which is less than CNT only if memory is exhausted.  C's lock
+   must be held. */
+static size_t
+slab_alloc_batch (struct kmem_cache *c, void **objs, size_t cnt) 
+{
+  size_t taken = 0;
+
+  while (taken < cnt) 
+    {
+      struct slab *s;
+
+      if (!list_empty (&c->partial))
+        s = list_entry (list_pop_front (&c->partial), struct slab, elem);
+      else if (!list_empty (&c->empty))
+        s = list_entry (list_pop_front (&c->empty), struct slab, elem);
+      else 
+        {
+          s = slab_create (c);
+          if (s == NULL)
+            break;
+        }
+
+      while (taken < cnt && s->free_cnt > 0) 
+        {
+          uint16_t idx = s->free[--s->free_cnt];
+          objs[taken++] = (uint8_t *) s + c->obj_ofs + idx * c->obj_stride;
+          c->in_slabs++;
+        }
+      list_push_front (s->free_cnt > 0 ? &c->partial : &c->full, &s->elem);
+    }
+  return taken;
+}
+
+/* Returns the CNT objects in OBJS to their slabs in C.  A slab
+   that becomes empty is kept if it is C's only empty slab, and
+   otherwise given back to the page allocator.  C's lock must be
+   held. */
+static void
+slab_free_batch (struct kmem_cache *c, void **objs, size_t cnt) 
+{
+  size_t i;
+
+  for (i = 0; i < cnt; i++) 
+    {
+      struct slab *s = pg_round_down (objs[i]);
+      size_t ofs = (uint8_t *) objs[i] - (uint8_t *) s - c->obj_ofs;
+
+      ASSERT (s->magic == SLAB_MAGIC);
+      ASSERT (s->cache == c);
+      ASSERT (ofs % c->obj_stride == 0);
+      ASSERT (s->free_cnt < c->objs_per_slab);
+
+      s->free[s->free_cnt++] = ofs / c->obj_stride;
+      c->in_slabs--;
+      list_remove (&s->elem);
+      if (s->free_cnt < c->objs_per_slab)
+        list_push_front (&c->partial, &s->elem);
+      else if (list_empty (&c->empty))
+        list_push_front (&c->empty, &s->elem);
+      else 
+        {
+          s->magic = 0;
+          c->slab_cnt--;
+          palloc_free_page (s);
+        }
+    }
+}
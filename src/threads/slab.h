@@ -0,0 +1,82 @@
+#ifndef THREADS_SLAB_H
+#define THREADS_SLAB_H
+
+#include <list.h>
+#include <memstat.h>
+#include <stddef.h>
+#include "threads/synch.h"
+
+/* Object caches.
+
+   An object cache hands out objects of a single, exact size,
+   carved from "slabs" of one page each, so that small fixed-size
+   kernel objects do not pay for malloc()'s rounding up to a power
+   of 2.  An optional constructor puts each object into a known
+   state once, when its slab is created, rather than on every
+   allocation; in return, an object must be back in that state
+   when it is freed.
+
+   Each cache keeps two "magazines" of recently freed objects in
+   front of its slabs.  Allocating from or freeing to a magazine
+   takes only a brief interrupts-off section, the per-CPU
+   exclusion of this kernel, rather than the cache's lock.  The
+   lock is taken only to move objects between the magazines and
+   the slabs, a batch at a time.
+
+   Objects are charged to the cache's tag for allocation
+   accounting.  Under -memdebug, each object is followed in its
+   slab by a pointer to the code that allocated it, null while
+   the object is free. */
+
+/* Number of objects a magazine holds. */
+#define KMEM_MAGAZINE_SIZE 16
+
+/* Puts an object into its constructed state. */
+typedef void kmem_ctor_func (void *obj);
+
+/* A magazine of free, constructed objects. */
+struct kmem_magazine 
+  {
+    int rounds;                         /* Number of objects. */
+    void *objs[KMEM_MAGAZINE_SIZE];     /* The objects. */
+  };
+
+/* An object cache. */
+struct kmem_cache 
+  {
+    const char *name;           /* Name, for statistics. */
+    size_t obj_size;            /* Object size, rounded to a word. */
+    size_t obj_stride;          /* Distance between objects in a slab. */
+    size_t objs_per_slab;       /* Objects in each slab. */
+    size_t obj_ofs;             /* Offset of first object in a slab. */
+    kmem_ctor_func *ctor;       /* Constructor, or null. */
+    enum mem_tag tag;           /* Tag charged for objects. */
+
+    /* Accessed with interrupts off. */
+    struct kmem_magazine loaded;    /* Magazine in use. */
+    struct kmem_magazine previous;  /* Full or empty spare. */
+
+    /* Protected by `lock'. */
+    struct lock lock;
+    struct list partial;        /* Slabs with some objects free. */
+    struct list full;           /* Slabs with no objects free. */
+    struct list empty;          /* Slabs with every object free. */
+    size_t slab_cnt;            /* Number of slabs. */
+    size_t in_slabs;            /* Objects handed out by slabs. */
+
+    /* Statistics. */
+    unsigned long long allocs;      /* Successful allocations. */
+    unsigned long long fast_allocs; /* ...of which from a magazine. */
+    unsigned long long frees;       /* Frees. */
+    unsigned long long fast_frees;  /* ...of which to a magazine. */
+  };
+
+void kmem_cache_init (struct kmem_cache *, const char *name, size_t size,
+                      kmem_ctor_func *, enum mem_tag);
+void *kmem_cache_alloc (struct kmem_cache *);
+void *kmem_cache_alloc_caller (struct kmem_cache *, void *caller);
+void kmem_cache_free (struct kmem_cache *, void *);
+void kmem_print_stats (void);
+void kmem_note_live (void);
+
+#endif /* threads/slab.h */
@@ -0,0 +1,449 @@
+#include "threads/smp.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/lapic.h"
+#include "devices/timer.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/loader.h"
+#include "threads/palloc.h"
+#include "threads/pte.h"
+#include "threads/spinlock.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#ifdef USERPROG
+#include "userprog/gdt.h"
+#endif
+
+/* Multiprocessor bring-up.
+
+   The BIOS describes the processors in the machine with the
+   tables of the Intel MultiProcessor Specification [MP].  We
+   find them, then start each application processor (AP) with
+   the INIT-SIPI-SIPI sequence.  An AP starts in real mode in
+   threads/mpentry.S, which switches to protected mode with the
+   kernel's page directory and calls ap_main().
+
+   Every processor then runs threads.  The kernel relies on
+   turning interrupts off for mutual exclusion, so turning them
+   off also takes the interrupts-off lock (see interrupt.c),
+   which makes every such critical section exclude the other
+   processors too.  Threads that run with interrupts on,
+   including user programs, run in parallel.
+
+   Each processor has its own running thread, idle thread and
+   run queue in struct cpu (see thread.c).  A processor that
+   picks its next thread takes the highest-priority ready thread
+   from any queue, preferring its own, so a processor that would
+   otherwise go idle steals work from the others.  A thread that
+   becomes ready on a processor that cannot run it at once sends
+   a reschedule IPI to the processor running the lowest-priority
+   thread, if that one is lower than the new thread's.
+
+   The bootstrap processor (BSP) keeps the PIT, which drives
+   timer_ticks(), and the local APIC one-shot timer, which
+   drives the high-resolution timers.  Each application
+   processor (AP) takes its scheduler ticks from its own local
+   APIC timer.
+
+   A processor that changes a mapping flushes it from its own
+   TLB, then calls smp_flush_tlb() to have every other processor
+   that may be using it flush its TLB too, and waits until they
+   have. */
+
+/* MP floating pointer structure.  See [MP] 4.1. */
+struct mp_fp 
+  {
+    char signature[4];          /* "_MP_". */
+    uint32_t config;            /* Physical address of config table. */
+    uint8_t length;             /* In 16-byte units. */
+    uint8_t revision;
+    uint8_t checksum;           /* Sums to 0. */
+    uint8_t type;               /* Default configuration, if nonzero. */
+    uint8_t features[4];
+  } __attribute__ ((packed));
+
+/* MP configuration table header.  See [MP] 4.2. */
+struct mp_config 
+  {
+    char signature[4];          /* "PCMP". */
+    uint16_t length;            /* Including header. */
+    uint8_t revision;
+    uint8_t checksum;           /* Sums to 0. */
+    char oem_id[20];
+    uint32_t oem_table;
+    uint16_t oem_length;
+    uint16_t entry_cnt;         /* Number of entries after header. */
+    uint32_t lapic_addr;        /* Physical address of local APICs. */
+    uint16_t ext_length;
+    uint8_t ext_checksum;
+    uint8_t reserved;
+  } __attribute__ ((packed));
+
+/* MP configuration table processor entry.  See [MP] 4.3.1. */
+struct mp_proc 
+  {
+    uint8_t type;               /* MP_PROC. */
+    uint8_t apic_id;
+    uint8_t apic_version;
+    uint8_t flags;              /* MP_PROC_* flags. */
+    uint32_t signature;
+    uint32_t features;
+    uint32_t reserved[2];
+  } __attribute__ ((packed));
+
+#define MP_PROC 0               /* Processor entry type. */
+#define MP_PROC_ENABLED 0x01    /* Processor is usable. */
+#define MP_PROC_BSP 0x02        /* Bootstrap processor. */
+
+/* Processors found in the MP configuration table.  The BSP is
+   always cpus[0], so that the thread system can use it before
+   smp_init(). */
+struct cpu cpus[CPU_MAX] = {{ .bsp = true, .started = true }};
+int cpu_cnt = 1;
+
+/* -smp: Start the application processors? */
+bool smp_enabled;
+
+/* Physical address of the local APICs, 0 if not found.  Only
+   used to tell whether find_cpus() succeeded: lapic_init()
+   takes the address from the processor itself. */
+static uintptr_t lapic_addr;
+
+/* Number of processors online, protected by online_lock. */
+static int online_cnt = 1;
+static struct spinlock online_lock = SPINLOCK_INITIALIZER;
+
+/* Trampoline in threads/mpentry.S. */
+extern const char mpentry_start[], mpentry_end[];
+extern uint32_t mpentry_cr3, mpentry_cr4, mpentry_stack;
+
+static bool find_cpus (void);
+static struct mp_fp *search_fp (uintptr_t paddr, size_t size);
+static uint8_t checksum (const void *, size_t);
+static bool start_ap (struct cpu *);
+static intr_handler_func lapic_timer_interrupt;
+static intr_handler_func resched_interrupt;
+static intr_handler_func tlb_interrupt;
+void ap_main (void) NO_RETURN;
+
+/* Starts every application processor listed by the BIOS and
+   waits for each one to come online.  Must be called after
+   timer_hires_init(), with interrupts on, before any user process
+   starts. */
+void
+smp_init (void) 
+{
+  uint32_t *pd = base_page_dir;
+  size_t size = mpentry_end - mpentry_start;
+  uint8_t *entry = ptov (LOADER_MPENTRY);
+  uint32_t cr4;
+  struct cpu *c;
+
+  ASSERT (intr_get_level () == INTR_ON);
+
+  if (!lapic_enabled ()) 
+    {
+      printf ("smp: no MP configuration, running on one CPU\n");
+      return;
+    }
+  cpus[0].apic_id = lapic_id ();
+  if (!find_cpus ()) 
+    {
+      printf ("smp: no MP configuration, running on one CPU\n");
+      return;
+    }
+  intr_register_int (LAPIC_TIMER_VEC, 0, INTR_OFF, lapic_timer_interrupt,
+                     "LAPIC timer");
+  intr_register_int (LAPIC_RESCHED_VEC, 0, INTR_OFF, resched_interrupt,
+                     "reschedule IPI");
+  intr_register_int (LAPIC_TLB_VEC, 0, INTR_OFF, tlb_interrupt,
+                     "TLB shootdown IPI");
+
+  /* The trampoline turns on paging while running at its physical
+     address, so temporarily map the bottom 4 MB of physical
+     memory at virtual address 0 too. */
+  ASSERT (pd[0] == 0);
+  pd[0] = pd[pd_no (PHYS_BASE)];
+  asm volatile ("movl %0, %%cr3" : : "r" (vtop (pd)) : "memory");
+
+  memcpy (entry, mpentry_start, size);
+  *(uint32_t *) (entry + ((char *) &mpentry_cr3 - mpentry_start)) = vtop (pd);
+  asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+  *(uint32_t *) (entry + ((char *) &mpentry_cr4 - mpentry_start)) = cr4;
+
+  for (c = cpus; c < cpus + cpu_cnt; c++)
+    if (!c->bsp && !start_ap (c))
+      printf ("smp: CPU %u did not start\n", c->apic_id);
+
+  /* Every page directory copies base_page_dir's kernel mappings,
+     so remove the identity mapping before any process exists. */
+  pd[0] = 0;
+  asm volatile ("movl %0, %%cr3" : : "r" (vtop (pd)) : "memory");
+
+  printf ("smp: %d of %d CPUs online\n", smp_online_cnt (), cpu_cnt);
+}
+
+/* Returns the running processor. */
+struct cpu *
+cpu_current (void) 
+{
+  unsigned id;
+  int i;
+
+  if (lapic_addr == 0)
+    return &cpus[0];
+
+  id = lapic_id ();
+  for (i = 0; i < cpu_cnt; i++)
+    if (cpus[i].apic_id == id)
+      return &cpus[i];
+  PANIC ("no CPU with local APIC ID %u", id);
+}
+
+/* Returns the number of processors online. */
+int
+smp_online_cnt (void) 
+{
+  return online_cnt;
+}
+
+/* Prints per-processor statistics. */
+void
+smp_print_stats (void) 
+{
+  int i;
+
+  if (!smp_enabled || lapic_addr == 0)
+    return;
+
+  printf ("SMP: %d of %d CPUs online\n", smp_online_cnt (), cpu_cnt);
+  for (i = 0; i < cpu_cnt; i++)
+    if (cpus[i].started)
+      printf ("  CPU %u: %lld local timer ticks, %lld steals, "
+              "%lld reschedule IPIs, %lld TLB shootdowns\n",
+              cpus[i].apic_id, cpus[i].ticks, cpus[i].steals,
+              cpus[i].resched_ipis, cpus[i].tlb_flushes);
+}
+
+/* Asks processor C, which must be running threads, to
+   reschedule.  Interrupts must be off. */
+void
+smp_resched (struct cpu *c) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (c->idle != NULL);
+
+  lapic_send_ipi (c->apic_id, LAPIC_RESCHED_VEC);
+}
+
+/* Makes every other processor that runs threads flush its TLB,
+   if it may be using page directory PD, or in any case if PD is
+   null, as after a change to the kernel's own mappings, and
+   waits until each one has.  The caller flushes its own TLB. */
+void
+smp_flush_tlb (const uint32_t *pd) 
+{
+  struct cpu *self, *c;
+  enum intr_level old_level;
+
+  if (online_cnt == 1)
+    return;
+
+  old_level = intr_disable ();
+  self = thread_cpu ();
+  for (c = cpus; c < cpus + cpu_cnt; c++)
+    if (c != self && c->idle != NULL && (pd == NULL || c->pagedir == pd)) 
+      {
+        c->tlb_flush = true;
+        lapic_send_ipi (c->apic_id, LAPIC_TLB_VEC);
+      }
+
+  /* Each processor flushes in its IPI handler, or while it waits
+     for the interrupts-off lock that we hold. */
+  for (c = cpus; c < cpus + cpu_cnt; c++)
+    while (c->tlb_flush)
+      asm volatile ("pause");
+  intr_set_level (old_level);
+}
+
+/* Flushes the running processor's TLB if another processor
+   asked it to.  Called with interrupts off, but possibly without
+   the interrupts-off lock. */
+void
+smp_tlb_poll (void) 
+{
+  struct cpu *c = thread_cpu ();
+
+  if (c->tlb_flush) 
+    {
+      uint32_t cr3;
+
+      asm volatile ("movl %%cr3, %0; movl %0, %%cr3" : "=r" (cr3) : : "memory");
+      c->tlb_flushes++;
+      c->tlb_flush = false;
+    }
+}
+
+/* Starts application processor C on a new kernel stack and waits
+   up to 100 ms for it to reach ap_main().  Returns true if
+   successful. */
+static bool
+start_ap (struct cpu *c) 
+{
+  uint8_t *entry = ptov (LOADER_MPENTRY);
+  int i;
+
+  c->stack = palloc_get_page (PAL_TAG (MEM_THREAD));
+  if (c->stack == NULL)
+    return false;
+  *(uint32_t *) (entry + ((char *) &mpentry_stack - mpentry_start))
+    = (uint32_t) c->stack + PGSIZE;
+
+  lapic_start_ap (c->apic_id, LOADER_MPENTRY);
+  for (i = 0; i < 100 && !c->started; i++)
+    timer_msleep (1);
+  return c->started;
+}
+
+/* Application processor entry point, called by threads/mpentry.S
+   with paging on and interrupts off.  Turns the running kernel
+   stack into the processor's idle thread and starts scheduling
+   threads. */
+void
+ap_main (void) 
+{
+  struct cpu *c;
+
+  intr_load_idt ();
+  lapic_init_ap ();
+
+  c = cpu_current ();
+#ifdef USERPROG
+  gdt_init_ap (c - cpus);
+#endif
+  spin_lock (&online_lock);
+  online_cnt++;
+  spin_unlock (&online_lock);
+  c->started = true;
+
+  thread_start_ap (c);
+}
+
+/* Local APIC timer interrupt handler, for an application
+   processor's scheduler tick. */
+static void
+lapic_timer_interrupt (struct intr_frame *f UNUSED) 
+{
+  thread_cpu ()->ticks++;
+  thread_tick ();
+}
+
+/* Reschedule IPI handler. */
+static void
+resched_interrupt (struct intr_frame *f UNUSED) 
+{
+  thread_cpu ()->resched_ipis++;
+  intr_yield_on_return ();
+}
+
+/* TLB shootdown IPI handler.  Runs without the interrupts-off
+   lock. */
+static void
+tlb_interrupt (struct intr_frame *f UNUSED) 
+{
+  smp_tlb_poll ();
+  lapic_eoi ();
+}
+
+/* Finds the MP configuration table and fills in cpus[] and
+   lapic_addr.  Returns true if successful. */
+static bool
+find_cpus (void) 
+{
+  struct mp_fp *mpfp;
+  struct mp_config *conf;
+  uint8_t *p, *end;
+  uintptr_t ebda = *(uint16_t *) ptov (0x40e) << 4;
+  uintptr_t base_kb = *(uint16_t *) ptov (0x413);
+  int proc_cnt;
+
+  /* [MP] 4: search the first KB of the extended BIOS data area,
+     the last KB of base memory, and the BIOS ROM. */
+  mpfp = NULL;
+  if (ebda != 0)
+    mpfp = search_fp (ebda, 1024);
+  if (mpfp == NULL)
+    mpfp = search_fp (base_kb * 1024 - 1024, 1024);
+  if (mpfp == NULL)
+    mpfp = search_fp (0xf0000, 0x10000);
+  if (mpfp == NULL || mpfp->config == 0 || mpfp->type != 0
+      || mpfp->config >= lowmem_pages * PGSIZE)
+    return false;
+
+  conf = ptov (mpfp->config);
+  if (memcmp (conf->signature, "PCMP", 4)
+      || checksum (conf, conf->length) != 0)
+    return false;
+  lapic_addr = conf->lapic_addr;
+
+  /* cpus[0] is the running processor, the BSP. */
+  p = (uint8_t *) (conf + 1);
+  end = (uint8_t *) conf + conf->length;
+  proc_cnt = 0;
+  while (p < end) 
+    if (*p == MP_PROC) 
+      {
+        struct mp_proc *proc = (struct mp_proc *) p;
+        if (proc->flags & MP_PROC_ENABLED) 
+          {
+            proc_cnt++;
+            if (proc->apic_id != cpus[0].apic_id && cpu_cnt < CPU_MAX) 
+              {
+                struct cpu *c = &cpus[cpu_cnt++];
+                c->apic_id = proc->apic_id;
+                c->bsp = false;
+                c->started = false;
+              }
+          }
+        p += sizeof *proc;
+      }
+    else
+      p += 8;
+
+  if (proc_cnt == 0) 
+    {
+      lapic_addr = 0;
+      cpu_cnt = 1;
+      return false;
+    }
+  return true;
+}
+
+/* Searches SIZE bytes of physical memory at PADDR for a valid
+   MP floating pointer structure and returns it, or a null
+   pointer if there is none. */
+static struct mp_fp *
+search_fp (uintptr_t paddr, size_t size) 
+{
+  uint8_t *p = ptov (paddr);
+  uint8_t *end = p + size;
+
+  for (; p + sizeof (struct mp_fp) <= end; p += 16) 
+    if (!memcmp (p, "_MP_", 4) && checksum (p, sizeof (struct mp_fp)) == 0)
+      return (struct mp_fp *) p;
+  return NULL;
+}
+
+/* Returns the sum of the SIZE bytes at P, mod 256. */
+static uint8_t
+checksum (const void *p_, size_t size) 
+{
+  const uint8_t *p = p_;
+  uint8_t sum = 0;
+
+  while (size-- > 0)
+    sum += *p++;
+  return sum;
+}
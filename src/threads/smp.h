@@ -0,0 +1,53 @@
+#ifndef THREADS_SMP_H
+#define THREADS_SMP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "threads/thread.h"
+
+/* Maximum number of processors. */
+#define CPU_MAX 8
+
+/* Per-processor state.  Except where noted, accessed with
+   interrupts off, that is, under the interrupts-off lock. */
+struct cpu 
+  {
+    unsigned apic_id;           /* Local APIC ID. */
+    bool bsp;                   /* Bootstrap processor? */
+    volatile bool started;      /* Has reached ap_main()? */
+    volatile int64_t ticks;     /* Local APIC timer ticks. */
+    void *stack;                /* Kernel stack page. */
+
+    /* Scheduling. */
+    struct thread *idle;        /* Idle thread, once it runs threads. */
+    struct thread *curr;        /* Running thread, once it runs threads. */
+    unsigned thread_ticks;      /* # of timer ticks since last yield. */
+    struct run_queue rq;        /* Ready threads queued here. */
+    bool kicked;                /* Reschedule IPI not yet answered? */
+    uint32_t *pagedir;          /* Active page directory, null if base. */
+
+    /* Set by another processor, cleared by this one without the
+       interrupts-off lock. */
+    volatile bool tlb_flush;    /* TLB flush requested? */
+
+    /* Statistics. */
+    long long steals;           /* Threads taken from other CPUs. */
+    long long resched_ipis;     /* Reschedule IPIs received. */
+    long long tlb_flushes;      /* TLB shootdowns received. */
+  };
+
+extern struct cpu cpus[CPU_MAX];
+extern int cpu_cnt;
+
+/* -smp: Start the application processors? */
+extern bool smp_enabled;
+
+void smp_init (void);
+struct cpu *cpu_current (void);
+int smp_online_cnt (void);
+void smp_print_stats (void);
+void smp_resched (struct cpu *);
+void smp_flush_tlb (const uint32_t *pd);
+void smp_tlb_poll (void);
+
+#endif /* threads/smp.h */
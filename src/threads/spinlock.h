@@ -0,0 +1,88 @@
+#ifndef THREADS_SPINLOCK_H
+#define THREADS_SPINLOCK_H
+
+#include <debug.h>
+#include <stdbool.h>
+#include "threads/interrupt.h"
+
+/* Spin lock.
+
+   A spin lock excludes other processors: the holder keeps it
+   for a short, bounded time, and other processors busy-wait
+   until it is released.  A spin lock may not be held across
+   anything that sleeps.
+
+   Turning interrupts off takes the kernel's interrupts-off lock
+   (see interrupt.c), which is a spin lock too, so most kernel
+   code needs no other.  A separate spin lock is for code that
+   runs before a processor may take that lock, such as an
+   application processor that is still starting up.
+
+   Code that may also be reached from an interrupt handler must
+   use spin_lock_irqsave(), so that the handler cannot interrupt
+   the holder and then spin on the same lock forever. */
+struct spinlock 
+  {
+    volatile int locked;        /* 1 if held, 0 if free. */
+  };
+
+/* Initializer for a static spin lock. */
+#define SPINLOCK_INITIALIZER { 0 }
+
+/* Initializes LOCK as free. */
+static inline void
+spinlock_init (struct spinlock *lock) 
+{
+  lock->locked = 0;
+}
+
+/* Acquires LOCK if it is available, without spinning.  Returns
+   true if successful, false if LOCK is held. */
+static inline bool
+spin_trylock (struct spinlock *lock) 
+{
+  int old = 1;
+
+  asm volatile ("xchgl %0, %1"
+                : "+r" (old), "+m" (lock->locked) : : "memory");
+  return old == 0;
+}
+
+/* Acquires LOCK, spinning until it is available. */
+static inline void
+spin_lock (struct spinlock *lock) 
+{
+  while (!spin_trylock (lock))
+    while (lock->locked)
+      asm volatile ("pause");
+}
+
+/* Releases LOCK, which the caller must hold. */
+static inline void
+spin_unlock (struct spinlock *lock) 
+{
+  ASSERT (lock->locked);
+  asm volatile ("" : : : "memory");
+  lock->locked = 0;
+}
+
+/* Turns interrupts off, acquires LOCK, and returns the previous
+   interrupt level, which the caller passes to
+   spin_unlock_irqrestore(). */
+static inline enum intr_level
+spin_lock_irqsave (struct spinlock *lock) 
+{
+  enum intr_level old_level = intr_disable ();
+  spin_lock (lock);
+  return old_level;
+}
+
+/* Releases LOCK and restores interrupt level OLD_LEVEL. */
+static inline void
+spin_unlock_irqrestore (struct spinlock *lock, enum intr_level old_level) 
+{
+  spin_unlock (lock);
+  intr_set_level (old_level);
+}
+
+#endif /* threads/spinlock.h */
@@ -31,6 +31,15 @@
 #include <string.h>
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
+#include "threads/tsc.h"
+#include "devices/timer.h"
+
+static rb_less_func sema_compare_waiter_priority;
+static void sema_remove_waiter (struct semaphore *, struct thread *);
+static timer_event_func sema_timeout;
+static void lock_waiters_changed (struct lock *);
+static void lock_refresh_donation (struct thread *);
 
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
    nonnegative integer along with two atomic operators for
@@ -47,7 +56,7 @@ sema_init (struct semaphore *sema, unsigned value)
   ASSERT (sema != NULL);
 
   sema->value = value;
-  list_init (&sema->waiters);
+  rb_init (&sema->waiters, sema_compare_waiter_priority, NULL);
 }
 
 /* Down or "P" operation on a semaphore.  Waits for SEMA's value
@@ -69,14 +78,95 @@ sema_down (struct semaphore *sema)
   old_level = intr_disable ();
   while (sema->value == 0) 
     {
-      list_insert_ordered(&sema->waiters, &thread_current()->elem, thread_compare_priority, NULL);
-      // list_push_back (&sema->waiters, &thread_current ()->elem);
+      struct thread *cur = thread_current ();
+
+      cur->waiting_sema = sema;
+      rb_insert (&sema->waiters, &cur->wait_node);
+      if (cur->waiting_lock != NULL && sema == &cur->waiting_lock->semaphore)
+        lock_waiters_changed (cur->waiting_lock);
       thread_block ();
     }
   sema->value--;
   intr_set_level (old_level);
 }
 
+/* Timeout state for sema_down_timeout(). */
+struct sema_waiter 
+  {
+    struct semaphore *sema;     /* Semaphore being waited on. */
+    struct thread *thread;      /* Waiting thread. */
+    bool timed_out;             /* Did the timeout wake the thread? */
+  };
+
+/* Like sema_down(), but gives up once TICKS timer ticks have
+   passed without SEMA's value becoming positive.  Returns true
+   if SEMA was decremented, false if the wait timed out.  If
+   TICKS is 0 or less, does not sleep at all.
+
+   Whichever of sema_up() and the timeout comes first removes the
+   thread from SEMA's waiters and wakes it, and the thread then
+   cancels the timeout itself, so neither can wake it a second
+   time.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+bool
+sema_down_timeout (struct semaphore *sema, int64_t ticks) 
+{
+  struct sema_waiter w;
+  struct timer_event alarm;
+  enum intr_level old_level;
+  int64_t deadline = timer_ticks () + ticks;
+
+  ASSERT (sema != NULL);
+  ASSERT (!intr_context ());
+
+  w.sema = sema;
+  w.thread = thread_current ();
+  w.timed_out = false;
+  timer_event_init (&alarm, sema_timeout, &w);
+
+  old_level = intr_disable ();
+  while (sema->value == 0) 
+    {
+      struct thread *cur = w.thread;
+
+      if (w.timed_out || timer_ticks () >= deadline)
+        {
+          intr_set_level (old_level);
+          return false;
+        }
+
+      timer_event_arm (&alarm, deadline);
+      cur->waiting_sema = sema;
+      rb_insert (&sema->waiters, &cur->wait_node);
+      if (cur->waiting_lock != NULL && sema == &cur->waiting_lock->semaphore)
+        lock_waiters_changed (cur->waiting_lock);
+      thread_block ();
+      timer_event_cancel (&alarm);
+    }
+  sema->value--;
+  intr_set_level (old_level);
+  return true;
+}
+
+/* Timer event function for sema_down_timeout().  Wakes up the
+   waiter in W_, unless sema_up() has already done so. */
+static void
+sema_timeout (void *w_) 
+{
+  struct sema_waiter *w = w_;
+  struct thread *t = w->thread;
+
+  if (t->waiting_sema != w->sema)
+    return;
+  sema_remove_waiter (w->sema, t);
+  w->timed_out = true;
+  thread_unblock (t);
+  if (t->priority > thread_current ()->priority)
+    intr_yield_on_return ();
+}
+
 /* Down or "P" operation on a semaphore, but only if the
    semaphore is not already 0.  Returns true if the semaphore is
    decremented, false otherwise.
@@ -116,9 +206,9 @@ sema_up (struct semaphore *sema)
 
   old_level = intr_disable ();
   struct thread *t = NULL;
-  if (!list_empty (&sema->waiters)) {
-      list_sort(&sema->waiters, thread_compare_priority, NULL);
-      t = list_entry(list_pop_front(&sema->waiters), struct thread, elem);
+  if (!rb_empty (&sema->waiters)) {
+      t = rb_entry (rb_min (&sema->waiters), struct thread, wait_node);
+      sema_remove_waiter (sema, t);
       thread_unblock (t);
     }
   sema->value++;
@@ -130,6 +220,52 @@ sema_up (struct semaphore *sema)
   intr_set_level (old_level);
 }
 
+/* Moves thread T, which is waiting on a semaphore, to its place
+   among the semaphore's waiters after a change in T's priority.
+   If T is acquiring a lock, the lock's holder is given the new
+   priority, which in turn follows the chain of locks that it is
+   waiting for.  Interrupts must be off. */
+void
+sema_reorder_waiter (struct thread *t) 
+{
+  struct semaphore *sema = t->waiting_sema;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (sema != NULL);
+
+  rb_remove (&sema->waiters, &t->wait_node);
+  rb_insert (&sema->waiters, &t->wait_node);
+  if (t->waiting_lock != NULL && sema == &t->waiting_lock->semaphore)
+    lock_waiters_changed (t->waiting_lock);
+}
+
+/* Removes thread T from SEMA's waiters, updating the priority
+   donated to the holder if SEMA belongs to the lock that T is
+   acquiring.  Interrupts must be off. */
+static void
+sema_remove_waiter (struct semaphore *sema, struct thread *t) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (t->waiting_sema == sema);
+
+  rb_remove (&sema->waiters, &t->wait_node);
+  t->waiting_sema = NULL;
+  if (t->waiting_lock != NULL && sema == &t->waiting_lock->semaphore)
+    lock_waiters_changed (t->waiting_lock);
+}
+
+/* Orders semaphore waiters by descending priority.  Waiters of
+   equal priority are woken in FIFO order. */
+static bool
+sema_compare_waiter_priority (const struct rb_node *a_,
+                              const struct rb_node *b_, void *aux UNUSED) 
+{
+  const struct thread *a = rb_entry (a_, struct thread, wait_node);
+  const struct thread *b = rb_entry (b_, struct thread, wait_node);
+
+  return a->priority > b->priority;
+}
+
 static void sema_test_helper (void *sema_);
 
 /* Self-test for semaphores that makes control "ping-pong"
@@ -188,7 +324,7 @@ lock_init (struct lock *lock)
   ASSERT (lock != NULL);
 
   lock->holder = NULL;
-  // lock->is_donated = false;
+  lock->max_priority = PRI_MIN - 1;
   sema_init (&lock->semaphore, 1);
 }
 
@@ -207,31 +343,123 @@ lock_acquire (struct lock *lock)
   ASSERT (!intr_context ());
   ASSERT (!lock_held_by_current_thread (lock));
 
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  tid_t holder_tid = TID_ERROR;
+  uint64_t wait_start = 0;
   if (lock->holder != NULL) {
     // someone is holding lock
-    if (lock->holder->priority < thread_get_priority()) {
-      lock->holder->priority = thread_get_priority();
-      lock_cascade_waiting_lock_priority(lock->holder);
-    }
+    holder_tid = lock->holder->tid;
+    if (trace_enabled)
+      wait_start = rdtsc ();
   }
 
-  thread_current()->waiting_lock = lock;
+  /* sema_down() donates our priority to the holder, if any. */
+  cur->waiting_lock = lock;
   sema_down (&lock->semaphore);
-  thread_current()->waiting_lock = NULL;
-  lock->holder = thread_current ();
-  list_push_back(&thread_current()->holding_locks, &lock->elem);
+  cur->waiting_lock = NULL;
+
+  old_level = intr_disable ();
+  lock->holder = cur;
+  rb_insert (&cur->held_locks, &lock->elem);
+  lock_refresh_donation (cur);
+  intr_set_level (old_level);
+  if (holder_tid != TID_ERROR)
+    TRACE (TRACE_LOCK_CONTENDED, lock, holder_tid, rdtsc () - wait_start);
 }
 
-void
-lock_cascade_waiting_lock_priority(struct thread *t) {
-  if (t->waiting_lock != NULL) {
-    struct thread *locking_thread = t->waiting_lock->holder;
-    if (locking_thread == NULL) return;
-    if (locking_thread->priority < t->priority) {
-      locking_thread->priority = t->priority;
-      lock_cascade_waiting_lock_priority(locking_thread);
+/* Like lock_acquire(), but gives up once TICKS timer ticks have
+   passed without LOCK becoming available.  Returns true if LOCK
+   was acquired, false if the wait timed out.  While waiting, the
+   current thread donates its priority to LOCK's holder as usual;
+   on a timeout, the donation is withdrawn.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+bool
+lock_acquire_timeout (struct lock *lock, int64_t ticks)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  bool success;
+
+  ASSERT (lock != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (!lock_held_by_current_thread (lock));
+
+  cur->waiting_lock = lock;
+  success = sema_down_timeout (&lock->semaphore, ticks);
+  cur->waiting_lock = NULL;
+  if (!success)
+    return false;
+
+  old_level = intr_disable ();
+  lock->holder = cur;
+  rb_insert (&cur->held_locks, &lock->elem);
+  lock_refresh_donation (cur);
+  intr_set_level (old_level);
+  return true;
+}
+
+/* Updates LOCK's cached maximum waiter priority after its
+   semaphore's waiters change, and passes any change on to
+   LOCK's holder.  Interrupts must be off. */
+static void
+lock_waiters_changed (struct lock *lock) 
+{
+  struct rbtree *waiters = &lock->semaphore.waiters;
+  struct thread *holder = lock->holder;
+  int priority;
+
+  priority = (rb_empty (waiters) ? PRI_MIN - 1
+              : rb_entry (rb_min (waiters), struct thread, wait_node)->priority);
+  if (priority == lock->max_priority)
+    return;
+
+  if (holder == NULL) 
+    {
+      lock->max_priority = priority;
+      return;
     }
-  }
+  rb_remove (&holder->held_locks, &lock->elem);
+  lock->max_priority = priority;
+  rb_insert (&holder->held_locks, &lock->elem);
+  lock_refresh_donation (holder);
+}
+
+/* Sets T's priority to the greater of its own priority and the
+   highest priority of any thread waiting for a lock that T
+   holds.  Costs time proportional to the length of the chain of
+   locks that T is itself waiting for.  Interrupts must be
+   off. */
+static void
+lock_refresh_donation (struct thread *t) 
+{
+  int priority;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (thread_mlfqs)
+    return;
+
+  priority = thread_locks_max_priority (t);
+  if (priority > t->orig_priority && priority > t->priority)
+    thread_donate_priority (t, priority);
+  else
+    thread_update_priority (t, (priority > t->orig_priority
+                                ? priority : t->orig_priority));
+}
+
+/* Orders a thread's held locks by descending maximum waiter
+   priority. */
+bool
+lock_compare_max_priority (const struct rb_node *a_,
+                           const struct rb_node *b_, void *aux UNUSED) 
+{
+  const struct lock *a = rb_entry (a_, struct lock, elem);
+  const struct lock *b = rb_entry (b_, struct lock, elem);
+
+  return a->max_priority > b->max_priority;
 }
 
 /* Tries to acquires LOCK and returns true if successful or false
@@ -249,8 +477,14 @@ lock_try_acquire (struct lock *lock)
   ASSERT (!lock_held_by_current_thread (lock));
 
   success = sema_try_down (&lock->semaphore);
-  if (success)
-    lock->holder = thread_current ();
+  if (success) 
+    {
+      enum intr_level old_level = intr_disable ();
+      lock->holder = thread_current ();
+      rb_insert (&thread_current ()->held_locks, &lock->elem);
+      lock_refresh_donation (thread_current ());
+      intr_set_level (old_level);
+    }
   return success;
 }
 
@@ -266,24 +500,12 @@ lock_release (struct lock *lock)
   ASSERT (lock != NULL);
   ASSERT (lock_held_by_current_thread (lock));
 
-  list_remove(&lock->elem);
-
-  
-  if (list_empty(&thread_current()->holding_locks)) {
-    thread_current()->priority = thread_current()->orig_priority;
-    }
-  else
-  {
-    // 아직 lock을 가지고 있다면.
-    int locks_max_priority = thread_locks_max_priority(thread_current());
-  // printf("locks priority %d, %d\n", locks_max_priority, thread_current()->orig_priority);
-    if (locks_max_priority < thread_current()->orig_priority)
-      thread_current()->priority = thread_current()->orig_priority;
-    else
-      thread_current()->priority = locks_max_priority;
-  } 
+  enum intr_level old_level = intr_disable ();
+  rb_remove (&thread_current ()->held_locks, &lock->elem);
   lock->holder = NULL;
+  lock_refresh_donation (thread_current ());
   sema_up (&lock->semaphore);
+  intr_set_level (old_level);
 }
 
 /* Returns true if the current thread holds LOCK, false
@@ -297,6 +519,139 @@ lock_held_by_current_thread (const struct lock *lock)
   return lock->holder == thread_current ();
 }
 
+/* Initializes RW as a reader-writer lock.  Any number of
+   readers may hold RW at once, or a single writer.
+
+   A writer holds RW's internal lock from the time it starts
+   waiting until it releases RW, so threads that must wait for a
+   writer block on that lock and donate their priority to the
+   writer.  Readers are not tracked individually, so a writer
+   waiting for readers to leave does not donate to them.
+
+   Under RWLOCK_PREFER_WRITERS, a new reader waits whenever a
+   writer holds RW or is waiting for it, so a stream of readers
+   cannot starve writers.  Under RWLOCK_BATCH_READERS, a new
+   reader may still join the readers already holding RW while a
+   writer waits, up to RWLOCK_BATCH of them, which shortens
+   reader waits at some cost to the writer. */
+void
+rwlock_init (struct rwlock *rw, enum rwlock_policy policy) 
+{
+  ASSERT (rw != NULL);
+
+  lock_init (&rw->writer);
+  sema_init (&rw->drained, 0);
+  rw->readers = 0;
+  rw->batch = 0;
+  rw->writing = false;
+  rw->draining = false;
+  rw->policy = policy;
+}
+
+/* Acquires RW for reading, sleeping until no writer holds it or
+   is waiting for it, as RW's policy dictates.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rwlock_acquire_read (struct rwlock *rw) 
+{
+  enum intr_level old_level;
+
+  ASSERT (rw != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (!rwlock_held_for_write (rw));
+
+  old_level = intr_disable ();
+  if (rw->writer.holder == NULL) 
+    {
+      rw->readers++;
+      intr_set_level (old_level);
+      return;
+    }
+  if (rw->policy == RWLOCK_BATCH_READERS && !rw->writing
+      && rw->readers > 0 && rw->batch < RWLOCK_BATCH) 
+    {
+      rw->batch++;
+      rw->readers++;
+      intr_set_level (old_level);
+      return;
+    }
+  intr_set_level (old_level);
+
+  /* Wait for the writer, donating our priority to it. */
+  lock_acquire (&rw->writer);
+  old_level = intr_disable ();
+  rw->readers++;
+  intr_set_level (old_level);
+  lock_release (&rw->writer);
+}
+
+/* Releases RW, which the current thread must hold for reading. */
+void
+rwlock_release_read (struct rwlock *rw) 
+{
+  enum intr_level old_level;
+
+  ASSERT (rw != NULL);
+  ASSERT (rw->readers > 0);
+
+  old_level = intr_disable ();
+  if (--rw->readers == 0 && rw->draining) 
+    {
+      rw->draining = false;
+      sema_up (&rw->drained);
+    }
+  intr_set_level (old_level);
+}
+
+/* Acquires RW for writing, sleeping until no other thread holds
+   it.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rwlock_acquire_write (struct rwlock *rw) 
+{
+  enum intr_level old_level;
+
+  ASSERT (rw != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (!rwlock_held_for_write (rw));
+
+  lock_acquire (&rw->writer);
+  old_level = intr_disable ();
+  rw->batch = 0;
+  while (rw->readers > 0) 
+    {
+      rw->draining = true;
+      sema_down (&rw->drained);
+    }
+  rw->writing = true;
+  intr_set_level (old_level);
+}
+
+/* Releases RW, which the current thread must hold for writing. */
+void
+rwlock_release_write (struct rwlock *rw) 
+{
+  ASSERT (rw != NULL);
+  ASSERT (rwlock_held_for_write (rw));
+
+  rw->writing = false;
+  lock_release (&rw->writer);
+}
+
+/* Returns true if the current thread holds RW for writing,
+   false otherwise. */
+bool
+rwlock_held_for_write (const struct rwlock *rw) 
+{
+  ASSERT (rw != NULL);
+
+  return lock_held_by_current_thread (&rw->writer);
+}
+
 /* One semaphore in a list. */
 struct semaphore_elem 
   {
@@ -355,6 +710,44 @@ cond_wait (struct condition *cond, struct lock *lock)
   lock_acquire (lock);
 }
 
+/* Like cond_wait(), but gives up waiting for COND once TICKS
+   timer ticks have passed.  LOCK is reacquired before returning
+   in either case.  Returns true if COND was signaled, false if
+   the wait timed out.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+bool
+cond_timedwait (struct condition *cond, struct lock *lock, int64_t ticks) 
+{
+  struct semaphore_elem waiter;
+  bool signaled;
+
+  ASSERT (cond != NULL);
+  ASSERT (lock != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (lock_held_by_current_thread (lock));
+
+  waiter.priority = lock->holder->priority;
+  sema_init (&waiter.semaphore, 0);
+  list_insert_ordered (&cond->waiters, &waiter.elem, cond_compare_semaphore_elem_priority, NULL);
+  lock_release (lock);
+  signaled = sema_down_timeout (&waiter.semaphore, ticks);
+  lock_acquire (lock);
+
+  /* A signal may have arrived between the timeout and
+     reacquiring LOCK.  If so, cond_signal() has already removed
+     WAITER from COND, and the signal must not be lost.
+     Otherwise, WAITER is still on COND's list. */
+  if (!signaled) 
+    {
+      signaled = sema_try_down (&waiter.semaphore);
+      if (!signaled)
+        list_remove (&waiter.elem);
+    }
+  return signaled;
+}
+
 /* If any threads are waiting on COND (protected by LOCK), then
    this function signals one of them to wake up from its wait.
    LOCK must be held before calling this function.
@@ -391,8 +784,8 @@ cond_broadcast (struct condition *cond, struct lock *lock)
     cond_signal (cond, lock);
 }
 
-bool cond_compare_semaphore_elem_priority (struct list_elem *e_a, struct list_elem *e_b){
-  struct semaphore_elem *t_a = list_entry(e_a, struct semaphore_elem, elem);
-  struct semaphore_elem *t_b = list_entry(e_b, struct semaphore_elem, elem);
+bool cond_compare_semaphore_elem_priority (const struct list_elem *e_a, const struct list_elem *e_b, void *aux UNUSED){
+  const struct semaphore_elem *t_a = list_entry(e_a, struct semaphore_elem, elem);
+  const struct semaphore_elem *t_b = list_entry(e_b, struct semaphore_elem, elem);
   return t_a->priority > t_b->priority;
 }
\ No newline at end of file
@@ -2,38 +2,74 @@
 #define THREADS_SYNCH_H
 
 #include <list.h>
+#include <rbtree.h>
 #include <stdbool.h>
+#include <stdint.h>
+
+struct thread;
 
 /* A counting semaphore. */
 struct semaphore 
   {
     unsigned value;             /* Current value. */
-    struct list waiters;        /* List of waiting threads. */
+    struct rbtree waiters;      /* Waiting threads, by priority. */
   };
 
 void sema_init (struct semaphore *, unsigned value);
 void sema_down (struct semaphore *);
+bool sema_down_timeout (struct semaphore *, int64_t ticks);
 bool sema_try_down (struct semaphore *);
 void sema_up (struct semaphore *);
 void sema_self_test (void);
+void sema_reorder_waiter (struct thread *);
 
 /* Lock. */
 struct lock 
   {
     struct thread *holder;      /* Thread holding lock (for debugging). */
     struct semaphore semaphore; /* Binary semaphore controlling access. */
-
-    // int orig_priority;
-    // bool is_donated;
-
-    struct list_elem elem;
+    int max_priority;           /* Highest waiter priority, or -1. */
+    struct rb_node elem;        /* Holder's held_locks node. */
   };
 
 void lock_init (struct lock *);
 void lock_acquire (struct lock *);
+bool lock_acquire_timeout (struct lock *, int64_t ticks);
 bool lock_try_acquire (struct lock *);
 void lock_release (struct lock *);
 bool lock_held_by_current_thread (const struct lock *);
+bool lock_compare_max_priority (const struct rb_node *,
+                                const struct rb_node *, void *aux);
+
+/* Reader-writer lock policies. */
+enum rwlock_policy
+  {
+    RWLOCK_PREFER_WRITERS,      /* Readers wait behind any writer. */
+    RWLOCK_BATCH_READERS        /* Readers may join an active batch. */
+  };
+
+/* Maximum number of readers admitted to a batch past a writer
+   that is waiting, under RWLOCK_BATCH_READERS. */
+#define RWLOCK_BATCH 8
+
+/* Reader-writer lock. */
+struct rwlock 
+  {
+    struct lock writer;         /* Held by a writer, even while waiting. */
+    struct semaphore drained;   /* Upped when the last reader leaves. */
+    unsigned readers;           /* Number of readers holding the lock. */
+    unsigned batch;             /* Readers admitted past the writer. */
+    bool writing;               /* Does a writer hold the lock? */
+    bool draining;              /* Is a writer waiting on `drained'? */
+    enum rwlock_policy policy;  /* Who goes first. */
+  };
+
+void rwlock_init (struct rwlock *, enum rwlock_policy);
+void rwlock_acquire_read (struct rwlock *);
+void rwlock_release_read (struct rwlock *);
+void rwlock_acquire_write (struct rwlock *);
+void rwlock_release_write (struct rwlock *);
+bool rwlock_held_for_write (const struct rwlock *);
 
 /* Condition variable. */
 struct condition 
@@ -43,9 +79,12 @@ struct condition
 
 void cond_init (struct condition *);
 void cond_wait (struct condition *, struct lock *);
+bool cond_timedwait (struct condition *, struct lock *, int64_t ticks);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
-bool cond_compare_semaphore_elem_priority (struct list_elem *e_a, struct list_elem *e_b);
+bool cond_compare_semaphore_elem_priority (const struct list_elem *e_a,
+                                           const struct list_elem *e_b,
+                                           void *aux);
 
 /* Optimization barrier.
 
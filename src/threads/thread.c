@@ -4,13 +4,20 @@
 #include <random.h>
 #include <stdio.h>
 #include <string.h>
+#include "devices/timer.h"
 #include "threads/flags.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
+#include "threads/memtag.h"
 #include "threads/palloc.h"
+#include "threads/slab.h"
+#include "threads/smp.h"
 #include "threads/switch.h"
 #include "threads/synch.h"
+#include "threads/trace.h"
+#include "threads/tsc.h"
 #include "threads/vaddr.h"
+#include "threads/workqueue.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #endif
@@ -25,19 +32,34 @@
    Do not modify this value. */
 #define THREAD_BASIC 0xd42df210
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
-static struct list sleep_list; // a list for struct thread_sleep_info
+/* Number of threads in THREAD_READY state: in every processor's
+   run queue (see struct run_queue), in fair_tree, and in
+   edf_tree.
 
-/* Idle thread. */
-static struct thread *idle_thread;
+   Each processor has its own run queue, idle thread, and running
+   thread, in struct cpu.  A thread that becomes ready goes on
+   the run queue of the processor that it last ran on, or of its
+   creator's.  A processor picking its next thread takes the
+   highest-priority ready thread in any run queue, preferring its
+   own, so idle processors steal work from busy ones. */
+static int ready_cnt;
 
 /* Initial thread, the thread running init.c:main(). */
 static struct thread *initial_thread;
 
-/* Lock used by allocate_tid(). */
-static struct lock tid_lock;
+/* Pages of dead threads, kept for reuse by thread_create() so
+   that creating and destroying threads does not go through the
+   page allocator in steady state.  A cached page is reused as is,
+   without zeroing, since init_thread() clears struct thread and
+   a stack needs no clearing.  Accessed with interrupts off. */
+#define THREAD_CACHE_MAX 16
+static struct list thread_cache;
+static int thread_cache_cnt;
+static long long thread_cache_hits, thread_cache_misses;
+
+/* Cache of child_status records. */
+static struct kmem_cache child_status_cache;
+static kmem_ctor_func child_status_ctor;
 
 /* Stack frame for kernel_thread(). */
 struct kernel_thread_frame 
@@ -52,18 +74,99 @@ static long long idle_ticks;    /* # of timer ticks spent idle. */
 static long long kernel_ticks;  /* # of timer ticks in kernel threads. */
 static long long user_ticks;    /* # of timer ticks in user programs. */
 
+/* Scheduler statistics, kept with interrupts off. */
+static struct sched_sys_stats sched_stats;
+
+/* If true, print detailed scheduler statistics at shutdown.
+   Controlled by kernel command-line option "-schedstats". */
+bool thread_schedstats;
+
 /* Scheduling. */
 #define TIME_SLICE 4            /* # of timer ticks to give each thread. */
-static unsigned thread_ticks;   /* # of timer ticks since last yield. */
 
 /* If false (default), use round-robin scheduler.
    If true, use multi-level feedback queue scheduler.
    Controlled by kernel command-line option "-o mlfqs". */
 bool thread_mlfqs;
 
+/* Lazy MLFQS bookkeeping.
+
+   Once per second, load_avg is updated and every thread's
+   recent_cpu should decay by a factor that depends on load_avg.
+   Instead of visiting every thread then, each update starts a
+   new epoch whose decay factor is recorded in mlfqs_decay[], and
+   each thread remembers the epoch up to which its recent_cpu has
+   been decayed.  A thread's missing decays are applied, and its
+   priority recomputed, only when it is scheduled, unblocked, or
+   reached by a sweep that visits a few threads per tick, so the
+   per-tick cost does not depend on the number of threads.
+
+   The sweep visits every thread long before MLFQS_EPOCH_HISTORY
+   epochs have gone by, unless there are many thousands of
+   threads. */
+#define MLFQS_EPOCH_HISTORY 64  /* # of decay factors remembered. */
+#define MLFQS_SWEEP_BATCH 8     /* # of threads swept per tick. */
+static int64_t mlfqs_epoch;     /* # of load_avg updates so far. */
+static fp mlfqs_decay[MLFQS_EPOCH_HISTORY];
+static struct list_elem *mlfqs_cursor; /* Next thread_all elem to sweep. */
+
+/* If true, use the fair-share scheduler instead of priorities.
+   Controlled by kernel command-line option "-sched=fair".
+
+   Ready threads are kept in fair_tree, ordered by virtual
+   runtime, which advances while a thread runs at a rate
+   inversely proportional to the thread's weight, a function of
+   its nice value.  The thread that has received the least
+   weighted CPU time, the leftmost in the tree, runs next.  Its
+   time slice is its share, by weight, of a target latency within
+   which every runnable thread should get to run once, but at
+   least one tick.  A thread that wakes up after sleeping is
+   placed no further than half the target latency behind the
+   least vruntime of the other threads, so that sleeping does not
+   bank unlimited CPU time.
+
+   Priority donation still works: a thread holding a lock that a
+   higher-priority thread wants is weighted as if its nice value
+   were lower by the number of priority levels donated to it, and
+   on receiving a donation its vruntime is pulled forward to the
+   least vruntime in the system, so that it runs soon and at a
+   larger share until it releases the lock. */
+bool thread_fair;
+#define FAIR_LATENCY 6          /* Target latency, in ticks. */
+#define FAIR_NICE_0_WEIGHT 1024 /* Weight of a thread with nice 0. */
+#define FAIR_TICK_VRUNTIME 1024 /* Vruntime per tick at nice 0. */
+#define FAIR_WAKEUP_GRAN FAIR_TICK_VRUNTIME
+#define FAIR_SLEEPER_CREDIT (FAIR_LATENCY * FAIR_TICK_VRUNTIME / 2)
+static struct rbtree fair_tree; /* Ready threads, by vruntime. */
+static int fair_ready_weight;   /* Total weight of threads in fair_tree. */
+static int64_t fair_min_vruntime; /* Monotonic floor of all vruntimes. */
+
+/* Earliest-deadline-first real-time class.  Ready real-time
+   threads are kept in edf_tree, ordered by absolute deadline, and
+   always run before any other ready thread. */
+static struct rbtree edf_tree;  /* Ready real-time threads. */
+static int rt_utilization;      /* Reserved, in 1/RT_UTIL_SCALE units. */
+
+/* Weights for nice values -20...20.  Each step of nice changes
+   the share of CPU time by about 10%. */
+static const int fair_weights[] = 
+  {
+    /* -20 */ 88761, 71755, 56483, 46273, 36291,
+    /* -15 */ 29154, 23254, 18705, 14949, 11916,
+    /* -10 */ 9548, 7620, 6100, 4904, 3906,
+    /*  -5 */ 3121, 2501, 1991, 1586, 1277,
+    /*   0 */ 1024, 820, 655, 526, 423,
+    /*   5 */ 335, 272, 215, 172, 137,
+    /*  10 */ 110, 87, 70, 56, 45,
+    /*  15 */ 36, 29, 23, 18, 15,
+    /*  20 */ 12,
+  };
+
 static void kernel_thread (thread_func *, void *aux);
 
 static void idle (void *aux UNUSED);
+static void idle_loop (void) NO_RETURN;
+static bool is_idle (const struct thread *);
 static struct thread *running_thread (void);
 static struct thread *next_thread_to_run (void);
 static void init_thread (struct thread *, const char *name, int priority);
@@ -72,6 +175,30 @@ static void *alloc_frame (struct thread *, size_t size);
 static void schedule (void);
 void schedule_tail (struct thread *prev);
 static tid_t allocate_tid (void);
+static void ready_push (struct thread *);
+static struct thread *ready_pop (void);
+static void ready_remove (struct thread *);
+static void rq_init (struct run_queue *);
+static int rq_max_priority (const struct run_queue *);
+static struct run_queue *pick_queue (struct cpu *);
+static int running_priority (const struct cpu *);
+static void kick_cpu (struct thread *);
+static bool mlfqs_catch_up (struct thread *);
+static void mlfqs_sweep (void);
+static void thread_refresh_load_avg (void);
+static void thread_nice_refresh_priority (struct thread *);
+static void print_latency_hist (const uint32_t hist[SCHED_HIST_BUCKETS]);
+static int fair_weight (const struct thread *);
+static void fair_boost_donee (struct thread *);
+static rb_less_func fair_less;
+static void fair_update_min_vruntime (struct thread *);
+static bool fair_tick (struct thread *);
+static tid_t spawn_thread (const char *name, int priority, thread_func *,
+                           void *aux, const struct thread_rt *);
+static rb_less_func edf_less;
+static int rt_density (int64_t budget, int64_t period, int64_t deadline);
+static timer_event_func rt_release;
+static void rt_check_preempt (struct thread *);
 
 /* Initializes the threading system by transforming the code
    that's currently running into a thread.  This can't work in
@@ -92,30 +219,33 @@ static tid_t allocate_tid (void);
 void
 thread_init (void) 
 {
+  int i;
+
   ASSERT (intr_get_level () == INTR_OFF);
 
-  lock_init (&tid_lock);
-  list_init (&ready_list);
-  list_init (&sleep_list);
+  list_init (&thread_cache);
+  kmem_cache_init (&child_status_cache, "child_status",
+                   sizeof (struct child_status), child_status_ctor,
+                   MEM_PROCESS);
+  for (i = 0; i < CPU_MAX; i++)
+    rq_init (&cpus[i].rq);
+  rb_init (&fair_tree, fair_less, NULL);
+  rb_init (&edf_tree, edf_less, NULL);
   list_init (&parent_child_list);
+  lock_init (&parent_child_lock);
   list_init (&thread_all);
 
   /* Set up a thread structure for the running thread. */
   initial_thread = running_thread ();
   init_thread (initial_thread, "main", PRI_DEFAULT);
+  initial_thread->cpu = &cpus[0];
+  cpus[0].curr = initial_thread;
   initial_thread->status = THREAD_RUNNING;
   initial_thread->tid = allocate_tid ();
+  initial_thread->run_stamp = rdtsc ();
+  list_push_back (&thread_all, &initial_thread->elem_all);
 
   thread_load_avg_fp = 0;
-
-  // if (thread_mlfqs) {
-  //   struct list temp_queue[64];
-  //   int i = 0;
-  //   for (i=0; i<64; i++) {
-  //     list_init(&(temp_queue[i]));
-  //   }
-  //   mlfqs_queue = temp_queue;
-  // }
 }
 
 /* Starts preemptive thread scheduling by enabling interrupts.
@@ -131,7 +261,7 @@ thread_start (void)
   /* Start preemptive thread scheduling. */
   intr_enable ();
 
-  /* Wait for the idle thread to initialize idle_thread. */
+  /* Wait for the idle thread to make itself cpus[0].idle. */
   sema_down (&idle_started);
 }
 
@@ -141,9 +271,10 @@ void
 thread_tick (void) 
 {
   struct thread *t = thread_current ();
+  struct cpu *c = t->cpu;
 
   /* Update statistics. */
-  if (t == idle_thread)
+  if (is_idle (t))
     idle_ticks++;
 #ifdef USERPROG
   else if (t->pagedir != NULL)
@@ -151,9 +282,33 @@ thread_tick (void)
 #endif
   else
     kernel_ticks++;
+  if (thread_mlfqs && !is_idle (t))
+    t->recent_cpu_fp = fadd_int (t->recent_cpu_fp, 1);
 
-  /* Enforce preemption. */
-  if (++thread_ticks >= TIME_SLICE)
+  /* Enforce preemption.  A real-time thread runs until it blocks
+     or runs out of budget.  An idle processor picks up any ready
+     thread that no reschedule IPI brought it. */
+  if (is_idle (t)) 
+    {
+      if (ready_cnt > 0)
+        intr_yield_on_return ();
+    }
+  else if (t->is_rt) 
+    {
+      if (--t->rt.remaining <= 0) 
+        {
+          t->rt.throttled = true;
+          t->rt.throttles++;
+          sched_stats.rt_throttles++;
+          intr_yield_on_return ();
+        }
+    }
+  else if (thread_fair) 
+    {
+      if (fair_tick (t))
+        intr_yield_on_return ();
+    }
+  else if (++c->thread_ticks >= TIME_SLICE)
     intr_yield_on_return ();
 }
 
@@ -161,8 +316,77 @@ thread_tick (void)
 void
 thread_print_stats (void) 
 {
+  struct list_elem *e;
+  int band;
+
   printf ("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n",
           idle_ticks, kernel_ticks, user_ticks);
+  printf ("Thread cache: %lld hits, %lld misses\n",
+          thread_cache_hits, thread_cache_misses);
+  printf ("Scheduler: %llu switches (%llu voluntary, %llu involuntary, "
+          "%llu preemptions), %llu wakeups, %llu donations\n",
+          sched_stats.switches, sched_stats.vol_switches,
+          sched_stats.invol_switches, sched_stats.preemptions,
+          sched_stats.wakeups, sched_stats.donations);
+  if (sched_stats.rt_jobs > 0)
+    printf ("EDF: %llu jobs, %llu deadline misses, %llu budget overruns, "
+            "%llu period overruns\n",
+            sched_stats.rt_jobs, sched_stats.rt_misses,
+            sched_stats.rt_throttles, sched_stats.rt_overruns);
+  if (!thread_schedstats)
+    return;
+
+  printf ("Wakeup latency (cycles, log2 buckets from 2^%d):\n",
+          SCHED_HIST_SHIFT);
+  for (band = SCHED_BANDS - 1; band >= 0; band--) 
+    {
+      printf ("  pri %2d-%2d:", band * SCHED_BAND_WIDTH,
+              (band + 1) * SCHED_BAND_WIDTH - 1);
+      print_latency_hist (sched_stats.latency_hist[band]);
+    }
+
+  printf ("%-16s %4s %3s %12s %12s %10s %7s %7s %7s %6s %6s\n",
+          "thread", "tid", "pri", "run", "wait", "max-lat", "wakeups",
+          "vol", "invol", "preempt", "donate");
+  for (e = list_begin (&thread_all); e != list_end (&thread_all);
+       e = list_next (e)) 
+    {
+      struct thread *t = list_entry (e, struct thread, elem_all);
+      struct sched_thread_stats *st = &t->sched_stats;
+      printf ("%-16s %4d %3d %12llu %12llu %10llu %7u %7u %7u %6u %6u\n",
+              t->name, t->tid, t->priority, st->run_time, st->wait_time,
+              st->max_latency, st->wakeups, st->vol_switches,
+              st->invol_switches, st->preemptions, st->donations);
+    }
+}
+
+/* Prints the nonzero part of latency histogram HIST. */
+static void
+print_latency_hist (const uint32_t hist[SCHED_HIST_BUCKETS]) 
+{
+  int last, i;
+
+  for (last = SCHED_HIST_BUCKETS - 1; last >= 0; last--)
+    if (hist[last] != 0)
+      break;
+  for (i = 0; i <= last; i++)
+    printf (" %u", hist[i]);
+  printf ("\n");
+}
+
+/* Copies the running thread's and the system's scheduler
+   statistics into *SS. */
+void
+thread_get_schedstat (struct schedstat *ss) 
+{
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  ss->thread = thread_current ()->sched_stats;
+  ss->thread.run_time += rdtsc () - thread_current ()->run_stamp;
+  ss->thread.rt_misses = thread_current ()->rt.misses;
+  ss->sys = sched_stats;
+  intr_set_level (old_level);
 }
 
 /* Creates a new kernel thread named NAME with the given initial
@@ -183,22 +407,140 @@ thread_print_stats (void)
 tid_t
 thread_create (const char *name, int priority,
                thread_func *function, void *aux) 
+{
+  return spawn_thread (name, priority, function, aux, NULL);
+}
+
+/* Creates a real-time kernel thread named NAME, scheduled
+   earliest-deadline-first, which executes FUNCTION passing AUX
+   as the argument.  A new job is released every PERIOD ticks,
+   starting now; each job may use up to BUDGET ticks of CPU time
+   and should finish, by calling thread_rt_wait_period(), within
+   DEADLINE ticks of its release.  Requires 0 < BUDGET <= DEADLINE
+   <= PERIOD.
+
+   Real-time threads run in preference to all other threads.  To
+   keep the system schedulable, creation fails, returning
+   TID_ERROR, if the total density BUDGET / DEADLINE of all
+   real-time threads would exceed RT_UTIL_MAX / RT_UTIL_SCALE. */
+tid_t
+thread_create_rt (const char *name, int64_t period, int64_t budget,
+                  int64_t deadline, thread_func *function, void *aux) 
+{
+  struct thread_rt rt;
+  enum intr_level old_level;
+  int density;
+  tid_t tid;
+
+  ASSERT (0 < budget && budget <= deadline && deadline <= period);
+
+  /* Admission control. */
+  density = rt_density (budget, period, deadline);
+  old_level = intr_disable ();
+  if (rt_utilization + density > RT_UTIL_MAX) 
+    {
+      intr_set_level (old_level);
+      return TID_ERROR;
+    }
+  rt_utilization += density;
+  intr_set_level (old_level);
+
+  memset (&rt, 0, sizeof rt);
+  rt.period = period;
+  rt.budget = budget;
+  rt.deadline = deadline;
+  tid = spawn_thread (name, PRI_MAX, function, aux, &rt);
+  if (tid == TID_ERROR) 
+    {
+      old_level = intr_disable ();
+      rt_utilization -= density;
+      intr_set_level (old_level);
+    }
+  return tid;
+}
+
+/* Completes the running real-time thread's oldest unfinished
+   job and blocks until the next one is released.  If a newer job
+   has already been released, because this one overran its
+   period, returns at once so that the thread can start on it.
+   rt_release() counted the overrun job's deadline miss when it
+   released the newer job. */
+void
+thread_rt_wait_period (void) 
+{
+  struct thread *cur = thread_current ();
+  struct thread_rt *rt = &cur->rt;
+  enum intr_level old_level;
+
+  ASSERT (cur->is_rt);
+
+  old_level = intr_disable ();
+  rt->completed++;
+  if (rt->completed < rt->jobs) 
+    {
+      rt->overruns++;
+      sched_stats.rt_overruns++;
+    }
+  else 
+    {
+      if (timer_ticks () > rt->abs_deadline) 
+        {
+          rt->misses++;
+          sched_stats.rt_misses++;
+        }
+      rt->waiting = true;
+      thread_block ();
+    }
+  intr_set_level (old_level);
+}
+
+/* Returns the number of deadlines that the running real-time
+   thread has missed. */
+unsigned
+thread_rt_misses (void) 
+{
+  return thread_current ()->rt.misses;
+}
+
+/* Does the work of thread_create() and thread_create_rt().  If
+   RT is nonnull, the new thread is a real-time thread with RT's
+   period, budget, and deadline. */
+static tid_t
+spawn_thread (const char *name, int priority,
+              thread_func *function, void *aux,
+              const struct thread_rt *rt) 
 {
   struct thread *t;
   struct kernel_thread_frame *kf;
   struct switch_entry_frame *ef;
   struct switch_threads_frame *sf;
+  enum intr_level old_level;
   tid_t tid;
 
   ASSERT (function != NULL);
 
-  /* Allocate thread. */
-  t = palloc_get_page (PAL_ZERO);
-  if (t == NULL)
-    return TID_ERROR;
+  /* Allocate thread, preferably from the cache. */
+  old_level = intr_disable ();
+  if (!list_empty (&thread_cache)) 
+    {
+      t = list_entry (list_pop_front (&thread_cache), struct thread, elem);
+      thread_cache_cnt--;
+      thread_cache_hits++;
+      intr_set_level (old_level);
+    }
+  else 
+    {
+      thread_cache_misses++;
+      intr_set_level (old_level);
+      t = palloc_get_page (PAL_ZERO | PAL_TAG (MEM_THREAD));
+      if (t == NULL)
+        return TID_ERROR;
+    }
 
-  /* Initialize thread. */
+  /* Initialize thread.  It starts out on its creator's run
+     queue. */
   init_thread (t, name, priority);
+  t->cpu = thread_cpu ();
   tid = t->tid = allocate_tid ();
   // sema_down(&t->process_lock);
 
@@ -216,7 +558,25 @@ thread_create (const char *name, int priority,
   sf = alloc_frame (t, sizeof *sf);
   sf->eip = switch_entry;
 
-  list_push_back(&thread_all, &t->elem_all);
+  /* The timer interrupt walks thread_all under MLFQS. */
+  old_level = intr_disable ();
+  list_push_back (&thread_all, &t->elem_all);
+  if (rt != NULL) 
+    {
+      /* Release the first job now. */
+      t->is_rt = true;
+      t->rt.period = rt->period;
+      t->rt.budget = rt->budget;
+      t->rt.deadline = rt->deadline;
+      t->rt.release = timer_ticks ();
+      t->rt.abs_deadline = t->rt.release + t->rt.deadline;
+      t->rt.remaining = t->rt.budget;
+      t->rt.jobs = 1;
+      sched_stats.rt_jobs++;
+      timer_event_init (&t->rt.release_timer, rt_release, t);
+      timer_event_arm (&t->rt.release_timer, t->rt.release + t->rt.period);
+    }
+  intr_set_level (old_level);
 
   /* Add to run queue. */
   thread_unblock (t);
@@ -239,6 +599,7 @@ thread_block (void)
   ASSERT (!intr_context ());
   ASSERT (intr_get_level () == INTR_OFF);
 
+  TRACE (TRACE_BLOCK, 0, 0, 0);
   thread_current ()->status = THREAD_BLOCKED;
   schedule ();
 }
@@ -260,67 +621,31 @@ thread_unblock (struct thread *t)
 
   old_level = intr_disable ();
   ASSERT (t->status == THREAD_BLOCKED);
-  // if (thread_mlfqs)
-  //   list_push_back(&mlfqs_queue[t->priority], &t->elem);
-  // else
   if (thread_mlfqs)
-    thread_nice_refresh_priority(t);
-  list_insert_ordered(&ready_list, &t->elem, thread_compare_priority, NULL);
-  // list_push_back (&ready_list, &t->elem);
+    {
+      mlfqs_catch_up (t);
+      thread_nice_refresh_priority (t);
+    }
+  if (thread_fair && t->vruntime < fair_min_vruntime - FAIR_SLEEPER_CREDIT)
+    t->vruntime = fair_min_vruntime - FAIR_SLEEPER_CREDIT;
+  ready_push (t);
   t->status = THREAD_READY;
+  t->ready_stamp = rdtsc ();
+  t->woken = true;
+  t->sched_stats.wakeups++;
+  sched_stats.wakeups++;
+  TRACE (TRACE_UNBLOCK, t->tid, t->priority, 0);
+  kick_cpu (t);
   intr_set_level (old_level);
 }
 
 void thread_check_priority (int priority) {
-  if (thread_current () == idle_thread) return;
+  if (is_idle (thread_current ())) return;
   if (priority > thread_get_priority ()) {
     thread_yield ();
   }
 }
 
-void thread_sleep(int64_t target_ticks)
-{
-  enum intr_level old_level;
-  old_level = intr_disable ();
-
-  struct thread_sleep_info info;
-  info.t = thread_current();
-  info.target_ticks = target_ticks;
-  list_insert_ordered(&sleep_list, &info.elem, thread_compare_sleep, NULL);
-  // list_push_back(&sleep_list, &info.elem);
-  thread_block();
-  
-  intr_set_level (old_level);
-}
-
-bool thread_compare_sleep(struct list_elem *e_a, struct list_elem *e_b) {
-  struct thread_sleep_info *t_a = list_entry(e_a, struct thread_sleep_info, elem);
-  struct thread_sleep_info *t_b = list_entry(e_b, struct thread_sleep_info, elem);
-  return t_a->target_ticks < t_b->target_ticks;
-}
-
-void thread_wake(struct thread_sleep_info *info)
-{
-  thread_unblock(info->t);
-  list_remove(&info->elem);
-}
-
-void thread_check_sleepers()
-{
-  struct list_elem *e, *next;
-  for (e = list_begin(&sleep_list); e != list_end(&sleep_list); e = next)
-  {
-    next = list_next(e);
-    struct thread_sleep_info *info = list_entry(e, struct thread_sleep_info, elem);
-    if (timer_ticks() >= info->target_ticks)
-    {
-      thread_wake(info);
-    } else {
-      break;
-    }
-  }
-}
-
 /* Returns the name of the running thread. */
 const char *
 thread_name (void) 
@@ -347,6 +672,13 @@ thread_current (void)
   return t;
 }
 
+/* Returns the processor that the running thread runs on. */
+struct cpu *
+thread_cpu (void) 
+{
+  return running_thread ()->cpu;
+}
+
 /* Returns the running thread's tid. */
 tid_t
 thread_tid (void) 
@@ -369,6 +701,14 @@ thread_exit (void)
      We will be destroyed during the call to schedule_tail(). */
   intr_disable ();
   sema_up(&thread_current()->process_lock);
+  if (thread_current ()->is_rt) 
+    {
+      struct thread_rt *rt = &thread_current ()->rt;
+      timer_event_cancel (&rt->release_timer);
+      rt_utilization -= rt_density (rt->budget, rt->period, rt->deadline);
+    }
+  if (mlfqs_cursor == &thread_current ()->elem_all)
+    mlfqs_cursor = list_next (mlfqs_cursor);
   list_remove(&thread_current()->elem_all);
   thread_current ()->status = THREAD_DYING;
   schedule ();
@@ -386,62 +726,96 @@ thread_yield (void)
   ASSERT (!intr_context ());
 
   old_level = intr_disable ();
-  if (curr != idle_thread) 
-    // list_push_back (&ready_list, &curr->elem);
-    
-    // if(thread_mlfqs)
-    //   list_push_back(&mlfqs_queue[curr->priority], &curr->elem);
-    // else
-      list_insert_ordered(&ready_list, &curr->elem, thread_compare_priority, NULL);
+  if (curr->is_rt && curr->rt.throttled) 
+    {
+      /* Out of budget: wait for rt_release(). */
+      curr->status = THREAD_BLOCKED;
+      schedule ();
+      intr_set_level (old_level);
+      return;
+    }
+  if (!is_idle (curr)) 
+    ready_push (curr);
   curr->status = THREAD_READY;
+  curr->ready_stamp = rdtsc ();
+  curr->woken = false;
   schedule ();
   intr_set_level (old_level);
 }
 
 struct semaphore*
 thread_get_process_lock(tid_t tid){
+  struct semaphore *process_lock = NULL;
+  enum intr_level old_level;
   struct list_elem *e;
 
+  old_level = intr_disable ();
   for (e=list_begin(&thread_all); e!=list_end(&thread_all); e=list_next(e)) {
     struct thread *t = list_entry(e, struct thread, elem_all);
-    if (t->tid == tid) return &t->process_lock;
+    if (t->tid == tid) {
+      process_lock = &t->process_lock;
+      break;
+    }
   }
+  intr_set_level (old_level);
 
   // maybe the thread had been already finished;;
-  return NULL;
+  return process_lock;
 }
 
+/* Returns the thread that owns the running thread's address
+   space, open files, and memory mappings: the running thread
+   itself, unless it is one of a process's additional user
+   threads. */
+struct thread *
+thread_process (void) 
+{
+  return thread_current ()->process;
+}
+
+/* Returns the priority of the highest-priority ready thread in
+   any processor's run queue, or PRI_MIN - 1 if no thread is
+   ready. */
 int
-thread_ready_max_priority () {
-  return list_entry(list_front(&ready_list), struct thread, elem)->priority;
+thread_ready_max_priority (void) {
+  int max = PRI_MIN - 1;
+  int i;
+
+  for (i = 0; i < cpu_cnt; i++) 
+    {
+      int priority = rq_max_priority (&cpus[i].rq);
+      if (priority > max)
+        max = priority;
+    }
+  return max;
 }
 
+/* Returns the highest priority of any thread waiting for a lock
+   that T holds, or PRI_MIN - 1 if there is none. */
 int
 thread_locks_max_priority (struct thread *t) {
-  struct list_elem *e;
-  int max_priority = -1;
-  for (e=list_begin(&t->holding_locks); e!=list_end(&t->holding_locks); e=list_next(e)) {
-    struct lock *lock = list_entry(e, struct lock, elem);
-    if(list_empty(&lock->semaphore.waiters)) continue;
-    int lock_max_priority = list_entry(list_front(&lock->semaphore.waiters), struct thread, elem)->priority;
-    if (max_priority < lock_max_priority) {
-      max_priority = lock_max_priority;
-    }
-  }
-  return max_priority;
+  if (rb_empty (&t->held_locks))
+    return PRI_MIN - 1;
+  return rb_entry (rb_min (&t->held_locks), struct lock, elem)->max_priority;
 }
 
 /* Sets the current thread's priority to NEW_PRIORITY. */
 void
 thread_set_priority (int new_priority) 
 {
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  int locks_max_priority;
+
   if (thread_mlfqs) return;
 
-  int locks_max_priority = thread_locks_max_priority(thread_current());
-  if (locks_max_priority < new_priority)
-    thread_current ()->priority = new_priority;
-  thread_current ()->orig_priority = new_priority;
-  if (!list_empty(&ready_list))
+  old_level = intr_disable ();
+  cur->orig_priority = new_priority;
+  locks_max_priority = thread_locks_max_priority (cur);
+  thread_update_priority (cur, locks_max_priority > new_priority
+                               ? locks_max_priority : new_priority);
+  intr_set_level (old_level);
+  if (ready_cnt > 0)
     thread_check_priority(thread_ready_max_priority ());
 }
 
@@ -459,99 +833,108 @@ bool thread_compare_priority(struct list_elem *e_a, struct list_elem *e_b) {
 }
 
 int thread_ready_count() {
-  int count = list_size(&ready_list);
-  if (thread_current() != idle_thread) count++;
+  int count = ready_cnt;
+  int i;
+
+  for (i = 0; i < cpu_cnt; i++)
+    if (cpus[i].curr != NULL && !is_idle (cpus[i].curr))
+      count++;
   return count;
 }
 
+/* Does the MLFQS bookkeeping for timer tick TICKS.  Called by
+   the timer interrupt handler, so it runs in an external
+   interrupt context.  Takes constant time. */
 void
-thread_refresh_mlfqs(int64_t ticks) {
-  if (thread_current() != idle_thread)
-    thread_current()->recent_cpu_fp = fadd_int(thread_current()->recent_cpu_fp, 1);
-  if (ticks%100 == 0) {
-    thread_all_refresh_recent_cpu();
-    thread_refresh_load_avg();
-  }
-  if (ticks%4 == 0) {
-    thread_nice_all_refresh_priority();
-  }
-}
+thread_refresh_mlfqs (int64_t ticks) 
+{
+  struct thread *cur = thread_current ();
 
-struct thread *thread_mlfqs_pop() {
-  int i=0;
-  for (i=63; i>=0; i--) {
-    struct list *queue = &mlfqs_queue[i];
-    if(!list_empty(queue)) {
-      return list_entry(list_pop_front(queue), struct thread, elem);
+  if (ticks % 100 == 0) 
+    {
+      /* Start a new epoch.  Only the running thread is decayed
+         now; everyone else catches up later. */
+      fp load_twice = fmul_int (thread_load_avg_fp, 2);
+      mlfqs_decay[++mlfqs_epoch % MLFQS_EPOCH_HISTORY]
+        = fdiv (load_twice, fadd_int (load_twice, 1));
+      mlfqs_catch_up (cur);
+      thread_refresh_load_avg ();
     }
-  }
-  return NULL;
-}
 
-void
-thread_refresh_load_avg() {
-  // printf("load avg was=%d / ", fp_to_int_nearest(thread_load_avg_fp));
-  // printf("avg was=%d, multiplied avg=%d / ", fp_to_int_nearest(thread_load_avg_fp), fp_to_int_nearest(fmul(thread_load_avg_fp, fdiv_int(int_to_fp(59), 60))));
-  // printf("thread_count=%d, ready count=%d / ", thread_ready_count(), fp_to_int_nearest(fmul_int(fdiv_int(int_to_fp(1), 60), thread_ready_count())));
-  thread_load_avg_fp = fadd(fmul(thread_load_avg_fp, fdiv_int(int_to_fp(59), 60)), fmul_int(fdiv_int(int_to_fp(1), 60), thread_ready_count()));
+  mlfqs_sweep ();
 
-  // printf("load avg is now=%d \n", fp_to_int_nearest(thread_load_avg_fp));
-}
+  /* The running thread is the only one whose recent_cpu changes
+     between epochs. */
+  if (ticks % 4 == 0 && !is_idle (cur))
+    thread_nice_refresh_priority (cur);
 
-void
-thread_all_refresh_recent_cpu() {
-  struct list_elem *e;
-  for (e=list_begin(&ready_list); e!=list_end(&ready_list); e=list_next(e)) {
-    thread_refresh_recent_cpu(list_entry(e, struct thread, elem));
-  }
-  
-  for (e=list_begin(&sleep_list); e!=list_end(&sleep_list); e=list_next(e)) {
-    thread_refresh_recent_cpu(list_entry(e, struct thread_sleep_info, elem)->t);
-  }
-  if (thread_current() != idle)
-    thread_refresh_recent_cpu(thread_current());
+  if (!is_idle (cur) && ready_cnt > 0
+      && cur->priority < thread_ready_max_priority ())
+    intr_yield_on_return ();
 }
 
-void
-thread_refresh_recent_cpu(struct thread *t) {
-  fp decay_fp = fdiv(fmul_int(thread_load_avg_fp, 2), fadd_int(fmul_int(thread_load_avg_fp, 2), 1));
-  fp load_twice = fmul_int(thread_load_avg_fp, 2);
-  // printf("%s: prev recent cpu=%d; load twice=%d / ", t->name, fp_to_int_nearest(t->recent_cpu_fp), fp_to_int_nearest(load_twice));
-  // fp recent_cpu_off = fdiv(fmul(t->recent_cpu_fp, load_twice), fadd_int(load_twice, 1));
-  fp recent_cpu_off = fmul(t->recent_cpu_fp, fdiv(load_twice, fadd_int(load_twice, 1)));
-  // printf("middle value=%d, %d /", fp_to_int_nearest(fmul(t->recent_cpu_fp, load_twice)), fp_to_int_nearest(load_twice));
-  t->recent_cpu_fp = fadd_int(recent_cpu_off, t->nice);
-  // printf("%d, recent_cpu=%d\n", 
-  //   fp_to_int_nearest(recent_cpu_off * 100),
-  //   fp_to_int_nearest(t->recent_cpu_fp));
+static void
+thread_refresh_load_avg (void) {
+  thread_load_avg_fp = fadd(fmul(thread_load_avg_fp, fdiv_int(int_to_fp(59), 60)), fmul_int(fdiv_int(int_to_fp(1), 60), thread_ready_count()));
 }
 
-void
-thread_nice_all_refresh_priority() {
-  struct list_elem *e;
-  
-  for (e=list_begin(&ready_list); e!=list_end(&ready_list); e=list_next(e)) {
-    thread_nice_refresh_priority(list_entry(e, struct thread, elem));
-  }
+/* Applies to T's recent_cpu the decay of every epoch that T has
+   missed.  Returns true if anything changed, in which case the
+   caller should recompute T's priority. */
+static bool
+mlfqs_catch_up (struct thread *t) 
+{
+  int64_t epoch = t->recent_cpu_epoch;
 
-  if (thread_current() != idle_thread)
-    thread_nice_refresh_priority(thread_current());
+  ASSERT (intr_get_level () == INTR_OFF);
 
-  list_sort(&ready_list, thread_compare_priority, NULL);
+  if (epoch == mlfqs_epoch || is_idle (t))
+    return false;
+
+  /* If T has missed more epochs than we remember, pretend that
+     the oldest remembered factor applied to the earlier ones;
+     by then T's old recent_cpu hardly matters. */
+  for (; epoch < mlfqs_epoch - MLFQS_EPOCH_HISTORY; epoch++)
+    t->recent_cpu_fp = fadd_int (fmul (t->recent_cpu_fp,
+                                       mlfqs_decay[(mlfqs_epoch + 1) % MLFQS_EPOCH_HISTORY]),
+                                 t->nice);
+  for (; epoch < mlfqs_epoch; epoch++)
+    t->recent_cpu_fp = fadd_int (fmul (t->recent_cpu_fp,
+                                       mlfqs_decay[(epoch + 1) % MLFQS_EPOCH_HISTORY]),
+                                 t->nice);
+  t->recent_cpu_epoch = mlfqs_epoch;
+  return true;
+}
 
+/* Brings the next MLFQS_SWEEP_BATCH threads in thread_all up to
+   date, so that threads that stay blocked or ready for a long
+   time do not fall too far behind. */
+static void
+mlfqs_sweep (void) 
+{
+  int i;
 
-  if (!list_empty(&ready_list) && thread_get_priority() < thread_ready_max_priority())
-    if (intr_context()) intr_yield_on_return();
-    else thread_yield();
+  for (i = 0; i < MLFQS_SWEEP_BATCH; i++) 
+    {
+      struct thread *t;
+
+      if (mlfqs_cursor == NULL || mlfqs_cursor == list_end (&thread_all))
+        mlfqs_cursor = list_begin (&thread_all);
+      t = list_entry (mlfqs_cursor, struct thread, elem_all);
+      mlfqs_cursor = list_next (mlfqs_cursor);
+      if (mlfqs_catch_up (t))
+        thread_nice_refresh_priority (t);
+    }
 }
 
-void
+static void
 thread_nice_refresh_priority(struct thread *t) {
-  t->priority = PRI_MAX - fp_to_int_nearest(fdiv_int(t->recent_cpu_fp, 4)) - (t->nice*2);
+  int priority = PRI_MAX - fp_to_int_nearest(fdiv_int(t->recent_cpu_fp, 4)) - (t->nice*2);
 
   // adjust range
-  if (t->priority < PRI_MIN) t->priority = PRI_MIN;
-  else if (t->priority > PRI_MAX) t->priority = PRI_MAX;
+  if (priority < PRI_MIN) priority = PRI_MIN;
+  else if (priority > PRI_MAX) priority = PRI_MAX;
+  thread_update_priority (t, priority);
 
   // printf("%s: p=%d, n=%d\n", t->name, t->priority, fp_to_int_nearest(fdiv_int(t->recent_cpu_fp, 4)));
 }
@@ -560,13 +943,13 @@ thread_nice_refresh_priority(struct thread *t) {
 void
 thread_set_nice (int nice) 
 {
-  /* Not yet implemented. */
-  thread_current()->nice = nice;
+  enum intr_level old_level;
 
-  thread_refresh_recent_cpu(thread_current());
-  thread_nice_refresh_priority(thread_current());
-  
-  list_sort(&ready_list, thread_compare_priority, NULL);
+  old_level = intr_disable ();
+  thread_current()->nice = nice;
+  if (thread_mlfqs)
+    thread_nice_refresh_priority(thread_current());
+  intr_set_level (old_level);
   
   // if (!list_empty(&ready_list) && thread_get_priority() < thread_ready_max_priority())
   //   thread_yield();
@@ -597,54 +980,96 @@ thread_get_recent_cpu (void)
 }
 
 bool thread_is_executables (char *file_name) {
+  enum intr_level old_level;
   struct list_elem *e;
+  bool found = false;
 
+  old_level = intr_disable ();
   for (e=list_begin(&thread_all); e!=list_end(&thread_all); e=list_next(e)) {
     struct thread *t = list_entry(e, struct thread, elem_all);
-    if (strcmp(t->executable_name, file_name) == 0) return true;
+    if (strcmp(t->executable_name, file_name) == 0) {
+      found = true;
+      break;
+    }
   }
+  intr_set_level (old_level);
 
-  return false;
+  return found;
 }
 
-/* Idle thread.  Executes when no other thread is ready to run.
+/* Idle thread of the bootstrap processor.  Executes when no
+   other thread is ready to run.
 
    The idle thread is initially put on the ready list by
    thread_start().  It will be scheduled once initially, at which
-   point it initializes idle_thread, "up"s the semaphore passed
+   point it makes itself cpus[0].idle, "up"s the semaphore passed
    to it to enable thread_start() to continue, and immediately
    blocks.  After that, the idle thread never appears in the
    ready list.  It is returned by next_thread_to_run() as a
-   special case when the ready list is empty. */
+   special case when the ready list is empty.  The application
+   processors' idle threads are set up by thread_start_ap(). */
 static void
 idle (void *idle_started_ UNUSED) 
 {
   struct semaphore *idle_started = idle_started_;
-  idle_thread = thread_current ();
+
+  ASSERT (thread_cpu ()->bsp);
+  thread_cpu ()->idle = thread_current ();
   sema_up (idle_started);
+  idle_loop ();
+}
+
+/* Turns the code running on application processor C, on the
+   kernel stack that smp_init() gave it, into C's idle thread, and
+   starts scheduling threads on C.  Interrupts must be off. */
+void
+thread_start_ap (struct cpu *c) 
+{
+  struct thread *t = running_thread ();
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (!c->bsp);
+
+  init_thread (t, "idle", PRI_MIN);
+  t->cpu = c;
+  intr_start_ap ();
+
+  t->status = THREAD_RUNNING;
+  t->tid = allocate_tid ();
+  t->run_stamp = rdtsc ();
+  list_push_back (&thread_all, &t->elem_all);
+  c->idle = c->curr = t;
+  idle_loop ();
+}
 
+/* Body of every processor's idle thread. */
+static void
+idle_loop (void) 
+{
   for (;;) 
     {
       /* Let someone else run. */
       intr_disable ();
       thread_block ();
 
-      /* Re-enable interrupts and wait for the next one.
+      /* In tickless mode, sleep until the next timer event
+         instead of the next tick.  Only the bootstrap processor
+         has the PIT. */
+      if (thread_cpu ()->bsp)
+        timer_idle_enter ();
 
-         The `sti' instruction disables interrupts until the
-         completion of the next instruction, so these two
-         instructions are executed atomically.  This atomicity is
-         important; otherwise, an interrupt could be handled
-         between re-enabling interrupts and waiting for the next
-         one to occur, wasting as much as one clock tick worth of
-         time.
-
-         See [IA32-v2a] "HLT", [IA32-v2b] "STI", and [IA32-v3a]
-         7.11.1 "HLT Instruction". */
-      asm volatile ("sti; hlt" : : : "memory");
+      /* Re-enable interrupts and wait for the next one. */
+      intr_idle ();
     }
 }
 
+/* Returns true if T is the idle thread of its processor. */
+static bool
+is_idle (const struct thread *t) 
+{
+  return t->cpu != NULL && t == t->cpu->idle;
+}
+
 /* Function used as the basis for a kernel thread. */
 static void
 kernel_thread (thread_func *function, void *aux) 
@@ -706,10 +1131,14 @@ init_thread (struct thread *t, const char *name, int priority)
 
   t->nice = 0;
   t->recent_cpu_fp = 0;
+  t->recent_cpu_epoch = mlfqs_epoch;
+  t->vruntime = fair_min_vruntime;
 
-  list_init(&t->holding_locks);
+  rb_init (&t->held_locks, lock_compare_max_priority, NULL);
+  t->process = t;
+  sema_init (&t->uthread_exited, 0);
   list_init(&t->spage_table);
-  lock_init(&t->spt_lock);
+  rwlock_init (&t->spt_lock, RWLOCK_PREFER_WRITERS);
 }
 
 /* Allocates a SIZE-byte frame at the top of thread T's stack and
@@ -726,25 +1155,437 @@ alloc_frame (struct thread *t, size_t size)
 }
 
 /* Chooses and returns the next thread to be scheduled.  Should
-   return a thread from the run queue, unless the run queue is
+   return a thread from a run queue, unless every run queue is
    empty.  (If the running thread can continue running, then it
-   will be in the run queue.)  If the run queue is empty, return
-   idle_thread. */
+   will be in a run queue.)  If every run queue is empty, return
+   the running processor's idle thread. */
 static struct thread *
 next_thread_to_run (void) 
 {
-  // if (!thread_mlfqs) {
-    if (list_empty (&ready_list))
-      return idle_thread;
-    else {
-      struct thread *next_thread = list_entry(list_pop_front(&ready_list), struct thread, elem);
-      return next_thread;
+  struct thread *next;
+
+  if (ready_cnt == 0)
+    return thread_cpu ()->idle;
+  next = ready_pop ();
+  if (thread_fair)
+    fair_update_min_vruntime (next);
+  return next;
+}
+
+/* Appends ready thread T to the list for its priority in the run
+   queue of its processor.  Interrupts must be off. */
+static void
+ready_push (struct thread *t) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (PRI_MIN <= t->priority && t->priority <= PRI_MAX);
+
+  if (t->is_rt)
+    rb_insert (&edf_tree, &t->rt.node);
+  else if (thread_fair) 
+    {
+      rb_insert (&fair_tree, &t->fair_node);
+      fair_ready_weight += fair_weight (t);
+    }
+  else 
+    {
+      struct run_queue *rq = &t->cpu->rq;
+      list_push_back (&rq->queues[t->priority], &t->elem);
+      rq->bitmap[t->priority / 32] |= 1u << (t->priority % 32);
+      rq->cnt++;
+    }
+  ready_cnt++;
+}
+
+/* Removes and returns the first thread in the highest-priority
+   nonempty list of the run queue chosen by pick_queue(), which
+   must exist.  Interrupts must be off. */
+static struct thread *
+ready_pop (void) 
+{
+  struct cpu *self = thread_cpu ();
+  struct run_queue *rq;
+  struct thread *t;
+  int priority;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!rb_empty (&edf_tree)) 
+    {
+      t = rb_entry (rb_min (&edf_tree), struct thread, rt.node);
+      rb_remove (&edf_tree, &t->rt.node);
+      ready_cnt--;
+      return t;
+    }
+  if (thread_fair) 
+    {
+      t = rb_entry (rb_min (&fair_tree), struct thread, fair_node);
+      rb_remove (&fair_tree, &t->fair_node);
+      fair_ready_weight -= fair_weight (t);
+      ready_cnt--;
+      return t;
+    }
+
+  rq = pick_queue (self);
+  priority = rq_max_priority (rq);
+  ASSERT (priority >= PRI_MIN);
+  t = list_entry (list_pop_front (&rq->queues[priority]),
+                  struct thread, elem);
+  if (list_empty (&rq->queues[priority]))
+    rq->bitmap[priority / 32] &= ~(1u << (priority % 32));
+  rq->cnt--;
+  ready_cnt--;
+  if (rq != &self->rq)
+    self->steals++;
+  return t;
+}
+
+/* Removes ready thread T from its run queue.  T's priority must
+   not have changed since it was pushed.  Interrupts must be
+   off. */
+static void
+ready_remove (struct thread *t) 
+{
+  struct run_queue *rq;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (t->status == THREAD_READY);
+
+  if (t->is_rt) 
+    {
+      rb_remove (&edf_tree, &t->rt.node);
+      ready_cnt--;
+      return;
+    }
+  if (thread_fair) 
+    {
+      rb_remove (&fair_tree, &t->fair_node);
+      fair_ready_weight -= fair_weight (t);
+      ready_cnt--;
+      return;
+    }
+
+  list_remove (&t->elem);
+  rq = &t->cpu->rq;
+  if (list_empty (&rq->queues[t->priority]))
+    rq->bitmap[t->priority / 32] &= ~(1u << (t->priority % 32));
+  rq->cnt--;
+  ready_cnt--;
+}
+
+/* Initializes RQ as an empty run queue. */
+static void
+rq_init (struct run_queue *rq) 
+{
+  int i;
+
+  for (i = PRI_MIN; i <= PRI_MAX; i++)
+    list_init (&rq->queues[i]);
+  rq->cnt = 0;
+}
+
+/* Returns the priority of the highest-priority thread in RQ, or
+   PRI_MIN - 1 if RQ is empty. */
+static int
+rq_max_priority (const struct run_queue *rq) 
+{
+  if (rq->bitmap[1] != 0)
+    return 32 + 31 - __builtin_clz (rq->bitmap[1]);
+  if (rq->bitmap[0] != 0)
+    return 31 - __builtin_clz (rq->bitmap[0]);
+  return PRI_MIN - 1;
+}
+
+/* Returns the run queue from which processor SELF should take its
+   next thread: the one whose first thread has the highest
+   priority.  Among equals, SELF's own queue wins, then the
+   longest.  Interrupts must be off. */
+static struct run_queue *
+pick_queue (struct cpu *self) 
+{
+  struct run_queue *best = &self->rq;
+  int best_priority = rq_max_priority (best);
+  int i;
+
+  for (i = 0; i < cpu_cnt; i++) 
+    {
+      struct run_queue *rq = &cpus[i].rq;
+      int priority = rq_max_priority (rq);
+
+      if (rq == &self->rq || priority < best_priority)
+        continue;
+      if (priority > best_priority
+          || (best != &self->rq && rq->cnt > best->cnt)) 
+        {
+          best = rq;
+          best_priority = priority;
+        }
+    }
+  return best;
+}
+
+/* Returns the priority of the thread running on processor C, or
+   PRI_MIN - 1 if C is idle. */
+static int
+running_priority (const struct cpu *c) 
+{
+  return is_idle (c->curr) ? PRI_MIN - 1 : c->curr->priority;
+}
+
+/* T has just become ready.  If the processor running the
+   lowest-priority thread is another one, and that thread's
+   priority is lower than T's, sends it a reschedule IPI, so that
+   T runs without waiting for a time slice to end.  The running
+   processor wins ties, since its caller decides whether to yield
+   to T.  Interrupts must be off. */
+static void
+kick_cpu (struct thread *t) 
+{
+  struct cpu *self = thread_cpu ();
+  struct cpu *target = NULL;
+  int target_priority = PRI_MAX + 1;
+  int i;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (smp_online_cnt () == 1)
+    return;
+
+  for (i = 0; i < cpu_cnt; i++) 
+    {
+      struct cpu *c = &cpus[i];
+      int priority;
+
+      if (c->idle == NULL || c->kicked)
+        continue;
+      priority = running_priority (c);
+      if (priority < target_priority
+          || (priority == target_priority && c == self)) 
+        {
+          target = c;
+          target_priority = priority;
+        }
+    }
+  if (target != NULL && target != self && target_priority < t->priority) 
+    {
+      target->kicked = true;
+      smp_resched (target);
+    }
+}
+
+/* Sets T's effective priority to PRIORITY.  If T is on a run
+   queue, it moves to the back of the queue for its new
+   priority; if T is waiting on a semaphore, it is repositioned
+   among the waiters, which may pass the change on to the holder
+   of the lock that T is acquiring. */
+void
+thread_update_priority (struct thread *t, int priority) 
+{
+  enum intr_level old_level;
+
+  ASSERT (is_thread (t));
+  ASSERT (PRI_MIN <= priority && priority <= PRI_MAX);
+
+  if (t->priority == priority)
+    return;
+
+  old_level = intr_disable ();
+  if (t->status == THREAD_READY && !is_idle (t)) 
+    {
+      ready_remove (t);
+      t->priority = priority;
+      fair_boost_donee (t);
+      ready_push (t);
+    }
+  else 
+    {
+      t->priority = priority;
+      fair_boost_donee (t);
+    }
+  if (t->waiting_sema != NULL)
+    sema_reorder_waiter (t);
+  intr_set_level (old_level);
+}
+
+/* Returns the fair-share scheduling weight of T.  Priority
+   donated to T counts as that many steps of lower nice. */
+static int
+fair_weight (const struct thread *t) 
+{
+  int nice = t->nice;
+
+  if (t->priority > t->orig_priority)
+    nice -= t->priority - t->orig_priority;
+
+  if (nice < -20)
+    nice = -20;
+  else if (nice > 20)
+    nice = 20;
+  return fair_weights[nice + 20];
+}
+
+/* Under the fair-share scheduler, moves T, which must not be in
+   fair_tree, forward to fair_min_vruntime if it has just been
+   donated priority but has run further ahead than that. */
+static void
+fair_boost_donee (struct thread *t) 
+{
+  if (thread_fair && !is_idle (t) && t->priority > t->orig_priority
+      && t->vruntime > fair_min_vruntime)
+    t->vruntime = fair_min_vruntime;
+}
+
+/* Orders threads in fair_tree by ascending vruntime. */
+static bool
+fair_less (const struct rb_node *a_, const struct rb_node *b_,
+           void *aux UNUSED) 
+{
+  const struct thread *a = rb_entry (a_, struct thread, fair_node);
+  const struct thread *b = rb_entry (b_, struct thread, fair_node);
+
+  return a->vruntime < b->vruntime;
+}
+
+/* Advances fair_min_vruntime to the least vruntime among the
+   ready threads and CUR, the thread that is running or about to
+   run, but never moves it backward. */
+static void
+fair_update_min_vruntime (struct thread *cur) 
+{
+  int64_t min = fair_min_vruntime;
+  bool any = false;
+
+  if (!is_idle (cur)) 
+    {
+      min = cur->vruntime;
+      any = true;
     }
-  // } else {
-  //   struct thread *next_thread = thread_mlfqs_pop();
-  //   if (next_thread == NULL) return idle_thread;
-  //   else return next_thread;
-  // }
+  if (!rb_empty (&fair_tree)) 
+    {
+      struct thread *left = rb_entry (rb_min (&fair_tree),
+                                      struct thread, fair_node);
+      if (!any || left->vruntime < min)
+        min = left->vruntime;
+    }
+  if (min > fair_min_vruntime)
+    fair_min_vruntime = min;
+}
+
+/* Charges running thread T for a timer tick under the fair-share
+   scheduler.  Returns true if T should yield, either because its
+   slice is used up or because the leftmost ready thread has
+   fallen too far behind it. */
+static bool
+fair_tick (struct thread *t) 
+{
+  int weight = fair_weight (t);
+  int latency = FAIR_LATENCY;
+  int slice;
+
+  t->vruntime += FAIR_TICK_VRUNTIME * FAIR_NICE_0_WEIGHT / weight;
+  fair_update_min_vruntime (t);
+  if (rb_empty (&fair_tree))
+    return false;
+
+  /* Stretch the latency so that each thread gets at least one
+     tick. */
+  if (latency < ready_cnt + 1)
+    latency = ready_cnt + 1;
+  slice = latency * weight / (fair_ready_weight + weight);
+  if (slice < 1)
+    slice = 1;
+  if (++t->cpu->thread_ticks >= (unsigned) slice)
+    return true;
+
+  return (rb_entry (rb_min (&fair_tree), struct thread, fair_node)->vruntime
+          + FAIR_WAKEUP_GRAN < t->vruntime);
+}
+
+/* Orders threads in edf_tree by ascending absolute deadline. */
+static bool
+edf_less (const struct rb_node *a_, const struct rb_node *b_,
+          void *aux UNUSED) 
+{
+  const struct thread *a = rb_entry (a_, struct thread, rt.node);
+  const struct thread *b = rb_entry (b_, struct thread, rt.node);
+
+  return a->rt.abs_deadline < b->rt.abs_deadline;
+}
+
+/* Returns the share of the CPU, in 1/RT_UTIL_SCALE units, that a
+   real-time thread with the given BUDGET, PERIOD, and DEADLINE
+   may demand.  With DEADLINE < PERIOD, this is its density
+   BUDGET / DEADLINE, which is conservative. */
+static int
+rt_density (int64_t budget, int64_t period UNUSED, int64_t deadline) 
+{
+  return (budget * RT_UTIL_SCALE + deadline - 1) / deadline;
+}
+
+/* Timer event function that releases the next job of real-time
+   thread T_.  Runs in the timer interrupt handler. */
+static void
+rt_release (void *t_) 
+{
+  struct thread *t = t_;
+  struct thread_rt *rt = &t->rt;
+  bool ready = t->status == THREAD_READY;
+
+  /* A job that is still unfinished at the next release has
+     missed its deadline. */
+  if (rt->completed < rt->jobs) 
+    {
+      rt->misses++;
+      sched_stats.rt_misses++;
+    }
+
+  if (ready)
+    ready_remove (t);
+  rt->release += rt->period;
+  rt->abs_deadline = rt->release + rt->deadline;
+  rt->remaining = rt->budget;
+  rt->jobs++;
+  sched_stats.rt_jobs++;
+  timer_event_arm (&rt->release_timer, rt->release + rt->period);
+
+  if (ready)
+    ready_push (t);
+  else if (rt->throttled || rt->waiting) 
+    {
+      rt->throttled = rt->waiting = false;
+      if (t->status == THREAD_BLOCKED)
+        thread_unblock (t);
+    }
+  rt_check_preempt (t);
+}
+
+/* Arranges for the running thread to be preempted on return
+   from the current interrupt if real-time thread T, which may
+   have just become ready, should run instead. */
+static void
+rt_check_preempt (struct thread *t) 
+{
+  struct thread *cur = thread_current ();
+
+  if (t->status != THREAD_READY || cur == t)
+    return;
+  if (is_idle (cur) || !cur->is_rt
+      || t->rt.abs_deadline < cur->rt.abs_deadline)
+    intr_yield_on_return ();
+}
+
+/* Raises T's priority to PRIORITY on behalf of a thread waiting
+   for a lock that T holds, and counts the donation. */
+void
+thread_donate_priority (struct thread *t, int priority) 
+{
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  t->sched_stats.donations++;
+  sched_stats.donations++;
+  thread_update_priority (t, priority);
+  intr_set_level (old_level);
 }
 
 /* Completes a thread switch by activating the new thread's page
@@ -772,9 +1613,33 @@ schedule_tail (struct thread *prev)
 
   /* Mark us as running. */
   curr->status = THREAD_RUNNING;
+  if (thread_mlfqs && mlfqs_catch_up (curr))
+    thread_nice_refresh_priority (curr);
+
+  /* Account for the time spent waiting to run. */
+  curr->run_stamp = rdtsc ();
+  if (!is_idle (curr)) 
+    {
+      uint64_t wait = curr->run_stamp - curr->ready_stamp;
+      curr->sched_stats.wait_time += wait;
+      if (curr->woken) 
+        {
+          int band = curr->priority / SCHED_BAND_WIDTH;
+          int bucket = 0;
+
+          while (bucket < SCHED_HIST_BUCKETS - 1
+                 && wait >> (SCHED_HIST_SHIFT + bucket) != 0)
+            bucket++;
+          sched_stats.latency_hist[band][bucket]++;
+          if (wait > curr->sched_stats.max_latency)
+            curr->sched_stats.max_latency = wait;
+          curr->woken = false;
+        }
+    }
 
   /* Start new time slice. */
-  thread_ticks = 0;
+  curr->cpu->curr = curr;
+  curr->cpu->thread_ticks = 0;
 
 #ifdef USERPROG
   /* Activate the new address space. */
@@ -789,7 +1654,24 @@ schedule_tail (struct thread *prev)
   if (prev != NULL && prev->status == THREAD_DYING && prev != initial_thread) 
     {
       ASSERT (prev != curr);
-      palloc_free_page (prev);
+
+      /* Keep the page for the next thread_create() if there is
+         room.  Otherwise free it from a worker, outside this
+         interrupts-off window, once the system work queue is
+         running. */
+      if (thread_cache_cnt < THREAD_CACHE_MAX) 
+        {
+          prev->magic = 0;
+          list_push_front (&thread_cache, &prev->elem);
+          thread_cache_cnt++;
+        }
+      else if (system_wq.name != NULL) 
+        {
+          work_init (&prev->reap_work, palloc_free_page, prev);
+          work_queue (&system_wq, &prev->reap_work);
+        }
+      else
+        palloc_free_page (prev);
     }
 }
 
@@ -806,31 +1688,85 @@ schedule (void)
   struct thread *curr = running_thread ();
   struct thread *next = next_thread_to_run ();
   struct thread *prev = NULL;
+  struct cpu *c = curr->cpu;
 
   ASSERT (intr_get_level () == INTR_OFF);
   ASSERT (curr->status != THREAD_RUNNING);
   ASSERT (is_thread (next));
 
-  if (curr != next)
-    prev = switch_threads (curr, next);
+  /* NEXT may have been queued on another processor. */
+  next->cpu = c;
+  c->kicked = false;
+
+  curr->sched_stats.run_time += rdtsc () - curr->run_stamp;
+  if (curr != next) 
+    {
+      sched_stats.switches++;
+      if (curr->status == THREAD_BLOCKED) 
+        {
+          curr->sched_stats.vol_switches++;
+          sched_stats.vol_switches++;
+        }
+      else if (curr->status == THREAD_READY) 
+        {
+          curr->sched_stats.invol_switches++;
+          sched_stats.invol_switches++;
+          if (next->priority > curr->priority) 
+            {
+              curr->sched_stats.preemptions++;
+              sched_stats.preemptions++;
+            }
+        }
+      TRACE (TRACE_SWITCH, curr->tid, next->tid, curr->status);
+      prev = switch_threads (curr, next);
+    }
   schedule_tail (prev); 
 
   // printf("thread sch %s\n", thread_name(), thread_ready_count());
 }
 
-/* Returns a tid to use for a new thread. */
+/* Returns a tid to use for a new thread.  Tids are never
+   reused, because wait() identifies children by tid.  A brief
+   interrupts-off window is cheaper than a lock here. */
 static tid_t
 allocate_tid (void) 
 {
   static tid_t next_tid = 1;
+  enum intr_level old_level;
   tid_t tid;
 
-  lock_acquire (&tid_lock);
+  old_level = intr_disable ();
   tid = next_tid++;
-  lock_release (&tid_lock);
+  intr_set_level (old_level);
 
   return tid;
 }
+
+/* Returns a child_status record, or a null pointer if memory is
+   exhausted.  Its `sema_start' is initialized to 0; its other
+   members are unspecified. */
+struct child_status *
+thread_alloc_child_status (void) 
+{
+  return kmem_cache_alloc_caller (&child_status_cache, MEM_CALLER);
+}
+
+/* Releases CSTAT, which must not be on any list.  Its
+   `sema_start' must be back at 0, with no waiters. */
+void
+thread_free_child_status (struct child_status *cstat) 
+{
+  kmem_cache_free (&child_status_cache, cstat);
+}
+
+/* Constructor for child_status records. */
+static void
+child_status_ctor (void *cstat_) 
+{
+  struct child_status *cstat = cstat_;
+
+  sema_init (&cstat->sema_start, 0);
+}
 
 /* Offset of `stack' member within `struct thread'.
    Used by switch.S, which can't figure it out on its own. */
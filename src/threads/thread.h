@@ -3,9 +3,13 @@
 
 #include <debug.h>
 #include <list.h>
+#include <rbtree.h>
+#include <schedstat.h>
 #include <stdint.h>
+#include "devices/timer.h"
 #include "fixed_pointer.h"
 #include "synch.h"
+#include "workqueue.h"
 
 /* States in a thread's life cycle. */
 enum thread_status
@@ -20,6 +24,7 @@ struct child_status {
   int parent_pid;
   int child_pid;
   int exit_status;
+  bool is_thread;               /* User thread, not a child process? */
   struct semaphore sema_start;
   struct list_elem elem;
 };
@@ -33,6 +38,51 @@ typedef int tid_t;
 #define PRI_DEFAULT 31                  /* Default priority. */
 #define PRI_MAX 63                      /* Highest priority. */
 
+/* Run queue of a processor, for threads in THREAD_READY state
+   that are scheduled by priority, that is, ready to run but not
+   actually running.  There is one FIFO list per priority level,
+   and bit P of BITMAP is set if and only if QUEUES[P] is
+   nonempty, so that the highest-priority ready thread can be
+   found without scanning. */
+struct run_queue
+  {
+    struct list queues[PRI_MAX + 1];
+    uint32_t bitmap[(PRI_MAX + 32) / 32];
+    int cnt;                            /* # of threads in QUEUES. */
+  };
+
+struct cpu;
+
+/* Earliest-deadline-first real-time scheduling parameters and
+   state of a thread created with thread_create_rt().  Times are
+   in timer ticks.
+
+   A real-time thread runs a sequence of jobs.  A new job is
+   released every PERIOD ticks; it must complete, by calling
+   thread_rt_wait_period(), within DEADLINE ticks of its release,
+   and it may use at most BUDGET ticks of CPU time, after which
+   the thread is throttled until the next release. */
+struct thread_rt
+  {
+    int64_t period;                     /* Release interval. */
+    int64_t budget;                     /* CPU time allowed per job. */
+    int64_t deadline;                   /* Relative deadline. */
+
+    int64_t release;                    /* Current job's release time. */
+    int64_t abs_deadline;               /* Current job's deadline. */
+    int64_t remaining;                  /* Budget left for current job. */
+    bool throttled;                     /* Out of budget? */
+    bool waiting;                       /* In thread_rt_wait_period()? */
+    unsigned jobs;                      /* Jobs released. */
+    unsigned completed;                 /* Jobs completed. */
+    unsigned misses;                    /* Jobs that missed their deadline. */
+    unsigned overruns;                  /* Jobs completed after the next
+                                           job's release. */
+    unsigned throttles;                 /* Jobs that ran out of budget. */
+    struct timer_event release_timer;   /* Releases the next job. */
+    struct rb_node node;                /* EDF run queue node. */
+  };
+
 /* A kernel thread or user process.
 
    Each thread structure is stored in its own 4 kB page.  The
@@ -97,15 +147,29 @@ struct thread
     char name[16];                      /* Name (for debugging purposes). */
     uint8_t *stack;                     /* Saved stack pointer. */
     int priority;                       /* Priority. */
+    struct cpu *cpu;                    /* Processor last run or queued on. */
 
     /* Shared between thread.c and synch.c. */
     struct list_elem elem;              /* List element. */
-    struct list holding_locks;
-    struct lock *waiting_lock;
-    int orig_priority;
+    struct rbtree held_locks;           /* Held locks, by max waiter. */
+    struct lock *waiting_lock;          /* Lock being acquired. */
+    struct semaphore *waiting_sema;     /* Semaphore waited on. */
+    struct rb_node wait_node;           /* Semaphore wait queue node. */
+    int orig_priority;                  /* Priority before donation. */
 
     int nice;
     fp recent_cpu_fp;
+    int64_t recent_cpu_epoch;           /* MLFQS epoch of last decay. */
+    int64_t vruntime;                   /* Fair-share virtual runtime. */
+    struct rb_node fair_node;           /* Fair-share run queue node. */
+    bool is_rt;                         /* Real-time (EDF) thread? */
+    struct thread_rt rt;                /* EDF state, if is_rt. */
+
+    /* Scheduler statistics. */
+    struct sched_thread_stats sched_stats;
+    uint64_t run_stamp;                 /* TSC when last scheduled. */
+    uint64_t ready_stamp;               /* TSC when last made ready. */
+    bool woken;                         /* Made ready by thread_unblock()? */
 
 #ifdef USERPROG
     /* Owned by userprog/process.c. */
@@ -117,6 +181,7 @@ struct thread
     struct semaphore process_lock;
     struct list fd_list;
     struct list_elem elem_all;
+    struct work reap_work;              /* Frees this page after exit. */
     /**
      * 구현 방향에 대하여.
      * 1. 따로 struct child_status를 둘 때.
@@ -129,8 +194,18 @@ struct thread
      *    1-1과 같은 이유로 패스.
      */
 
+    /* User threads.  A process's initial thread owns its address
+       space, open files, and mappings; the process's other user
+       threads share them through PROCESS. */
+    struct thread *process;             /* Owner, or this thread itself. */
+    int ustack_slot;                    /* User stack slot, 0 if owner. */
+    unsigned ustack_slots;              /* Owner only: slots in use. */
+    int uthread_cnt;                    /* Owner only: live user threads. */
+    bool exiting;                       /* Owner only: being torn down? */
+    struct semaphore uthread_exited;    /* Owner only: upped per exit. */
+
     struct list spage_table;
-    struct lock spt_lock; 
+    struct rwlock spt_lock;             /* Guards spage_table. */
     struct file *exe_file;
     struct list mm_list;
     void *sys_esp;
@@ -144,8 +219,18 @@ struct thread
    Controlled by kernel command-line option "-o mlfqs". */
 extern bool thread_mlfqs;
 
+/* If true, use the fair-share scheduler.
+   Controlled by kernel command-line option "-sched=fair". */
+extern bool thread_fair;
+
+/* If true, print per-thread scheduler statistics and wakeup
+   latency histograms at shutdown.
+   Controlled by kernel command-line option "-schedstats". */
+extern bool thread_schedstats;
+
 void thread_init (void);
 void thread_start (void);
+void thread_start_ap (struct cpu *) NO_RETURN;
 
 void thread_tick (void);
 void thread_print_stats (void);
@@ -153,10 +238,21 @@ void thread_print_stats (void);
 typedef void thread_func (void *aux);
 tid_t thread_create (const char *name, int priority, thread_func *, void *);
 
+/* Real-time threads.  At most RT_UTIL_MAX / RT_UTIL_SCALE of the
+   CPU may be reserved by them, so that normal threads always
+   make progress. */
+#define RT_UTIL_SCALE 10000
+#define RT_UTIL_MAX 9000
+tid_t thread_create_rt (const char *name, int64_t period, int64_t budget,
+                        int64_t deadline, thread_func *, void *);
+void thread_rt_wait_period (void);
+unsigned thread_rt_misses (void);
+
 void thread_block (void);
 void thread_unblock (struct thread *);
 
 struct thread *thread_current (void);
+struct cpu *thread_cpu (void);
 tid_t thread_tid (void);
 const char *thread_name (void);
 
@@ -170,27 +266,25 @@ int thread_get_nice (void);
 void thread_set_nice (int);
 int thread_get_recent_cpu (void);
 int thread_get_load_avg (void);
+void thread_refresh_mlfqs (int64_t ticks);
 
 
-struct thread_sleep_info {
-  struct thread* t;
-  int64_t target_ticks;
-  struct list_elem elem;
-};
-
-void thread_sleep(int64_t target_ticks);
-void thread_wake(struct thread_sleep_info *info);
-void thread_check_sleepers();
 void thread_check_priority (int priority) ;
 bool thread_compare_priority(struct list_elem *e_a, struct list_elem *e_b) ;
 int thread_locks_max_priority (struct thread *t);
-bool thread_compare_sleep(struct list_elem *e_a, struct list_elem *e_b);
+void thread_update_priority (struct thread *, int priority);
+void thread_donate_priority (struct thread *, int priority);
+void thread_get_schedstat (struct schedstat *);
+int thread_ready_max_priority (void);
+
+struct child_status *thread_alloc_child_status (void);
+void thread_free_child_status (struct child_status *);
 
-struct list *mlfqs_queue;
 fp thread_load_avg_fp;
 
 /* Project 2 */
 struct semaphore* thread_get_process_lock(tid_t tid);
+struct thread *thread_process (void);
 bool thread_is_executables (char *file_name);
 
 struct fd_file {
@@ -209,6 +303,7 @@ struct mm_item {
 
 struct list thread_all;
 struct list parent_child_list;
+struct lock parent_child_lock;          /* Guards parent_child_list. */
 
 
 #endif /* threads/thread.h */
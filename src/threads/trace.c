@@ -0,0 +1,109 @@
+#include "threads/trace.h"
+#include <debug.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include "devices/serial.h"
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/tsc.h"
+#include "threads/vaddr.h"
+
+/* True if tracepoints should record events. */
+bool trace_enabled;
+
+/* Ring buffer of trace records. */
+static struct trace_record *trace_buf;
+static size_t trace_cap;        /* Capacity, in records. */
+static size_t trace_next;       /* Index of next record to write. */
+static uint64_t trace_total;    /* Records written since boot. */
+
+static void serial_printf (const char *format, ...) PRINTF_FORMAT (1, 2);
+
+/* Allocates a ring buffer of PAGE_CNT pages and starts
+   tracing. */
+void
+trace_init (size_t page_cnt) 
+{
+  trace_buf = palloc_get_multiple (PAL_ASSERT, page_cnt);
+  trace_cap = page_cnt * PGSIZE / sizeof *trace_buf;
+  trace_next = 0;
+  trace_total = 0;
+  trace_enabled = true;
+}
+
+/* Records EVENT with arguments A, B, and C.  Use TRACE()
+   instead of calling this directly. */
+void
+trace_emit (enum trace_event event, uint32_t a, uint32_t b, uint32_t c) 
+{
+  struct trace_record *r;
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  r = &trace_buf[trace_next];
+  if (++trace_next >= trace_cap)
+    trace_next = 0;
+  trace_total++;
+
+  r->tsc = rdtsc ();
+  r->event = event;
+  r->tid = thread_current ()->tid;
+  r->arg[0] = a;
+  r->arg[1] = b;
+  r->arg[2] = c;
+  intr_set_level (old_level);
+}
+
+/* Writes the contents of the ring buffer to the serial port,
+   oldest first, and stops tracing.  The format is understood by
+   utils/pintos-trace. */
+void
+trace_dump (void) 
+{
+  struct list_elem *e;
+  size_t cnt, i;
+
+  if (!trace_enabled)
+    return;
+  trace_enabled = false;
+
+  cnt = trace_total < trace_cap ? trace_total : trace_cap;
+  serial_printf ("trace: begin %zu records, %llu lost\n",
+                 cnt, trace_total - cnt);
+  if (timer_tsc_hz () != 0)
+    serial_printf ("trace: tsc %llu kHz\n", timer_tsc_hz () / 1000);
+  for (e = list_begin (&thread_all); e != list_end (&thread_all);
+       e = list_next (e)) 
+    {
+      struct thread *t = list_entry (e, struct thread, elem_all);
+      serial_printf ("trace: thread %d %s\n", t->tid, t->name);
+    }
+  for (i = 0; i < cnt; i++) 
+    {
+      const struct trace_record *r
+        = &trace_buf[(trace_next + trace_cap - cnt + i) % trace_cap];
+      serial_printf ("trace: %016llx %u %u %08x %08x %08x\n",
+                     r->tsc, r->event, r->tid,
+                     r->arg[0], r->arg[1], r->arg[2]);
+    }
+  serial_printf ("trace: end\n");
+}
+
+/* Formats like printf(), but writes only to the serial port, so
+   that a large dump does not scroll through the VGA console. */
+static void
+serial_printf (const char *format, ...) 
+{
+  char buf[128];
+  const char *p;
+  va_list args;
+
+  va_start (args, format);
+  vsnprintf (buf, sizeof buf, format, args);
+  va_end (args);
+
+  for (p = buf; *p != '\0'; p++)
+    serial_putc (*p);
+}
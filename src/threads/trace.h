@@ -0,0 +1,61 @@
+#ifndef THREADS_TRACE_H
+#define THREADS_TRACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Static tracepoints.
+
+   When tracing is enabled with the "-trace" kernel command-line
+   option, each TRACE() records a fixed-size binary record,
+   stamped with the CPU time-stamp counter, into a ring buffer
+   allocated at boot.  The newest records overwrite the oldest.
+   At shutdown the buffer is dumped over the serial port, for
+   decoding on the host with utils/pintos-trace. */
+
+/* Trace events, with the meaning of each record's arguments.
+   Keep utils/pintos-trace in sync with this list. */
+enum trace_event
+  {
+    TRACE_SWITCH = 1,           /* Prev tid, next tid, prev status. */
+    TRACE_BLOCK,                /* (none) */
+    TRACE_UNBLOCK,              /* Tid, priority. */
+    TRACE_LOCK_CONTENDED,       /* Lock, holder's tid, cycles waited. */
+    TRACE_PAGE_FAULT,           /* Address, eip, error code. */
+    TRACE_EVICT,                /* User page, owner's tid, dirty. */
+    TRACE_SWAP_OUT,             /* Swap sector, page, cycles taken. */
+    TRACE_SWAP_IN,              /* Swap sector, page, cycles taken. */
+    TRACE_DISK_READ,            /* Disk, sector, cycles taken. */
+    TRACE_DISK_WRITE,           /* Disk, sector, cycles taken. */
+    TRACE_SYSCALL,              /* System call number. */
+    TRACE_SYSCALL_RETURN        /* System call number, return value. */
+  };
+
+/* A trace record. */
+struct trace_record
+  {
+    uint64_t tsc;               /* Time-stamp counter. */
+    uint16_t event;             /* An enum trace_event. */
+    uint16_t tid;               /* Running thread. */
+    uint32_t arg[3];            /* Event-specific arguments. */
+  };
+
+extern bool trace_enabled;
+
+void trace_init (size_t page_cnt);
+void trace_emit (enum trace_event, uint32_t, uint32_t, uint32_t);
+void trace_dump (void);
+
+/* Records EVENT with arguments A, B, and C, if tracing is
+   enabled.  Cheap enough to leave in hot paths when it isn't. */
+#define TRACE(EVENT, A, B, C)                                   \
+        do                                                      \
+          {                                                     \
+            if (trace_enabled)                                  \
+              trace_emit (EVENT, (uint32_t) (A), (uint32_t) (B),\
+                          (uint32_t) (C));                      \
+          }                                                     \
+        while (0)
+
+#endif /* threads/trace.h */
@@ -52,6 +52,18 @@ static inline void *pg_round_down (const void *va) {
    virtual address space belongs to the kernel. */
 #define	PHYS_BASE ((void *) LOADER_PHYS_BASE)
 
+/* Temporary kernel mappings made by kmap(), for physical pages
+   that lie beyond the 1:1 mapping.  The window takes the last
+   page directory entries below the local APIC's page.  See
+   threads/highmem.c. */
+#define KMAP_BASE ((void *) 0xfe000000)
+#define KMAP_PAGES 1024
+
+/* Physical memory below this address ("low memory") is mapped
+   at PHYS_BASE.  Memory above it ("high memory") has no kernel
+   mapping of its own and must be reached through kmap(). */
+#define LOWMEM_LIMIT ((uintptr_t) KMAP_BASE - LOADER_PHYS_BASE)
+
 /* Returns true if VADDR is a user virtual address. */
 static inline bool
 is_user_vaddr (const void *vaddr) 
@@ -71,7 +83,7 @@ is_kernel_vaddr (const void *vaddr)
 static inline void *
 ptov (uintptr_t paddr)
 {
-  ASSERT ((void *) paddr < PHYS_BASE);
+  ASSERT (paddr < LOWMEM_LIMIT);
 
   return (void *) (paddr + PHYS_BASE);
 }
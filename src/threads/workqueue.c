@@ -0,0 +1,214 @@
+#include "threads/workqueue.h"
+#include <debug.h>
+#include <stdio.h>
+#include "threads/interrupt.h"
+#include "threads/thread.h"
+
+/* General-purpose work queue. */
+struct workqueue system_wq;
+
+/* Number of workers and their priority for system_wq. */
+#define SYSTEM_WQ_WORKERS 1
+#define SYSTEM_WQ_PRIORITY PRI_MAX
+
+static thread_func worker_thread;
+static timer_event_func work_delay_expired;
+static void enqueue (struct workqueue *, struct work *);
+
+/* Creates system_wq.  Must be called after thread_init(). */
+void
+workqueue_init (void) 
+{
+  if (!workqueue_create (&system_wq, "events",
+                         SYSTEM_WQ_PRIORITY, SYSTEM_WQ_WORKERS))
+    PANIC ("cannot create system work queue");
+}
+
+/* Initializes WQ and starts WORKER_CNT worker threads for it,
+   running at PRIORITY, named after NAME.  WQ must stay valid
+   for as long as the kernel runs, because the workers never
+   exit.  Returns true if successful, false if the workers could
+   not all be created. */
+bool
+workqueue_create (struct workqueue *wq, const char *name,
+                  int priority, int worker_cnt) 
+{
+  int i;
+
+  ASSERT (wq != NULL);
+  ASSERT (name != NULL);
+  ASSERT (worker_cnt > 0);
+
+  wq->name = name;
+  wq->priority = priority;
+  list_init (&wq->items);
+  list_init (&wq->idle);
+  wq->queued = wq->completed = 0;
+
+  for (i = 0; i < worker_cnt; i++) 
+    {
+      char thread_name[16];
+
+      snprintf (thread_name, sizeof thread_name, "%s/%d", name, i);
+      if (thread_create (thread_name, priority, worker_thread, wq)
+          == TID_ERROR)
+        return false;
+    }
+  return true;
+}
+
+/* Prints statistics for system_wq. */
+void
+workqueue_print_stats (void) 
+{
+  printf ("Work queue: %lld items queued, %lld completed\n",
+          system_wq.queued, system_wq.completed);
+}
+
+/* Initializes W as a work item that calls FUNC with AUX. */
+void
+work_init (struct work *w, work_func *func, void *aux) 
+{
+  ASSERT (w != NULL);
+  ASSERT (func != NULL);
+
+  w->func = func;
+  w->aux = aux;
+  w->wq = NULL;
+  w->pending = false;
+  timer_event_init (&w->timer, work_delay_expired, w);
+}
+
+/* Queues W on WQ, to be run by one of WQ's workers.  Returns
+   true if W was queued, false if it was already pending.
+
+   May be called from an interrupt handler or with interrupts
+   off.  W may be queued again once its function has started. */
+bool
+work_queue (struct workqueue *wq, struct work *w) 
+{
+  enum intr_level old_level;
+
+  ASSERT (wq != NULL);
+  ASSERT (w != NULL);
+
+  old_level = intr_disable ();
+  if (w->pending) 
+    {
+      intr_set_level (old_level);
+      return false;
+    }
+  w->pending = true;
+  w->wq = wq;
+  enqueue (wq, w);
+  intr_set_level (old_level);
+  return true;
+}
+
+/* Queues W on WQ after TICKS timer ticks.  Returns true if W was
+   scheduled, false if it was already pending.
+
+   May be called from an interrupt handler or with interrupts
+   off. */
+bool
+work_queue_delayed (struct workqueue *wq, struct work *w, int64_t ticks) 
+{
+  enum intr_level old_level;
+
+  ASSERT (wq != NULL);
+  ASSERT (w != NULL);
+
+  if (ticks <= 0)
+    return work_queue (wq, w);
+
+  old_level = intr_disable ();
+  if (w->pending) 
+    {
+      intr_set_level (old_level);
+      return false;
+    }
+  w->pending = true;
+  w->wq = wq;
+  timer_event_arm (&w->timer, timer_ticks () + ticks);
+  intr_set_level (old_level);
+  return true;
+}
+
+/* Cancels W if it is pending.  Returns true if W was cancelled,
+   false if it was not pending.  If W's function has already
+   started, it is not waited for. */
+bool
+work_cancel (struct work *w) 
+{
+  enum intr_level old_level;
+  bool was_pending;
+
+  ASSERT (w != NULL);
+
+  old_level = intr_disable ();
+  was_pending = w->pending;
+  if (was_pending && !timer_event_cancel (&w->timer))
+    list_remove (&w->elem);
+  w->pending = false;
+  intr_set_level (old_level);
+  return was_pending;
+}
+
+/* Timer event function for work_queue_delayed(). */
+static void
+work_delay_expired (void *w_) 
+{
+  struct work *w = w_;
+
+  enqueue (w->wq, w);
+}
+
+/* Adds W to WQ's items and wakes an idle worker, if any.
+   Interrupts must be off. */
+static void
+enqueue (struct workqueue *wq, struct work *w) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  list_push_back (&wq->items, &w->elem);
+  wq->queued++;
+  if (!list_empty (&wq->idle)) 
+    {
+      struct thread *t = list_entry (list_pop_front (&wq->idle),
+                                     struct thread, elem);
+      thread_unblock (t);
+      if (intr_context () && t->priority > thread_get_priority ())
+        intr_yield_on_return ();
+    }
+}
+
+/* A worker thread for work queue WQ_.  Runs work items in the
+   order they were queued. */
+static void
+worker_thread (void *wq_) 
+{
+  struct workqueue *wq = wq_;
+
+  for (;;) 
+    {
+      struct work *w;
+      work_func *func;
+      void *aux;
+
+      intr_disable ();
+      while (list_empty (&wq->items)) 
+        {
+          list_push_back (&wq->idle, &thread_current ()->elem);
+          thread_block ();
+        }
+      w = list_entry (list_pop_front (&wq->items), struct work, elem);
+      w->pending = false;
+      func = w->func;
+      aux = w->aux;
+      intr_enable ();
+
+      /* FUNC may free or requeue W. */
+      func (aux);
+      wq->completed++;
+    }
+}
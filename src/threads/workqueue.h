@@ -0,0 +1,64 @@
+#ifndef THREADS_WORKQUEUE_H
+#define THREADS_WORKQUEUE_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "devices/timer.h"
+
+/* Work queues.
+
+   A work queue is a pool of kernel worker threads, running at a
+   chosen priority, that call functions on behalf of other code.
+   Interrupt handlers, and code that runs with interrupts off,
+   can queue a work item and return at once, leaving the
+   expensive part to run later in a worker thread, where it may
+   sleep and interrupts are on.  A work item may also be queued
+   after a delay, driven by the timer.
+
+   Queueing never yields the CPU.  From an interrupt handler, it
+   requests a yield on return if a worker of higher priority
+   than the interrupted thread was woken; otherwise the worker
+   runs at the next scheduling point. */
+
+struct workqueue;
+
+/* A function that a worker calls with a work item's AUX. */
+typedef void work_func (void *aux);
+
+/* A work item. */
+struct work 
+  {
+    struct list_elem elem;      /* Element in the queue's items list. */
+    work_func *func;            /* Function to call. */
+    void *aux;                  /* Argument for `func'. */
+    struct workqueue *wq;       /* Queue it is pending on. */
+    bool pending;               /* Queued or delayed, not yet started? */
+    struct timer_event timer;   /* Delay, for work_queue_delayed(). */
+  };
+
+/* A work queue. */
+struct workqueue 
+  {
+    const char *name;           /* Name, for worker thread names. */
+    int priority;               /* Priority of the workers. */
+    struct list items;          /* Pending work items. */
+    struct list idle;           /* Workers waiting for work. */
+    int64_t queued;             /* Number of items queued. */
+    int64_t completed;          /* Number of items completed. */
+  };
+
+/* General-purpose work queue, for work with no better place. */
+extern struct workqueue system_wq;
+
+void workqueue_init (void);
+bool workqueue_create (struct workqueue *, const char *name,
+                       int priority, int worker_cnt);
+void workqueue_print_stats (void);
+
+void work_init (struct work *, work_func *, void *aux);
+bool work_queue (struct workqueue *, struct work *);
+bool work_queue_delayed (struct workqueue *, struct work *, int64_t ticks);
+bool work_cancel (struct work *);
+
+#endif /* threads/workqueue.h */
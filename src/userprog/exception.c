@@ -4,9 +4,11 @@
 #include "userprog/gdt.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
 #include "threads/vaddr.h"
 #include "userprog/syscall.h"
 #include "userprog/pagedir.h"
+#include "userprog/process.h"
 #include "vm/page.h"
 
 /* Number of page faults processed. */
@@ -92,6 +94,7 @@ kill(struct intr_frame *f)
       printf("%s: dying due to interrupt %#04x (%s).\n",
              thread_name(), f->vec_no, intr_name(f->vec_no));
       intr_dump_frame(f);
+      process_kill();
       thread_exit();
 
    case SEL_KCSEG:
@@ -146,6 +149,7 @@ page_fault(struct intr_frame *f)
 
    /* Count page faults. */
    page_fault_cnt++;
+   TRACE (TRACE_PAGE_FAULT, fault_addr, f->eip, f->error_code);
 
    /* Determine cause. */
    not_present = (f->error_code & PF_P) == 0;
@@ -161,12 +165,19 @@ page_fault(struct intr_frame *f)
    //        write ? "writing" : "reading",
    //        user ? "user" : "kernel");
    void *esp = user ? f->esp : thread_current()->sys_esp; 
-   if (!not_present) exit_impl(-1);
+   /* A bad access by any of a process's threads kills the whole
+      process, not just that thread. */
+   if (!not_present)
+   {
+      process_kill();
+      exit_impl(-1);
+   }
    if (not_present & is_user_vaddr(fault_addr) && fault_addr > 0x804800)
       handle_page_fault(fault_addr, esp);
 
    if (!check_valid_pointer(fault_addr))
    {
+      process_kill();
       exit_impl(-1);
    }
 }
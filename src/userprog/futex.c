@@ -0,0 +1,156 @@
+#include "userprog/futex.h"
+#include <debug.h>
+#include <list.h>
+#include <stdint.h>
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Futexes ("fast user-space mutexes").
+
+   A futex is an int in a process's memory.  User threads
+   manipulate it with atomic instructions and only enter the
+   kernel to sleep until it changes, with futex_wait(), or to
+   wake sleepers, with futex_wake().  An uncontended lock or
+   unlock therefore costs no system call at all; see
+   lib/user/thread.c for the mutex built on top.
+
+   Sleepers are kept in a hash table keyed by process and user
+   address.  The table takes no memory for futexes nobody is
+   waiting on. */
+
+/* Number of hash buckets.  A power of 2. */
+#define FUTEX_BUCKETS 64
+
+/* A thread sleeping in futex_wait(). */
+struct futex_waiter 
+  {
+    struct list_elem elem;      /* Element in bucket's list. */
+    struct thread *process;     /* Owner of the address space. */
+    int *uaddr;                 /* User address waited on. */
+    struct semaphore sema;      /* Upped by futex_wake(). */
+  };
+
+/* A hash bucket. */
+struct futex_bucket 
+  {
+    struct lock lock;           /* Guards waiters. */
+    struct list waiters;        /* List of struct futex_waiter. */
+  };
+
+static struct futex_bucket buckets[FUTEX_BUCKETS];
+
+static struct futex_bucket *bucket_for (struct thread *, int *uaddr);
+
+/* Initializes the futex hash table. */
+void
+futex_init (void) 
+{
+  int i;
+
+  for (i = 0; i < FUTEX_BUCKETS; i++) 
+    {
+      lock_init (&buckets[i].lock);
+      list_init (&buckets[i].waiters);
+    }
+}
+
+/* If the int at user address UADDR still contains VAL, sleeps
+   until another thread in the same process calls futex_wake()
+   on UADDR, and returns 0.  Otherwise, or if the process is
+   exiting, returns -1 immediately.
+
+   The check and the sleep are atomic with respect to
+   futex_wake(), so a wakeup sent after the caller changed *UADDR
+   is never lost.  UADDR must be a valid, aligned user address. */
+int
+futex_wait (int *uaddr, int val) 
+{
+  struct futex_waiter w;
+  struct futex_bucket *b;
+
+  ASSERT (((uintptr_t) uaddr & 3) == 0);
+
+  w.process = thread_process ();
+  w.uaddr = uaddr;
+  sema_init (&w.sema, 0);
+
+  b = bucket_for (w.process, uaddr);
+  lock_acquire (&b->lock);
+  if (w.process->exiting || *(volatile int *) uaddr != val) 
+    {
+      lock_release (&b->lock);
+      return -1;
+    }
+  list_push_back (&b->waiters, &w.elem);
+  lock_release (&b->lock);
+
+  sema_down (&w.sema);
+  return 0;
+}
+
+/* Wakes up to CNT threads of the running process sleeping on
+   user address UADDR, oldest first.  Returns the number woken. */
+int
+futex_wake (int *uaddr, int cnt) 
+{
+  struct thread *process = thread_process ();
+  struct futex_bucket *b = bucket_for (process, uaddr);
+  struct list_elem *e, *next;
+  int woken = 0;
+
+  lock_acquire (&b->lock);
+  for (e = list_begin (&b->waiters);
+       e != list_end (&b->waiters) && woken < cnt; e = next) 
+    {
+      struct futex_waiter *w = list_entry (e, struct futex_waiter, elem);
+      next = list_next (e);
+      if (w->process == process && w->uaddr == uaddr) 
+        {
+          list_remove (&w->elem);
+          sema_up (&w->sema);
+          woken++;
+        }
+    }
+  lock_release (&b->lock);
+
+  return woken;
+}
+
+/* Wakes every thread of PROCESS sleeping on any futex.  PROCESS
+   must already be marked exiting, so that none of its threads
+   can go back to sleep afterward. */
+void
+futex_wake_all (struct thread *process) 
+{
+  int i;
+
+  ASSERT (process->exiting);
+
+  for (i = 0; i < FUTEX_BUCKETS; i++) 
+    {
+      struct futex_bucket *b = &buckets[i];
+      struct list_elem *e, *next;
+
+      lock_acquire (&b->lock);
+      for (e = list_begin (&b->waiters); e != list_end (&b->waiters);
+           e = next) 
+        {
+          struct futex_waiter *w = list_entry (e, struct futex_waiter, elem);
+          next = list_next (e);
+          if (w->process == process) 
+            {
+              list_remove (&w->elem);
+              sema_up (&w->sema);
+            }
+        }
+      lock_release (&b->lock);
+    }
+}
+
+/* Returns the bucket for UADDR in PROCESS. */
+static struct futex_bucket *
+bucket_for (struct thread *process, int *uaddr) 
+{
+  uintptr_t hash = ((uintptr_t) uaddr >> 2) ^ (uintptr_t) process->tid;
+  return &buckets[hash & (FUTEX_BUCKETS - 1)];
+}
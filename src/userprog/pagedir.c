@@ -3,11 +3,15 @@
 #include <stddef.h>
 #include <string.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/pgops.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
+#include "threads/smp.h"
 
 static uint32_t *active_pd (void);
 static void invalidate_pagedir (uint32_t *);
+static uint32_t *lookup_entry (uint32_t *pd, const void *vaddr);
 
 /* Creates a new page directory that has mappings for kernel
    virtual addresses, but none for user virtual addresses.
@@ -16,9 +20,9 @@ static void invalidate_pagedir (uint32_t *);
 uint32_t *
 pagedir_create (void) 
 {
-  uint32_t *pd = palloc_get_page (0);
+  uint32_t *pd = palloc_get_page (PAL_TAG (MEM_PAGETABLE));
   if (pd != NULL)
-    memcpy (pd, base_page_dir, PGSIZE);
+    copy_page (pd, base_page_dir);
   return pd;
 }
 
@@ -36,7 +40,9 @@ pagedir_destroy (uint32_t *pd)
 
   ASSERT (pd != base_page_dir);
   for (pde = pd; pde < pd + pd_no (PHYS_BASE); pde++)
-    if (*pde & PTE_P) 
+    if (*pde & PTE_PS)
+      palloc_free_multiple (pde_get_large (*pde), LARGE_PGCNT);
+    else if (*pde & PTE_P) 
       {
         uint32_t *pt = pde_get_pt (*pde);
         uint32_t *pte;
@@ -54,7 +60,9 @@ pagedir_destroy (uint32_t *pd)
    If PD does not have a page table for VADDR, behavior depends
    on CREATE.  If CREATE is true, then a new page table is
    created and a pointer into it is returned.  Otherwise, a null
-   pointer is returned. */
+   pointer is returned.
+   Returns a null pointer if VADDR lies in a large page, which
+   has no page table. */
 static uint32_t *
 lookup_page (uint32_t *pd, const void *vaddr, bool create)
 {
@@ -72,7 +80,7 @@ lookup_page (uint32_t *pd, const void *vaddr, bool create)
     {
       if (create)
         {
-          pt = palloc_get_page (PAL_ZERO);
+          pt = palloc_get_page (PAL_ZERO | PAL_TAG (MEM_PAGETABLE));
           if (pt == NULL) 
             return NULL; 
       
@@ -81,6 +89,8 @@ lookup_page (uint32_t *pd, const void *vaddr, bool create)
       else
         return NULL;
     }
+  if (*pde & PTE_PS)
+    return NULL;
 
   /* Return the page table entry. */
   pt = pde_get_pt (*pde);
@@ -105,7 +115,7 @@ pagedir_set_page (uint32_t *pd, void *upage, void *kpage, bool writable)
   ASSERT (pg_ofs (upage) == 0);
   ASSERT (pg_ofs (kpage) == 0);
   ASSERT (is_user_vaddr (upage));
-  ASSERT (vtop (kpage) >> PTSHIFT < ram_pages);
+  ASSERT (vtop (kpage) >> PTSHIFT < lowmem_pages);
   ASSERT (pd != base_page_dir);
 
   pte = lookup_page (pd, upage, true);
@@ -130,6 +140,10 @@ pagedir_get_page (uint32_t *pd, const void *uaddr)
   uint32_t *pte;
 
   ASSERT (is_user_vaddr (uaddr));
+
+  if (pd[pd_no (uaddr)] & PTE_PS)
+    return ((uint8_t *) pde_get_large (pd[pd_no (uaddr)])
+            + ((uintptr_t) uaddr & (LARGE_PGSIZE - 1)));
   
   pte = lookup_page (pd, uaddr, false);
   if (pte != NULL && (*pte & PTE_P) != 0)
@@ -158,6 +172,61 @@ pagedir_clear_page (uint32_t *pd, void *upage)
     }
 }
 
+/* Maps the 4 MB of user virtual memory starting at UPAGE to the
+   large page at kernel virtual address KPAGE, which should be
+   LARGE_PGCNT contiguous pages from the user pool.  Both must be
+   aligned to 4 MB, and CR4.PSE must be on.  If WRITABLE is true,
+   the page is read/write; otherwise it is read-only.
+   Returns false, without changing anything, if some page in the
+   4 MB is already mapped or has a page table. */
+bool
+pagedir_set_large (uint32_t *pd, void *upage, void *kpage, bool writable) 
+{
+  uint32_t *pde;
+
+  ASSERT (pse_enabled);
+  ASSERT (((uintptr_t) upage & (LARGE_PGSIZE - 1)) == 0);
+  ASSERT (is_user_vaddr (upage));
+  ASSERT (pd != base_page_dir);
+
+  pde = pd + pd_no (upage);
+  if (*pde != 0)
+    return false;
+  *pde = pde_create_large (kpage, writable, true);
+  return true;
+}
+
+/* Removes the large page mapping of UPAGE in PD, if there is
+   one, and returns the kernel virtual address of the large
+   page.  Returns a null pointer if UPAGE is not in a large
+   page. */
+void *
+pagedir_clear_large (uint32_t *pd, void *upage) 
+{
+  uint32_t *pde;
+  void *kpage;
+
+  ASSERT (is_user_vaddr (upage));
+
+  pde = pd + pd_no (upage);
+  if (!(*pde & PTE_PS))
+    return NULL;
+  kpage = pde_get_large (*pde);
+  *pde = 0;
+  invalidate_pagedir (pd);
+  return kpage;
+}
+
+/* Returns the entry that maps virtual address VADDR in PD: the
+   PDE if VADDR lies in a large page, otherwise the PTE, or a
+   null pointer if there is no page table. */
+static uint32_t *
+lookup_entry (uint32_t *pd, const void *vaddr) 
+{
+  uint32_t *pde = pd + pd_no (vaddr);
+  return *pde & PTE_PS ? pde : lookup_page (pd, vaddr, false);
+}
+
 /* Returns true if the PTE for virtual page VPAGE in PD is dirty,
    that is, if the page has been modified since the PTE was
    installed.
@@ -165,7 +234,7 @@ pagedir_clear_page (uint32_t *pd, void *upage)
 bool
 pagedir_is_dirty (uint32_t *pd, const void *vpage) 
 {
-  uint32_t *pte = lookup_page (pd, vpage, false);
+  uint32_t *pte = lookup_entry (pd, vpage);
   return pte != NULL && (*pte & PTE_D) != 0;
 }
 
@@ -174,7 +243,7 @@ pagedir_is_dirty (uint32_t *pd, const void *vpage)
 void
 pagedir_set_dirty (uint32_t *pd, const void *vpage, bool dirty) 
 {
-  uint32_t *pte = lookup_page (pd, vpage, false);
+  uint32_t *pte = lookup_entry (pd, vpage);
   if (pte != NULL) 
     {
       if (dirty)
@@ -194,7 +263,7 @@ pagedir_set_dirty (uint32_t *pd, const void *vpage, bool dirty)
 bool
 pagedir_is_accessed (uint32_t *pd, const void *vpage) 
 {
-  uint32_t *pte = lookup_page (pd, vpage, false);
+  uint32_t *pte = lookup_entry (pd, vpage);
   return pte != NULL && (*pte & PTE_A) != 0;
 }
 
@@ -203,7 +272,7 @@ pagedir_is_accessed (uint32_t *pd, const void *vpage)
 void
 pagedir_set_accessed (uint32_t *pd, const void *vpage, bool accessed) 
 {
-  uint32_t *pte = lookup_page (pd, vpage, false);
+  uint32_t *pte = lookup_entry (pd, vpage);
   if (pte != NULL) 
     {
       if (accessed)
@@ -221,6 +290,11 @@ pagedir_set_accessed (uint32_t *pd, const void *vpage, bool accessed)
 void
 pagedir_activate (uint32_t *pd) 
 {
+  enum intr_level old_level;
+
+  /* Record PD as the processor's, for smp_flush_tlb(). */
+  old_level = intr_disable ();
+  thread_cpu ()->pagedir = pd;
   if (pd == NULL)
     pd = base_page_dir;
 
@@ -230,6 +304,7 @@ pagedir_activate (uint32_t *pd)
      to/from Control Registers" and [IA32-v3a] 3.7.5 "Base
      Address of the Page Directory". */
   asm volatile ("movl %0, %%cr3" : : "r" (vtop (pd)) : "memory");
+  intr_set_level (old_level);
 }
 
 /* Returns the currently active page directory. */
@@ -252,7 +327,9 @@ active_pd (void)
 
    This function invalidates the TLB if PD is the active page
    directory.  (If PD is not active then its entries are not in
-   the TLB, so there is no need to invalidate anything.) */
+   the TLB, so there is no need to invalidate anything.)  It
+   does the same on every other processor on which PD is
+   active. */
 static void
 invalidate_pagedir (uint32_t *pd) 
 {
@@ -262,4 +339,5 @@ invalidate_pagedir (uint32_t *pd)
          "Translation Lookaside Buffers (TLBs)". */
       pagedir_activate (pd);
     } 
+  smp_flush_tlb (pd);
 }
@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "userprog/futex.h"
 #include "userprog/gdt.h"
 #include "userprog/pagedir.h"
 #include "userprog/tss.h"
@@ -22,6 +23,8 @@
 #include "vm/frame.h"
 
 static thread_func start_process NO_RETURN;
+static thread_func start_uthread NO_RETURN;
+static void release_uthread (struct thread *);
 static bool load (const char *cmdline, void (**eip) (void), void **esp);
 bool stack_save_arguments (void **esp, char **arg_tokens, int token_num, void **return_argv);
 
@@ -40,7 +43,7 @@ process_execute (const char *file_name)
 
   /* Make a copy of FILE_NAME.
      Otherwise there's a race between the caller and load(). */
-  fn_copy = palloc_get_page (0);
+  fn_copy = palloc_get_page (PAL_TAG (MEM_PROCESS));
   if (fn_copy == NULL)
     return TID_ERROR;
   strlcpy (fn_copy, file_name, PGSIZE);
@@ -71,6 +74,7 @@ start_process (void *f_name)
   // printf("pid %d: start_process %s %d\n", thread_tid(), file_name, success);
 
   struct list_elem *e;
+  lock_acquire (&parent_child_lock);
   for (e=list_begin(&parent_child_list); e!=list_end(&parent_child_list); e=list_next(e)) {
     struct child_status *cstat = list_entry(e, struct child_status, elem);
     if (cstat->child_pid == thread_tid()) {
@@ -82,6 +86,7 @@ start_process (void *f_name)
       break;
     }
   }
+  lock_release (&parent_child_lock);
 
   strlcpy(thread_current()->executable_name, file_name, strlen(file_name) + 1);
 
@@ -115,6 +120,23 @@ start_process (void *f_name)
 int
 process_wait (tid_t child_tid) 
 {
+  struct list_elem *e, *next;
+
+  /* User threads are joined with process_thread_join(), not
+     waited for. */
+  lock_acquire (&parent_child_lock);
+  for (e = list_begin (&parent_child_list); e != list_end (&parent_child_list);
+       e = list_next (e)) 
+    {
+      struct child_status *cstat = list_entry (e, struct child_status, elem);
+      if (cstat->child_pid == child_tid && cstat->is_thread) 
+        {
+          lock_release (&parent_child_lock);
+          return -1;
+        }
+    }
+  lock_release (&parent_child_lock);
+
   if (isdebug) printf("pid %d: process_wait for pid %d\n", thread_tid(), child_tid);
   struct semaphore *child_lock = thread_get_process_lock(child_tid);
   if (child_lock != NULL){
@@ -123,14 +145,17 @@ process_wait (tid_t child_tid)
   }
   if (isdebug) printf("pid %d: wait finished for %d@%p\n", thread_tid(), child_tid, child_lock);
 
-  struct list_elem *e, *next;
+  lock_acquire (&parent_child_lock);
   for (e=list_begin(&parent_child_list); e!=list_end(&parent_child_list); e=next) {
     next=list_next(e);
     struct child_status *cstat = list_entry(e, struct child_status, elem);
     if (cstat->child_pid == child_tid) {
-      return cstat->exit_status;
+      int status = cstat->exit_status;
+      lock_release (&parent_child_lock);
+      return status;
     }
   }
+  lock_release (&parent_child_lock);
   
   // while(thread_tid() != child_tid){};
   return -1;
@@ -143,6 +168,13 @@ process_exit (void)
   struct thread *curr = thread_current ();
   uint32_t *pd;
 
+  if (curr->process != curr) 
+    {
+      release_uthread (curr);
+      return;
+    }
+  process_wait_threads ();
+
   remove_spt_entry(curr);
   file_close(curr->exe_file);
 
@@ -181,6 +213,256 @@ process_activate (void)
   tss_update ();
 }
 
+/* User threads.
+
+   A process may run several user threads in one address space.
+   The process's initial thread owns the page directory,
+   supplemental page table, open files, and mappings, and each
+   additional thread points to it through its PROCESS member.
+
+   Each thread has its own user stack.  Stack slot 0 belongs to
+   the initial thread and grows down from PHYS_BASE; slot N
+   grows down from PHYS_BASE - N * USTACK_SIZE, on demand, like
+   the initial stack.
+
+   A thread's exit status is kept in a child_status record owned
+   by the initial thread, like a child process's, until some
+   thread of the process joins it.  The initial thread waits for
+   all the others before tearing the process down, because the
+   kernel cannot stop a thread that is running or asleep. */
+
+/* Size of each user thread's stack region. */
+#define USTACK_SIZE (1024 * 1024)
+
+/* Number of stack slots, including the initial thread's. */
+#define USTACK_SLOTS 16
+
+/* Passed from process_thread_create() to start_uthread(). */
+struct uthread_start 
+  {
+    struct thread *process;     /* Owner of the address space. */
+    struct child_status *cstat; /* Exit status record. */
+    int slot;                   /* Stack slot. */
+    void *eip;                  /* User entry point. */
+    void *args[2];              /* Arguments to the entry point. */
+  };
+
+/* Starts a new user thread in the running thread's process,
+   calling EIP(ARG0, ARG1) on a fresh user stack.  EIP must not
+   return, because its return address is null.  Returns the new
+   thread's tid, or TID_ERROR if no stack slot or memory is
+   available or the process is exiting. */
+tid_t
+process_thread_create (void *eip, void *arg0, void *arg1) 
+{
+  struct thread *process = thread_process ();
+  struct uthread_start start;
+  enum intr_level old_level;
+  tid_t tid;
+
+  start.process = process;
+  start.eip = eip;
+  start.args[0] = arg0;
+  start.args[1] = arg1;
+
+  old_level = intr_disable ();
+  for (start.slot = 1; start.slot < USTACK_SLOTS; start.slot++)
+    if ((process->ustack_slots & (1u << start.slot)) == 0)
+      break;
+  if (process->exiting)
+    start.slot = USTACK_SLOTS;
+  if (start.slot < USTACK_SLOTS) 
+    {
+      process->ustack_slots |= 1u << start.slot;
+      process->uthread_cnt++;
+    }
+  intr_set_level (old_level);
+  if (start.slot >= USTACK_SLOTS)
+    return TID_ERROR;
+
+  /* The record must be in place before the thread can exit. */
+  start.cstat = thread_alloc_child_status ();
+  if (start.cstat == NULL)
+    goto error;
+  start.cstat->parent_pid = process->tid;
+  start.cstat->child_pid = TID_ERROR;
+  start.cstat->exit_status = 1000;
+  start.cstat->is_thread = true;
+  lock_acquire (&parent_child_lock);
+  list_push_back (&parent_child_list, &start.cstat->elem);
+  lock_release (&parent_child_lock);
+
+  tid = thread_create (thread_name (), PRI_DEFAULT, start_uthread, &start);
+  if (tid == TID_ERROR) 
+    {
+      lock_acquire (&parent_child_lock);
+      list_remove (&start.cstat->elem);
+      lock_release (&parent_child_lock);
+      thread_free_child_status (start.cstat);
+      goto error;
+    }
+
+  /* START lives on our stack, so wait until the thread is done
+     with it. */
+  sema_down (&start.cstat->sema_start);
+  return tid;
+
+ error:
+  old_level = intr_disable ();
+  process->ustack_slots &= ~(1u << start.slot);
+  process->uthread_cnt--;
+  intr_set_level (old_level);
+  return TID_ERROR;
+}
+
+/* A thread function that joins a new user thread to its process
+   and starts it running in user mode. */
+static void
+start_uthread (void *start_) 
+{
+  struct uthread_start *start = start_;
+  struct thread *t = thread_current ();
+  struct intr_frame if_;
+  uint32_t *esp;
+
+  t->process = start->process;
+  t->ustack_slot = start->slot;
+  strlcpy (t->command_line, t->process->command_line,
+           sizeof t->command_line);
+  strlcpy (t->executable_name, t->process->executable_name,
+           sizeof t->executable_name);
+  t->pagedir = t->process->pagedir;
+  process_activate ();
+
+  /* Map the top page of the thread's stack and push the
+     arguments and a null return address. */
+  esp = (uint32_t *) ((uint8_t *) PHYS_BASE - start->slot * USTACK_SIZE);
+  grow_stack (pg_round_down (esp - 1));
+  *--esp = (uint32_t) start->args[1];
+  *--esp = (uint32_t) start->args[0];
+  *--esp = 0;
+
+  memset (&if_, 0, sizeof if_);
+  if_.gs = if_.fs = if_.es = if_.ds = if_.ss = SEL_UDSEG;
+  if_.cs = SEL_UCSEG;
+  if_.eflags = FLAG_IF | FLAG_MBS;
+  if_.eip = start->eip;
+  if_.esp = esp;
+
+  start->cstat->child_pid = t->tid;
+  sema_up (&start->cstat->sema_start);
+
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+  NOT_REACHED ();
+}
+
+/* Waits for user thread TID, which must belong to the running
+   thread's process, to exit and returns its exit status.
+   Returns -1 immediately if TID is not such a thread or has
+   already been joined. */
+int
+process_thread_join (tid_t tid) 
+{
+  struct thread *process = thread_process ();
+  struct list_elem *e;
+
+  lock_acquire (&parent_child_lock);
+  for (e = list_begin (&parent_child_list); e != list_end (&parent_child_list);
+       e = list_next (e)) 
+    {
+      struct child_status *cstat = list_entry (e, struct child_status, elem);
+      if (cstat->child_pid == tid && cstat->parent_pid == process->tid
+          && cstat->is_thread && tid != thread_tid ()) 
+        {
+          int status;
+
+          /* Only a joiner of TID removes CSTAT, so it stays put
+             while we wait without the lock. */
+          if (cstat->exit_status == 1000) 
+            {
+              struct semaphore *exited = thread_get_process_lock (tid);
+              lock_release (&parent_child_lock);
+              if (exited != NULL)
+                sema_down (exited);
+              lock_acquire (&parent_child_lock);
+            }
+          status = cstat->exit_status;
+          list_remove (&cstat->elem);
+          lock_release (&parent_child_lock);
+          thread_free_child_status (cstat);
+          return status;
+        }
+    }
+  lock_release (&parent_child_lock);
+  return -1;
+}
+
+/* Waits until every user thread but the running process's
+   initial thread has exited.  Called by the initial thread.
+
+   The kernel cannot stop another thread where it stands, so
+   this first kills the process, which makes the other threads
+   end themselves the next time they would return to user mode,
+   and wakes any of them sleeping on a futex. */
+void
+process_wait_threads (void) 
+{
+  struct thread *curr = thread_current ();
+
+  ASSERT (curr->process == curr);
+
+  process_kill ();
+  while (curr->uthread_cnt > 0)
+    sema_down (&curr->uthread_exited);
+}
+
+/* Marks the running thread's process as exiting and wakes all of
+   its threads that sleep on futexes.  From then on, each of its
+   user threads, including the initial thread, exits with status
+   -1 on its way back to user mode; see process_killed(). */
+void
+process_kill (void) 
+{
+  struct thread *process = thread_process ();
+
+  process->exiting = true;
+  futex_wake_all (process);
+}
+
+/* Returns true if the running thread belongs to a process that
+   is exiting, so that it must not return to user mode.  Called
+   on the way back from every interrupt, including system
+   calls. */
+bool
+process_killed (void) 
+{
+  return thread_process ()->exiting;
+}
+
+/* Frees user thread T's stack, returns its stack slot, and tells
+   the process's initial thread that it has exited.  T must be
+   the running thread. */
+static void
+release_uthread (struct thread *t) 
+{
+  struct thread *process = t->process;
+  uint8_t *top = (uint8_t *) PHYS_BASE - t->ustack_slot * USTACK_SIZE;
+  enum intr_level old_level;
+
+  remove_spt_range (process, top - USTACK_SIZE, top);
+
+  /* As in process_exit(), stop using the page directory before
+     the initial thread can destroy it. */
+  t->pagedir = NULL;
+  pagedir_activate (NULL);
+
+  old_level = intr_disable ();
+  process->ustack_slots &= ~(1u << t->ustack_slot);
+  process->uthread_cnt--;
+  intr_set_level (old_level);
+  sema_up (&process->uthread_exited);
+}
+
 /* We load ELF binaries.  The following definitions are taken
    from the ELF specification, [ELF1], more-or-less verbatim.  */
 
@@ -285,7 +567,7 @@ load (const char *file_name, void (**eip) (void), void **esp)
   }
   process_activate ();
 
-  lock_acquire(&fs_lock);
+  rwlock_acquire_write (&fs_lock);
   /* Open executable file. */
   file = filesys_open (file_name);
   if (file == NULL) 
@@ -379,7 +661,7 @@ load (const char *file_name, void (**eip) (void), void **esp)
   success = true;
 
  done:
-  lock_release(&fs_lock);
+  rwlock_release_write (&fs_lock);
   /* We arrive here whether the load is successful or not. */
   return success;
 }
@@ -8,4 +8,10 @@ int process_wait (tid_t);
 void process_exit (void);
 void process_activate (void);
 
+tid_t process_thread_create (void *eip, void *arg0, void *arg1);
+int process_thread_join (tid_t);
+void process_wait_threads (void);
+void process_kill (void);
+bool process_killed (void);
+
 #endif /* userprog/process.h */
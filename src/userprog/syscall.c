@@ -5,15 +5,19 @@
 #include "threads/init.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
 #include "threads/vaddr.h"
 #include "lib/kernel/stdio.h"
 #include "lib/stdio.h"
 #include "lib/string.h"
+#include "userprog/futex.h"
 #include "userprog/pagedir.h"
 #include "userprog/process.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "threads/malloc.h"
+#include "threads/memtag.h"
+#include "threads/slab.h"
 #include "vm/page.h"
 
 static void syscall_handler (struct intr_frame *);
@@ -21,13 +25,27 @@ bool is_valid_pointer (void *esp, int max_dist);
 bool create (void *esp);
 bool remove (void *esp);
 unsigned tell (void *esp);
+bool schedstat (void *esp);
+bool memstat (void *esp);
+static tid_t sys_thread_spawn (void *esp);
+static int sys_thread_join (void *esp);
+static int sys_futex_wait (void *esp);
+static int sys_futex_wake (void *esp);
+static int sys_largepages (void *esp);
+static bool is_writable_buffer (void *buf, size_t size);
 
 bool isdebug2 = false;
 
+/* Cache of open file records. */
+static struct kmem_cache fd_cache;
+
 void
 syscall_init (void) 
 {
-  lock_init(&fs_lock);
+  rwlock_init (&fs_lock, RWLOCK_PREFER_WRITERS);
+  kmem_cache_init (&fd_cache, "fd_file", sizeof (struct fd_file), NULL,
+                   MEM_PROCESS);
+  futex_init ();
   intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
 }
 
@@ -43,6 +61,7 @@ syscall_handler (struct intr_frame *f)
   void *arg_addr = f->esp + 4;
   // printf ("system call! %d\n", syscall_num);
   thread_current()->sys_esp = f->esp;
+  TRACE (TRACE_SYSCALL, syscall_num, 0, 0);
 
   switch(syscall_num) {
     case SYS_HALT:
@@ -89,7 +108,29 @@ syscall_handler (struct intr_frame *f)
     case SYS_MUNMAP:
       munmap(arg_addr);
       break;
+    case SYS_SCHEDSTAT:
+      f->eax = schedstat(arg_addr);
+      break;
+    case SYS_THREAD_SPAWN:
+      f->eax = sys_thread_spawn(arg_addr);
+      break;
+    case SYS_THREAD_JOIN:
+      f->eax = sys_thread_join(arg_addr);
+      break;
+    case SYS_FUTEX_WAIT:
+      f->eax = sys_futex_wait(arg_addr);
+      break;
+    case SYS_FUTEX_WAKE:
+      f->eax = sys_futex_wake(arg_addr);
+      break;
+    case SYS_MEMSTAT:
+      f->eax = memstat(arg_addr);
+      break;
+    case SYS_LARGEPAGES:
+      f->eax = sys_largepages(arg_addr);
+      break;
     }
+  TRACE (TRACE_SYSCALL_RETURN, syscall_num, f->eax, 0);
 }
 
 void halt () {
@@ -107,37 +148,48 @@ void exit (void* esp) {
 
 void exit_impl (int status) {
   struct list_elem *e, *next;
+  /* Only a process's initial thread tears the process down; any
+     other user thread just ends. */
+  bool is_process = thread_process() == thread_current();
 
-  struct list *mm_list = &thread_current()->mm_list;
-  // lock_acquire(&fs_lock);
-  for (e = list_begin(mm_list); e != list_end(mm_list);)
-  {
-    struct mm_item *ff = list_entry(e, struct mm_item, elem);
-     e = list_next(e);
+  if (is_process) {
+    process_wait_threads();
 
-    remove_mmap_spt_entry(ff->mapid);
-    list_remove(&ff->elem);
-    // munmap(ff->mapid);
-  }
-  // lock_release(&fs_lock);
+    struct list *mm_list = &thread_process()->mm_list;
+    // lock_acquire(&fs_lock);
+    for (e = list_begin(mm_list); e != list_end(mm_list);)
+    {
+      struct mm_item *ff = list_entry(e, struct mm_item, elem);
+       e = list_next(e);
 
-  _close_all_fd();
+      remove_mmap_spt_entry(ff->mapid);
+      list_remove(&ff->elem);
+      // munmap(ff->mapid);
+    }
+    // lock_release(&fs_lock);
 
+    _close_all_fd();
+  }
+
+  lock_acquire (&parent_child_lock);
   for (e=list_begin(&parent_child_list); e!=list_end(&parent_child_list); e=next) {
     next=list_next(e);
     struct child_status *cstat = list_entry(e, struct child_status, elem);
     if (cstat->parent_pid == thread_tid()) {
       list_remove(&cstat->elem);
-      free(cstat);
+      thread_free_child_status(cstat);
     }
     // update child status to later use in wait
     else if (cstat->child_pid == thread_tid()) {
       cstat->exit_status = status;
     }
   }
-  char *name;
-  char *process_name = strtok_r(thread_current()->command_line, " ", &name);
-  printf ("%s: exit(%d)\n", process_name, status);
+  lock_release (&parent_child_lock);
+  if (is_process) {
+    char *name;
+    char *process_name = strtok_r(thread_current()->command_line, " ", &name);
+    printf ("%s: exit(%d)\n", process_name, status);
+  }
   thread_exit();
 }
 
@@ -146,19 +198,23 @@ tid_t exec (void *esp) {
 
   if(!is_valid_pointer(cmd_line, 0)) exit(-1);
 
-  lock_acquire(&fs_lock);
+  /* Hold parent_child_lock until the record is in the list, so
+     that the child cannot look for it first. */
+  rwlock_acquire_write (&fs_lock);
+  lock_acquire (&parent_child_lock);
   tid_t pid = process_execute(cmd_line);
-  lock_release(&fs_lock);
+  rwlock_release_write (&fs_lock);
   // printf("pid %d: %s, syscall::exec for %d\n", thread_tid(), cmd_line, pid);
-  struct child_status *cstat = malloc(sizeof(struct child_status));
+  struct child_status *cstat = thread_alloc_child_status();
   // struct child_status *cstat = thread_get_child_status(pid);
   // struct child_status *cstat = palloc_get_page(0);
   cstat->parent_pid = thread_tid();
   cstat->child_pid = pid;
   cstat->exit_status = 1000;
-  sema_init(&cstat->sema_start, 0);
+  cstat->is_thread = false;
   
   list_push_back(&parent_child_list, &cstat->elem);
+  lock_release (&parent_child_lock);
 // printf("pid %d: exec %s waiting to start of %d\n", thread_tid(),  cmd_line, pid);
   sema_down(&cstat->sema_start); // wait for start process complete
   
@@ -173,22 +229,32 @@ int wait (void *esp) {
   int pid = *(int*) esp;
   if (isdebug2) printf("pid %d: syscall::wait for %d\n", thread_tid(), pid);
   struct list_elem *e, *next;
+  lock_acquire (&parent_child_lock);
   for (e=list_begin(&parent_child_list); e!=list_end(&parent_child_list); e=next) {
     next=list_next(e);
     struct child_status *cstat = list_entry(e, struct child_status, elem);
-    if (cstat->child_pid == pid) {
+    if (cstat->child_pid == pid && !cstat->is_thread) {
       // if waiting found
       // if (cstat->exit_status == -1) return -1;
       if (cstat->exit_status != 1000) { 
+        int status = cstat->exit_status;
         list_remove(&cstat->elem);
-        return cstat->exit_status;
+        lock_release (&parent_child_lock);
+        thread_free_child_status(cstat);
+        return status;
       }
+      /* Only we remove our children's records, so CSTAT stays
+         put while we wait without the lock. */
+      lock_release (&parent_child_lock);
       int result = process_wait(cstat->child_pid);
+      lock_acquire (&parent_child_lock);
       list_remove(&cstat->elem);
-      free(cstat);
+      lock_release (&parent_child_lock);
+      thread_free_child_status(cstat);
       return result;
     }
   }
+  lock_release (&parent_child_lock);
   return -1;
 }
 
@@ -206,9 +272,9 @@ create (void *esp) {
   if (!is_valid_pointer(file_name, 0))
     exit(-1);
 
-  lock_acquire(&fs_lock);
+  rwlock_acquire_write (&fs_lock);
   bool returnVal = filesys_create(file_name, initial_size);
-  lock_release(&fs_lock);
+  rwlock_release_write (&fs_lock);
   // printf("create is: %s, %d, %d\n", file_name, initial_size, returnVal);
   return returnVal;
 }
@@ -220,9 +286,9 @@ bool remove (void *esp) {
   if (!is_valid_pointer(file_name, 0))
     exit(-1);
 
-  lock_acquire(&fs_lock);
+  rwlock_acquire_write (&fs_lock);
   bool returnVal = filesys_remove(file_name);
-  lock_release(&fs_lock);
+  rwlock_release_write (&fs_lock);
   return returnVal;
 }
 
@@ -234,27 +300,27 @@ int open (void *esp) {
   if (!is_valid_pointer(file_name, 0))
     exit(-1);
 
-  lock_acquire(&fs_lock);
+  rwlock_acquire_write (&fs_lock);
   struct file *f = filesys_open(file_name);
   if (f == NULL)
   {
-    lock_release(&fs_lock);
+    rwlock_release_write (&fs_lock);
     return -1;
   }
 
   int old_max_fd;
-  if (list_empty(&thread_current()->fd_list))
+  if (list_empty(&thread_process()->fd_list))
     old_max_fd = 2;
   else
-    old_max_fd = list_entry(list_front(&thread_current()->fd_list), struct fd_file, elem)->fd;
+    old_max_fd = list_entry(list_front(&thread_process()->fd_list), struct fd_file, elem)->fd;
 
   // printf("old max_fd is %d\n", old_max_fd);
-  struct fd_file *ff = malloc(sizeof(struct fd_file));
+  struct fd_file *ff = kmem_cache_alloc(&fd_cache);
   ff->fd = old_max_fd + 1;
   ff->file_ptr = f;
   strlcpy(ff->file_name, file_name, strlen(file_name) + 1);
-  list_push_front(&thread_current()->fd_list, &ff->elem);
-  lock_release(&fs_lock);
+  list_push_front(&thread_process()->fd_list, &ff->elem);
+  rwlock_release_write (&fs_lock);
 
   // printf("file p=%p, fd=%d\n",f, ff->fd);
   return ff->fd;
@@ -263,20 +329,20 @@ int open (void *esp) {
 int filesize (void *esp) {
   int fd = *(int*) esp;
 
-  struct list *fd_list = &thread_current()->fd_list;
+  struct list *fd_list = &thread_process()->fd_list;
   struct list_elem *e;
-  lock_acquire(&fs_lock);
+  rwlock_acquire_read (&fs_lock);
   for (e = list_begin(fd_list); e != list_end(fd_list); e = list_next(e))
   {
     struct fd_file *ff = list_entry(e, struct fd_file, elem);
     if (ff->fd == fd)
     {
       int returnVal = file_length(ff->file_ptr);
-      lock_release(&fs_lock);
+      rwlock_release_read (&fs_lock);
       return returnVal;
     }
   }
-  lock_release(&fs_lock);
+  rwlock_release_read (&fs_lock);
   return -1;
 }
 
@@ -300,9 +366,9 @@ int read (void *esp) {
     exit(-1);
   }
 
-  lock_acquire(&fs_lock);
+  rwlock_acquire_write (&fs_lock);
   struct file *file = NULL;
-  struct list *fd_list = &thread_current()->fd_list;
+  struct list *fd_list = &thread_process()->fd_list;
   struct list_elem *e;
   for (e=list_begin(fd_list); e!=list_end(fd_list); e=list_next(e)) {
     struct fd_file *ff = list_entry(e, struct fd_file, elem);
@@ -314,7 +380,7 @@ int read (void *esp) {
 
   if (file == NULL)
   {
-    lock_release(&fs_lock);
+    rwlock_release_write (&fs_lock);
     return -1;
   }
   void *upage = pg_round_down(buffer);
@@ -329,7 +395,7 @@ int read (void *esp) {
     if ((entry_p == NULL && !handle_page_fault(upage + i, esp)) ||
         (entry_p != NULL && !entry_p->writeable))
     {
-      lock_release(&fs_lock);
+      rwlock_release_write (&fs_lock);
       exit_impl(-1);
     }
       // entry_p->pinning = true;
@@ -340,7 +406,7 @@ int read (void *esp) {
     struct spt_entry *entry_p = fetch_spt_entry(upage + i);
     // entry_p->pinning = false;
   }
-  lock_release(&fs_lock);
+  rwlock_release_write (&fs_lock);
   return size;
 }
 
@@ -367,10 +433,10 @@ int write (void *esp) {
     return size;
   }
   
-  lock_acquire(&fs_lock);
+  rwlock_acquire_write (&fs_lock);
   struct file *file = NULL;
   struct fd_file *ff_pick;
-  struct list *fd_list = &thread_current()->fd_list;
+  struct list *fd_list = &thread_process()->fd_list;
   struct list_elem *e;
   for (e=list_begin(fd_list); e!=list_end(fd_list); e=list_next(e)) {
     struct fd_file *ff = list_entry(e, struct fd_file, elem);
@@ -382,7 +448,7 @@ int write (void *esp) {
   }
   
   if (file == NULL || ff_pick == NULL) {
-    lock_release(&fs_lock);
+    rwlock_release_write (&fs_lock);
     exit_impl(-1);
   }
 
@@ -395,7 +461,7 @@ int write (void *esp) {
     struct spt_entry *entry_p = fetch_spt_entry(upage + i);
     if (entry_p == NULL)
     {
-      lock_release(&fs_lock);
+      rwlock_release_write (&fs_lock);
       exit_impl(-1);
     }
     entry_p->pinning = true;
@@ -414,7 +480,7 @@ int write (void *esp) {
     entry_p->pinning = false;
   }
 
-  lock_release(&fs_lock);
+  rwlock_release_write (&fs_lock);
   return size;
 }
 
@@ -425,8 +491,8 @@ void seek (void *esp) {
 
   // printf("sick %d %d\n", fd, position);
   
-  lock_acquire(&fs_lock);
-  struct list *fd_list = &thread_current()->fd_list;
+  rwlock_acquire_write (&fs_lock);
+  struct list *fd_list = &thread_process()->fd_list;
   struct list_elem *e;
   for (e=list_begin(fd_list); e!=list_end(fd_list); e=list_next(e)) {
     struct fd_file *ff = list_entry(e, struct fd_file, elem);
@@ -435,33 +501,33 @@ void seek (void *esp) {
       break;
     }
   }
-  lock_release(&fs_lock);
+  rwlock_release_write (&fs_lock);
 }
 
 // unsigned tell (int fd)
 unsigned tell (void *esp) {
   int fd = *(int*) esp;
 
-  lock_acquire(&fs_lock);
-  struct list *fd_list = &thread_current()->fd_list;
+  rwlock_acquire_read (&fs_lock);
+  struct list *fd_list = &thread_process()->fd_list;
   struct list_elem *e;
   for (e=list_begin(fd_list); e!=list_end(fd_list); e=list_next(e)) {
     struct fd_file *ff = list_entry(e, struct fd_file, elem);
     if (ff->fd == fd) {
-      lock_release(&fs_lock);
+      rwlock_release_read (&fs_lock);
       return file_tell(ff->file_ptr);
     }
   }
-  lock_release(&fs_lock);
+  rwlock_release_read (&fs_lock);
   return -1;
 }
 
 void close (void *esp) {
   int fd = *(int*) esp;
 
-  struct list *fd_list = &thread_current()->fd_list;
+  struct list *fd_list = &thread_process()->fd_list;
   struct list_elem *e, *next;
-  lock_acquire(&fs_lock);
+  rwlock_acquire_write (&fs_lock);
   for (e=list_begin(fd_list); e!=list_end(fd_list); e=next) {
     struct fd_file *ff = list_entry(e, struct fd_file, elem);
     next = list_next(e);
@@ -469,7 +535,7 @@ void close (void *esp) {
     {
       // printf("closing %d, %p\n\n", fd, ff->file_ptr);
       bool is_using = false;
-      struct list *mm_list = &thread_current()->mm_list;
+      struct list *mm_list = &thread_process()->mm_list;
       struct list_elem *e;
       for (e = list_begin(mm_list); e != list_end(mm_list); e = list_next(e))
       {
@@ -484,11 +550,11 @@ void close (void *esp) {
       if (!is_using)
         file_close(ff->file_ptr);
       list_remove(&ff->elem);
-      free(ff);
+      kmem_cache_free(&fd_cache, ff);
       break;
     }
   }
-  lock_release(&fs_lock);
+  rwlock_release_write (&fs_lock);
 }
 
 // mapid_t mmap (int fd, void *addr)
@@ -499,8 +565,8 @@ int mmap (void *esp) {
   // printf("mmap %d %d\n", fd, addr);
   
   struct file *file = NULL;
-  lock_acquire(&fs_lock);
-  struct list *fd_list = &thread_current()->fd_list;
+  rwlock_acquire_write (&fs_lock);
+  struct list *fd_list = &thread_process()->fd_list;
   struct list_elem *e;
   for (e = list_begin(fd_list); e != list_end(fd_list); e = list_next(e))
   {
@@ -513,30 +579,30 @@ int mmap (void *esp) {
 
   if (addr == NULL || file == NULL || pg_ofs(addr) != 0)
   {
-    lock_release(&fs_lock);
+    rwlock_release_write (&fs_lock);
     return -1;
   }
 
   int old_max_mapid;
-  if (list_empty(&thread_current()->mm_list))
+  if (list_empty(&thread_process()->mm_list))
     old_max_mapid = 1;
   else
-    old_max_mapid = list_entry(list_front(&thread_current()->mm_list), struct mm_item, elem)->mapid;
+    old_max_mapid = list_entry(list_front(&thread_process()->mm_list), struct mm_item, elem)->mapid;
 
-  struct mm_item *mm = malloc(sizeof(struct mm_item));
+  struct mm_item *mm = malloc_tagged(sizeof(struct mm_item), MEM_VM);
   mm->mapid = old_max_mapid + 1;
   mm->file_ptr = file;
   int read_bytes = file_length(file);
   int zero_bytes = ROUND_UP(read_bytes, PGSIZE) - read_bytes;
   if (add_spt_entry_mmap(file, 0, addr, read_bytes, zero_bytes, true, mm->mapid))
-    list_push_back(&thread_current()->mm_list, &mm->elem);
+    list_push_back(&thread_process()->mm_list, &mm->elem);
   else
   {
-    lock_release(&fs_lock);
+    rwlock_release_write (&fs_lock);
     return -1;
   }
 
-  lock_release(&fs_lock);
+  rwlock_release_write (&fs_lock);
 
   return mm->mapid;
 }
@@ -548,7 +614,7 @@ void munmap (void *esp) {
 
   int mapid = *(int*)esp;
   remove_mmap_spt_entry(mapid);
-  struct list *mm_list = &thread_current()->mm_list;
+  struct list *mm_list = &thread_process()->mm_list;
   struct list_elem *e;
   for (e = list_begin(mm_list); e != list_end(mm_list); e = list_next(e))
   {
@@ -565,18 +631,140 @@ void munmap (void *esp) {
   return;
 }
 
+// bool schedstat (struct schedstat *stats)
+bool schedstat (void *esp) {
+  if (!is_valid_pointer(esp, 4)) exit(-1);
+
+  struct schedstat *stats = *(struct schedstat **) esp;
+  if (!is_writable_buffer(stats, sizeof *stats))
+    exit(-1);
+
+  /* Take the snapshot first: it is made with interrupts off, and
+     writing to user memory may fault. */
+  struct schedstat snapshot;
+  thread_get_schedstat(&snapshot);
+  memcpy(stats, &snapshot, sizeof snapshot);
+  return true;
+}
+
+// bool memstat (struct memstat *stats)
+bool memstat (void *esp) {
+  if (!is_valid_pointer(esp, 4)) exit(-1);
+
+  struct memstat *stats = *(struct memstat **) esp;
+  if (!is_writable_buffer(stats, sizeof *stats))
+    exit(-1);
+
+  /* As for schedstat(), snapshot before touching user memory. */
+  struct memstat snapshot;
+  memtag_get_stats(&snapshot);
+  large_get_stats(&snapshot);
+  memcpy(stats, &snapshot, sizeof snapshot);
+  return true;
+}
+
+/* The calls below take their arguments straight from the words
+   pushed by lib/user/syscall.c. */
+
+// tid_t thread_spawn (void (*entry) (void *, void *), void *a, void *b)
+static tid_t sys_thread_spawn (void *esp) {
+  if (!is_valid_pointer(esp, 12)) exit_impl(-1);
+
+  void *entry = *(void **) esp;
+  void *arg0 = *(void **) (esp + 4);
+  void *arg1 = *(void **) (esp + 8);
+  if (!is_user_vaddr(entry)) exit_impl(-1);
+
+  return process_thread_create(entry, arg0, arg1);
+}
+
+// int thread_join (tid_t tid)
+static int sys_thread_join (void *esp) {
+  if (!is_valid_pointer(esp, 4)) exit_impl(-1);
+
+  return process_thread_join(*(tid_t *) esp);
+}
+
+// int futex_wait (int *addr, int val)
+static int sys_futex_wait (void *esp) {
+  if (!is_valid_pointer(esp, 8)) exit_impl(-1);
+
+  int *addr = *(int **) esp;
+  int val = *(int *) (esp + 4);
+  if ((uintptr_t) addr % sizeof *addr != 0
+      || !is_valid_pointer(addr, sizeof *addr))
+    exit_impl(-1);
+
+  return futex_wait(addr, val);
+}
+
+// int futex_wake (int *addr, int cnt)
+static int sys_futex_wake (void *esp) {
+  if (!is_valid_pointer(esp, 8)) exit_impl(-1);
+
+  int *addr = *(int **) esp;
+  int cnt = *(int *) (esp + 4);
+  if ((uintptr_t) addr % sizeof *addr != 0 || !is_user_vaddr(addr))
+    exit_impl(-1);
+
+  return futex_wake(addr, cnt);
+}
+
+// int largepages (void *addr, size_t size)
+static int sys_largepages (void *esp) {
+  if (!is_valid_pointer(esp, 8)) exit_impl(-1);
+
+  uint8_t *addr = *(uint8_t **) esp;
+  size_t size = *(size_t *) (esp + 4);
+  if (!is_user_vaddr(addr) || size > (size_t) ((uint8_t *) PHYS_BASE - addr))
+    exit_impl(-1);
+
+  return spt_want_large(addr, addr + size);
+}
+
 void _close_all_fd (void) {
-  struct list *fd_list = &thread_current()->fd_list;
+  struct list *fd_list = &thread_process()->fd_list;
   struct list_elem *e, *next;
-  lock_acquire(&fs_lock);
+  rwlock_acquire_write (&fs_lock);
   for (e=list_begin(fd_list); e!=list_end(fd_list); e=next) {
     struct fd_file *ff = list_entry(e, struct fd_file, elem);
     next = list_next(e);
     file_close(ff->file_ptr);
     list_remove(&ff->elem);
-    free(ff);
+    kmem_cache_free(&fd_cache, ff);
+  }
+  rwlock_release_write (&fs_lock);
+}
+
+/* Returns true if every page of the SIZE bytes at user address
+   BUF may be written by the process, growing the stack for pages
+   just above the stack pointer as read() does.  A page that is
+   mapped read-only, or not mapped at all, fails, so the kernel
+   never writes into either. */
+static bool is_writable_buffer (void *buf, size_t size) {
+  uint8_t *first = pg_round_down(buf);
+  uint8_t *last;
+  uint8_t *upage;
+
+  if (size == 0)
+    return true;
+  if (!is_user_vaddr(buf) || size > (size_t) ((uint8_t *) PHYS_BASE - (uint8_t *) buf))
+    return false;
+  last = pg_round_down((uint8_t *) buf + size - 1);
+
+  for (upage = first; upage <= last; upage += PGSIZE)
+  {
+    struct spt_entry *entry_p = fetch_spt_entry(upage);
+    if (entry_p == NULL)
+    {
+      if (!handle_page_fault(upage, thread_current()->sys_esp))
+        return false;
+      entry_p = fetch_spt_entry(upage);
+    }
+    if (entry_p == NULL || !entry_p->writeable)
+      return false;
   }
-  lock_release(&fs_lock);
+  return true;
 }
 
 bool is_valid_pointer (void *esp, int max_length) {
@@ -1,9 +1,11 @@
 #ifndef USERPROG_SYSCALL_H
 #define USERPROG_SYSCALL_H
 
+#include "threads/synch.h"
+
 void syscall_init (void);
 void exit_impl (int status);
 
-struct lock fs_lock;
+struct rwlock fs_lock;
 
 #endif /* userprog/syscall.h */
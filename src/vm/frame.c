@@ -1,14 +1,20 @@
 #include "frame.h"
-#include "threads/malloc.h"
+#include "threads/slab.h"
 #include "threads/synch.h"
+#include "threads/trace.h"
 #include "userprog/pagedir.h"
 #include <debug.h>
 #include <stdio.h>
 
 void _ffree(struct frame_entry *entry_p);
 
+/* Cache of frame table entries. */
+static struct kmem_cache frame_cache;
+
 void finit(void)
 {
+    kmem_cache_init(&frame_cache, "frame_entry", sizeof(struct frame_entry),
+                    NULL, MEM_VM);
     list_init(&frame_table);
     lock_init(&f_lock);
     lock_init(&evict_lock);
@@ -29,9 +35,9 @@ void *falloc(enum palloc_flags f, struct spt_entry *spte_p)
         frame = palloc_get_page(f);
     }
 
-    struct frame_entry *entry_p = malloc(sizeof(struct frame_entry));
+    struct frame_entry *entry_p = kmem_cache_alloc(&frame_cache);
     entry_p->frame = frame;
-    entry_p->t = thread_current();
+    entry_p->t = thread_process();
     entry_p->spt_entry = spte_p;
 
     // printf("fallocing complete %p\n", frame);
@@ -61,6 +67,9 @@ bool evict(void)
     int max_count = -1;
     struct list_elem *e;
     bool is_dirty;
+    /* While the kernel pool is short, prefer frames it lent us. */
+    bool reclaim = palloc_reclaim_wanted();
+    bool evict_lent = false;
 
     // lock_acquire(&evict_lock);
     lock_acquire(&f_lock);
@@ -93,22 +102,33 @@ bool evict(void)
             if (spte_p->pinning)
                 continue;
 
-            if (entry_p->unused_cnt > max_count)
+            bool is_lent = reclaim && palloc_page_lent(entry_p->frame);
+            if ((is_lent && !evict_lent) ||
+                (is_lent == evict_lent && entry_p->unused_cnt > max_count))
             {
                 is_dirty = is_last_dirty;
                 entry_to_evict = entry_p;
                 max_count = entry_p->unused_cnt;
+                evict_lent = is_lent;
             }
             entry_p->unused_cnt = 0;
         }
     }
     // printf("eviction %p: %p\n", entry_to_evict, entry_to_evict->spt_entry->upage);
     // entry_to_evict->spt_entry->pinning = true;
+    TRACE(TRACE_EVICT, entry_to_evict->spt_entry->upage,
+          entry_to_evict->spt_entry->thread->tid, is_dirty);
     entry_to_evict->spt_entry->type = IN_SWAP;
     write_back(entry_to_evict->spt_entry, entry_to_evict->frame, is_dirty);
     list_remove(&entry_to_evict->elem);
     lock_release(&f_lock);
-    _ffree(entry_to_evict);
+    if (evict_lent)
+    {
+        palloc_reclaim_page(entry_to_evict->frame);
+        kmem_cache_free(&frame_cache, entry_to_evict);
+    }
+    else
+        _ffree(entry_to_evict);
     // entry_to_evict->spt_entry->pinning = false;
     // printf("eviction complete\n");
     // lock_release(&evict_lock);
@@ -156,6 +176,6 @@ void _ffree(struct frame_entry *entry_p)
 {
     // printf("freeing %p\n", entry_p->frame);
     palloc_free_page(entry_p->frame);
-    free(entry_p);
+    kmem_cache_free(&frame_cache, entry_p);
     // printf("free complete %p\n", entry_p->frame);
 }
\ No newline at end of file
@@ -1,14 +1,41 @@
 #include "frame.h"
 #include "swap.h"
+#include <round.h>
 #include <stdio.h>
+#include <string.h>
 #include "userprog/pagedir.h"
 #include "userprog/syscall.h"
-#include "threads/malloc.h"
+#include "threads/init.h"
 #include "threads/palloc.h"
+#include "threads/pte.h"
+#include "threads/slab.h"
 #include "threads/vaddr.h"
 #include "threads/thread.h"
 
 static bool install_page(void *upage, void *kpage, bool writable);
+static bool load_large(struct spt_entry *entry_p);
+static void release_large(struct thread *t, void *upage);
+
+/* Cache of supplemental page table entries. */
+static struct kmem_cache spt_cache;
+
+/* Large pages are never evicted, so together they may hold at
+   most this part of the user pool, as a shift count.  The rest
+   is left to pages that can be evicted. */
+#define LARGE_SHARE_SHIFT 1
+
+/* Large page statistics. */
+static unsigned long long large_maps;      /* 4 MB regions mapped. */
+static unsigned long long large_unmaps;    /* ...and unmapped since. */
+static unsigned long long large_fallbacks; /* Mapped with 4 kB pages for
+                                              lack of contiguous frames
+                                              or over the share. */
+
+void spt_init(void)
+{
+    kmem_cache_init(&spt_cache, "spt_entry", sizeof(struct spt_entry), NULL,
+                    MEM_VM);
+}
 
 void add_spt_entry_file(struct file *file, off_t ofs, uint8_t *upage,
                         uint32_t read_bytes, uint32_t zero_bytes, bool writable)
@@ -26,9 +53,9 @@ void add_spt_entry_file(struct file *file, off_t ofs, uint8_t *upage,
         size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
         size_t page_zero_bytes = PGSIZE - page_read_bytes;
 
-        struct thread *t = thread_current();
+        struct thread *t = thread_process();
 
-        struct spt_entry *entry_p = malloc(sizeof(struct spt_entry));
+        struct spt_entry *entry_p = kmem_cache_alloc(&spt_cache);
         entry_p->file = file;
         entry_p->offset = ofs;
         entry_p->upage = upage;
@@ -38,12 +65,13 @@ void add_spt_entry_file(struct file *file, off_t ofs, uint8_t *upage,
         entry_p->type = IN_FILE;
         entry_p->pinning = false;
         entry_p->writeable = writable;
+        entry_p->large_ok = entry_p->large = false;
 
         // printf("add entry %p: %d\n", upage, writable);
 
-        lock_acquire(&t->spt_lock);
+        rwlock_acquire_write (&t->spt_lock);
         list_push_back(&t->spage_table, &entry_p->elem);
-        lock_release(&t->spt_lock);
+        rwlock_release_write (&t->spt_lock);
 
         /* Advance. */
         read_bytes -= page_read_bytes;
@@ -71,7 +99,7 @@ bool add_spt_entry_mmap(struct file *file, off_t ofs, uint8_t *upage,
         size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
         size_t page_zero_bytes = PGSIZE - page_read_bytes;
 
-        struct thread *t = thread_current();
+        struct thread *t = thread_process();
 
         // mmap-overlap
         struct spt_entry *old_entry = fetch_spt_entry(upage);
@@ -81,7 +109,7 @@ bool add_spt_entry_mmap(struct file *file, off_t ofs, uint8_t *upage,
             return false;
         }
 
-        struct spt_entry *entry_p = malloc(sizeof(struct spt_entry));
+        struct spt_entry *entry_p = kmem_cache_alloc(&spt_cache);
         entry_p->file = file;
         entry_p->offset = ofs;
         entry_p->upage = upage;
@@ -92,10 +120,11 @@ bool add_spt_entry_mmap(struct file *file, off_t ofs, uint8_t *upage,
         entry_p->pinning = false;
         entry_p->mapid = mapid;
         entry_p->writeable = writable;
+        entry_p->large_ok = entry_p->large = false;
 
-        lock_acquire(&t->spt_lock);
+        rwlock_acquire_write (&t->spt_lock);
         list_push_back(&t->spage_table, &entry_p->elem);
-        lock_release(&t->spt_lock);
+        rwlock_release_write (&t->spt_lock);
 
         /* Advance. */
         read_bytes -= page_read_bytes;
@@ -108,8 +137,29 @@ bool add_spt_entry_mmap(struct file *file, off_t ofs, uint8_t *upage,
 
 void remove_mmap_spt_entry(int mapid)
 {
-    struct thread *t = thread_current();
+    struct thread *t = thread_process();
     struct list_elem *e;
+
+    /* A large page's dirty bit covers all of its pages, so write
+       them all back before unmapping any of them. */
+    for (e = list_begin(&t->spage_table); e != list_end(&t->spage_table);
+         e = list_next(e))
+    {
+        struct spt_entry *entry_p = list_entry(e, struct spt_entry, elem);
+        if (entry_p->large && entry_p->type == IN_MMAP
+            && entry_p->mapid == mapid
+            && pagedir_is_dirty(t->pagedir, entry_p->upage))
+            write_back(entry_p, NULL, true);
+    }
+    for (e = list_begin(&t->spage_table); e != list_end(&t->spage_table);
+         e = list_next(e))
+    {
+        struct spt_entry *entry_p = list_entry(e, struct spt_entry, elem);
+        if (entry_p->large && entry_p->type == IN_MMAP
+            && entry_p->mapid == mapid)
+            release_large(t, entry_p->upage);
+    }
+
     for (e = list_begin(&t->spage_table); e != list_end(&t->spage_table);)
     {
         struct spt_entry *entry_p = list_entry(e, struct spt_entry, elem);
@@ -123,7 +173,7 @@ void remove_mmap_spt_entry(int mapid)
             ffree(pagedir_get_page(t->pagedir, entry_p->upage));
             list_remove(&entry_p->elem);
 
-            free(entry_p);
+            kmem_cache_free(&spt_cache, entry_p);
         }
     }
 }
@@ -137,23 +187,58 @@ void remove_spt_entry(struct thread *t)
         struct spt_entry *entry_p = list_entry(e, struct spt_entry, elem);
         e = list_next(e);
         // ffree(pagedir_get_page(t->pagedir, entry_p->upage));
+        if (entry_p->large)
+            release_large(t, entry_p->upage);
+        if (entry_p->type == IN_SWAP && entry_p->swap != NULL)
+            swap_discard(entry_p->swap);
         pagedir_clear_page(t->pagedir, entry_p->upage);
 
-        free(entry_p);
+        kmem_cache_free(&spt_cache, entry_p);
     }
 }
 
+/* Unmaps and frees T's pages in [LO, HI), such as the stack of a
+   user thread that has exited. */
+void remove_spt_range(struct thread *t, void *lo, void *hi)
+{
+    struct list_elem *e;
+    rwlock_acquire_write (&t->spt_lock);
+    for (e = list_begin(&t->spage_table); e != list_end(&t->spage_table);)
+    {
+        struct spt_entry *entry_p = list_entry(e, struct spt_entry, elem);
+        e = list_next(e);
+        if (entry_p->upage >= lo && entry_p->upage < hi)
+        {
+            void *kpage = pagedir_get_page(t->pagedir, entry_p->upage);
+            pagedir_clear_page(t->pagedir, entry_p->upage);
+            if (kpage != NULL)
+                ffree(kpage);
+            if (entry_p->type == IN_SWAP && entry_p->swap != NULL)
+                swap_discard(entry_p->swap);
+            list_remove(&entry_p->elem);
+            kmem_cache_free(&spt_cache, entry_p);
+        }
+    }
+    rwlock_release_write (&t->spt_lock);
+}
+
 struct spt_entry *fetch_spt_entry(void *upage)
 {
-    struct thread *t = thread_current();
+    struct thread *t = thread_process();
+    struct spt_entry *found = NULL;
     struct list_elem *e;
+    rwlock_acquire_read (&t->spt_lock);
     for (e = list_begin(&t->spage_table); e != list_end(&t->spage_table); e = list_next(e))
     {
         struct spt_entry *entry_p = list_entry(e, struct spt_entry, elem);
         if (entry_p->upage == upage)
-            return entry_p;
+        {
+            found = entry_p;
+            break;
+        }
     }
-    return NULL;
+    rwlock_release_read (&t->spt_lock);
+    return found;
 }
 
 bool handle_page_fault(void *upage, void *esp)
@@ -173,7 +258,8 @@ bool handle_page_fault(void *upage, void *esp)
     {
         // printf("handle pf2\n");
         entry_p->pinning = true;
-        load_spte_file(entry_p);
+        if (!entry_p->large_ok || !load_large(entry_p))
+            load_spte_file(entry_p);
         entry_p->pinning = false;
     }
     else if (entry_p->type == IN_SWAP)
@@ -188,7 +274,8 @@ bool handle_page_fault(void *upage, void *esp)
         // printf("handle pf4\n");
         //mmap
         entry_p->pinning = true;
-        load_spte_file(entry_p);
+        if (!entry_p->large_ok || !load_large(entry_p))
+            load_spte_file(entry_p);
         entry_p->pinning = false;
     }
     else if (entry_p != NULL)
@@ -205,9 +292,7 @@ bool handle_page_fault(void *upage, void *esp)
 void load_spte_zero(struct spt_entry *entry_p)
 {
     /* Get a page of memory. */
-    uint8_t *kpage = falloc(PAL_USER, entry_p);
-
-    memset(kpage, 0, PGSIZE);
+    uint8_t *kpage = falloc(PAL_USER | PAL_ZERO, entry_p);
 
     if (!install_page(entry_p->upage, kpage, true))
     {
@@ -259,7 +344,7 @@ void load_spte_file(struct spt_entry *entry_p)
 static bool
 install_page(void *upage, void *kpage, bool writable)
 {
-    struct thread *t = thread_current();
+    struct thread *t = thread_process();
 
     /* Verify that there's not already a page at that virtual
      address, then map our page there. */
@@ -269,19 +354,20 @@ install_page(void *upage, void *kpage, bool writable)
 void grow_stack(void *upage)
 {
     // printf("grow stack %p\n", upage);
-    struct spt_entry *entry_p = malloc(sizeof(struct spt_entry));
+    struct spt_entry *entry_p = kmem_cache_alloc(&spt_cache);
 
     uint8_t *kpage = falloc(PAL_USER | PAL_ZERO, entry_p);
-    struct thread *t = thread_current();
+    struct thread *t = thread_process();
 
     entry_p->upage = upage;
     entry_p->type = STACK;
     entry_p->thread = t;
     entry_p->writeable = true;
+    entry_p->large_ok = entry_p->large = false;
 
-    lock_acquire(&t->spt_lock);
+    rwlock_acquire_write (&t->spt_lock);
     list_push_back(&t->spage_table, &entry_p->elem);
-    lock_release(&t->spt_lock);
+    rwlock_release_write (&t->spt_lock);
 
     if (!install_page(upage, kpage, true))
     {
@@ -307,4 +393,161 @@ void write_back(struct spt_entry *entry_p, void *kpage, bool is_dirty)
         // printf("write back to swap %p: %d\n", entry_p->upage, entry_p->swap->swap_idx);
     }
     pagedir_clear_page(entry_p->thread->pagedir, entry_p->upage);
-}
\ No newline at end of file
+}
+
+/* Asks for the current process's pages in [LO, HI) to be loaded
+   as 4 MB pages where possible.  This only takes effect for each
+   4 MB-aligned part of the range whose pages are all backed by
+   the same file, or all zero-filled, and not yet loaded, and
+   only while large pages hold less than their share of the user
+   pool (see load_large()); other parts get 4 kB pages.  Returns
+   the number of such 4 MB parts that [LO, HI) covers entirely. */
+int spt_want_large(void *lo, void *hi)
+{
+    struct thread *t = thread_process();
+    uintptr_t first = ROUND_UP((uintptr_t)lo, LARGE_PGSIZE);
+    uintptr_t last = ROUND_DOWN((uintptr_t)hi, LARGE_PGSIZE);
+    struct list_elem *e;
+
+    if (!pse_enabled || first >= last)
+        return 0;
+
+    rwlock_acquire_write (&t->spt_lock);
+    for (e = list_begin(&t->spage_table); e != list_end(&t->spage_table);
+         e = list_next(e))
+    {
+        struct spt_entry *entry_p = list_entry(e, struct spt_entry, elem);
+        if ((uintptr_t)entry_p->upage >= first && (uintptr_t)entry_p->upage < last)
+            entry_p->large_ok = true;
+    }
+    rwlock_release_write (&t->spt_lock);
+    return (last - first) / LARGE_PGSIZE;
+}
+
+/* Returns true if page ENTRY_P can share a large page with
+   FIRST, the page that faulted. */
+static bool large_compatible(struct spt_entry *entry_p, struct spt_entry *first)
+{
+    return (entry_p->large_ok && entry_p->type == first->type
+            && entry_p->file == first->file
+            && entry_p->writeable == first->writeable
+            && (entry_p->type != IN_MMAP || entry_p->mapid == first->mapid));
+}
+
+/* Tries to load the 4 MB-aligned region around ENTRY_P's page,
+   and map it, as one large page.  Every page in the region must
+   be compatible with ENTRY_P and none may be loaded yet, and
+   there must be a free, aligned block of LARGE_PGCNT user frames.
+   Large pages are not in the frame table, so they stay in memory
+   until unmapped, and all of them together may hold only
+   1/2**LARGE_SHARE_SHIFT of the user pool.  Returns false if the region cannot be loaded
+   this way, in which case the caller should load ENTRY_P's page
+   by itself, and the other pages in the region will be too. */
+static bool load_large(struct spt_entry *entry_p)
+{
+    struct thread *t = thread_process();
+    uint8_t *base = (uint8_t *)((uintptr_t)entry_p->upage & PDE_LARGE_ADDR);
+    struct spt_entry **region;
+    struct list_elem *e;
+    uint8_t *kpage = NULL;
+    bool ok = true;
+    size_t i;
+
+    /* Gather the region's entries, indexed by page. */
+    region = palloc_get_page(PAL_ZERO | PAL_TAG(MEM_VM));
+    if (region == NULL)
+        return false;
+    rwlock_acquire_read (&t->spt_lock);
+    for (e = list_begin(&t->spage_table); e != list_end(&t->spage_table);
+         e = list_next(e))
+    {
+        struct spt_entry *r = list_entry(e, struct spt_entry, elem);
+        if (r->upage >= (void *)base && r->upage < (void *)(base + LARGE_PGSIZE))
+            region[pg_no(r->upage) % LARGE_PGCNT] = r;
+    }
+    rwlock_release_read (&t->spt_lock);
+
+    for (i = 0; ok && i < LARGE_PGCNT; i++)
+        ok = (region[i] != NULL && large_compatible(region[i], entry_p)
+              && pagedir_get_page(t->pagedir, region[i]->upage) == NULL);
+
+    if (ok && (large_maps - large_unmaps + 1) * LARGE_PGCNT
+                  > palloc_user_page_cnt() >> LARGE_SHARE_SHIFT)
+    {
+        large_fallbacks++;
+        ok = false;
+    }
+
+    if (ok)
+    {
+        kpage = palloc_get_multiple(PAL_USER, LARGE_PGCNT);
+        if (kpage != NULL && vtop(kpage) % LARGE_PGSIZE != 0)
+        {
+            palloc_free_multiple(kpage, LARGE_PGCNT);
+            kpage = NULL;
+        }
+        if (kpage == NULL)
+        {
+            large_fallbacks++;
+            ok = false;
+        }
+    }
+
+    for (i = 0; ok && i < LARGE_PGCNT; i++)
+    {
+        struct spt_entry *r = region[i];
+        uint8_t *p = kpage + i * PGSIZE;
+        ok = file_read_at(r->file, p, r->read_bytes, r->offset) == (int)r->read_bytes;
+        memset(p + r->read_bytes, 0, r->zero_bytes);
+    }
+
+    if (ok && pagedir_set_large(t->pagedir, base, kpage, entry_p->writeable))
+    {
+        for (i = 0; i < LARGE_PGCNT; i++)
+            region[i]->large = true;
+        large_maps++;
+    }
+    else
+    {
+        /* Don't try again for every other page in the region. */
+        ok = false;
+        if (kpage != NULL)
+            palloc_free_multiple(kpage, LARGE_PGCNT);
+        for (i = 0; i < LARGE_PGCNT; i++)
+            if (region[i] != NULL)
+                region[i]->large_ok = false;
+        entry_p->large_ok = false;
+    }
+    palloc_free_page(region);
+    return ok;
+}
+
+/* Unmaps and frees the large page in T that holds UPAGE, if it
+   is still mapped. */
+static void release_large(struct thread *t, void *upage)
+{
+    void *kpage = pagedir_clear_large(t->pagedir, upage);
+    if (kpage != NULL)
+    {
+        palloc_free_multiple(kpage, LARGE_PGCNT);
+        large_unmaps++;
+    }
+}
+
+/* Adds large page statistics to MS. */
+void large_get_stats(struct memstat *ms)
+{
+    ms->user_large = large_maps - large_unmaps;
+    ms->large_maps = large_maps;
+    ms->large_fallbacks = large_fallbacks;
+}
+
+/* Prints large page statistics. */
+void large_print_stats(void)
+{
+    if (large_maps == 0 && large_fallbacks == 0)
+        return;
+    printf("Large pages: %llu mapped, %llu unmapped, "
+           "%llu fell back to 4 kB pages\n",
+           large_maps, large_unmaps, large_fallbacks);
+}
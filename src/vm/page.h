@@ -1,4 +1,5 @@
 #include <list.h>
+#include <memstat.h>
 #include "threads/thread.h"
 #include "filesys/file.h"
 
@@ -26,14 +27,18 @@ struct spt_entry
 
     struct swap_entry *swap;
     bool pinning;
+    bool large_ok; /* May be loaded as part of a 4 MB page. */
+    bool large;    /* Loaded as part of a 4 MB page. */
 };
 
+void spt_init(void);
 void add_spt_entry_file(struct file *file, off_t ofs, uint8_t *upage,
                         uint32_t read_bytes, uint32_t zero_bytes, bool writable);
 bool add_spt_entry_mmap(struct file *file, off_t ofs, uint8_t *upage,
                         uint32_t read_bytes, uint32_t zero_bytes, bool writable,
                         int mapid);
 void remove_spt_entry(struct thread *t);
+void remove_spt_range(struct thread *t, void *lo, void *hi);
 void remove_mmap_spt_entry(int mapid);
 struct spt_entry *fetch_spt_entry(void *upage);
 bool handle_page_fault(void *upage, void *esp);
@@ -41,4 +46,7 @@ void load_spte_zero(struct spt_entry *entry_p);
 void load_spte_swap(struct spt_entry *entry_p);
 void load_spte_file(struct spt_entry *entry_p);
 void grow_stack(void *upage);
-void write_back(struct spt_entry *entry_p, void *kpage, bool is_dirty);
\ No newline at end of file
+void write_back(struct spt_entry *entry_p, void *kpage, bool is_dirty);
+int spt_want_large(void *lo, void *hi);
+void large_get_stats(struct memstat *ms);
+void large_print_stats(void);
\ No newline at end of file
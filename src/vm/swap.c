@@ -1,11 +1,21 @@
 #include "swap.h"
+#include "threads/highmem.h"
+#include "threads/pgops.h"
+#include "threads/slab.h"
 #include "threads/synch.h"
+#include "threads/trace.h"
+#include "threads/tsc.h"
 #include "threads/vaddr.h"
 
 #define BLOCK_PER_PAGE (PGSIZE / DISK_SECTOR_SIZE)
 
+/* Cache of swap slot records. */
+static struct kmem_cache swap_cache;
+
 void swap_init(void)
 {
+    kmem_cache_init(&swap_cache, "swap_entry", sizeof(struct swap_entry), NULL,
+                    MEM_VM);
     swap_disk = disk_get(1, 1);
     lock_init(&swap_lock);
     swap_bitmap = bitmap_create(disk_size(swap_disk) / BLOCK_PER_PAGE);
@@ -14,7 +24,21 @@ void swap_init(void)
 struct swap_entry *save_swap(void *upage)
 {
     // printf("saving swap %p\n", upage);
-    struct swap_entry *entry_p = malloc(sizeof(struct swap_entry));
+    struct swap_entry *entry_p = kmem_cache_alloc(&swap_cache);
+    uint64_t start = rdtsc();
+
+    /* Memory beyond the kernel's direct map cannot hold user
+       pages, but it can hold their contents, which is much cheaper
+       than going to disk. */
+    entry_p->high_pfn = highmem_alloc();
+    if (entry_p->high_pfn != 0)
+    {
+        void *copy = kmap(entry_p->high_pfn);
+        copy_page(copy, upage);
+        kunmap(copy);
+        return entry_p;
+    }
+
     lock_acquire(&swap_lock);
     entry_p->swap_idx = BLOCK_PER_PAGE * bitmap_scan_and_flip(swap_bitmap, 0, 1, false);
 
@@ -24,12 +48,25 @@ struct swap_entry *save_swap(void *upage)
         disk_write(swap_disk, entry_p->swap_idx + i, upage + i * DISK_SECTOR_SIZE);
     }
     lock_release(&swap_lock);
+    TRACE(TRACE_SWAP_OUT, entry_p->swap_idx, upage, rdtsc() - start);
     return entry_p;
 }
 
 void load_swap(void *kpage, struct swap_entry *entry_p)
 {
+    uint64_t start = rdtsc();
     int i;
+
+    if (entry_p->high_pfn != 0)
+    {
+        void *copy = kmap(entry_p->high_pfn);
+        copy_page(kpage, copy);
+        kunmap(copy);
+        highmem_free(entry_p->high_pfn);
+        kmem_cache_free(&swap_cache, entry_p);
+        return;
+    }
+
     for (i = 0; i < BLOCK_PER_PAGE; i++)
     {
         disk_read(swap_disk, entry_p->swap_idx + i, kpage + i * DISK_SECTOR_SIZE);
@@ -37,6 +74,23 @@ void load_swap(void *kpage, struct swap_entry *entry_p)
     lock_acquire(&swap_lock);
     bitmap_flip(swap_bitmap, entry_p->swap_idx / BLOCK_PER_PAGE);
     lock_release(&swap_lock);
+    TRACE(TRACE_SWAP_IN, entry_p->swap_idx, kpage, rdtsc() - start);
+
+    kmem_cache_free(&swap_cache, entry_p);
+}
 
-    free(entry_p);
+/* Frees the saved copy of a page that will never be loaded back,
+   because its process is exiting or its region is being removed:
+   the high memory page or swap slot, and ENTRY_P itself. */
+void swap_discard(struct swap_entry *entry_p)
+{
+    if (entry_p->high_pfn != 0)
+        highmem_free(entry_p->high_pfn);
+    else
+    {
+        lock_acquire(&swap_lock);
+        bitmap_reset(swap_bitmap, entry_p->swap_idx / BLOCK_PER_PAGE);
+        lock_release(&swap_lock);
+    }
+    kmem_cache_free(&swap_cache, entry_p);
 }
\ No newline at end of file
@@ -5,6 +5,7 @@
 struct swap_entry
 {
     disk_sector_t swap_idx;
+    size_t high_pfn; /* High memory page holding the data, or 0 if on disk. */
 };
 
 struct disk *swap_disk;
@@ -14,3 +15,4 @@ struct bitmap *swap_bitmap;
 void swap_init(void);
 struct swap_entry *save_swap(void *upage);
 void load_swap(void *upage, struct swap_entry *entry_p);
+void swap_discard(struct swap_entry *entry_p);